@@ -0,0 +1,278 @@
+#include "BinanceConsolidatedBook.h"
+
+BinanceConsolidatedBook::BinanceConsolidatedBook(): fBooks(), fVenues(), fSubscriptions(), fBids(), fAsks(), fMutex(), fNVenues(0)
+{
+  pthread_mutex_init(&fMutex,NULL);
+
+  for(int i=0; i<CONSBOOK_MAX_VENUES; ++i) fSubscriptions[i]=-1;
+}
+
+BinanceConsolidatedBook::~BinanceConsolidatedBook()
+{
+  for(int i=0; i<CONSBOOK_MAX_VENUES; ++i) if(fBooks[i]) RemoveVenue(i);
+  pthread_mutex_destroy(&fMutex);
+}
+
+int BinanceConsolidatedBook::AddVenue(BinanceOrderBook* book, const consvenue& venue)
+{
+  int id;
+  pthread_mutex_lock(&fMutex);
+
+  for(id=0; id<CONSBOOK_MAX_VENUES; ++id) if(!fBooks[id]) break;
+
+  if(id==CONSBOOK_MAX_VENUES || venue.pricefactor<=0) {
+    pthread_mutex_unlock(&fMutex);
+    fprintf(stderr,"%s: Error: Too many venues or invalid conversion!\n",__func__);
+    return -1;
+  }
+  fBooks[id]=book;
+  fVenues[id]=venue;
+  ++fNVenues;
+  pthread_mutex_unlock(&fMutex);
+  //A loaded book notifies itself right away with BOOKUPDATE_RESET, which
+  //merges its current levels
+  const int sub=book->Subscribe(OnBookUpdate, this);
+
+  if(sub<0) {
+    fprintf(stderr,"%s: Error: Could not subscribe to the book!\n",__func__);
+    pthread_mutex_lock(&fMutex);
+    fBooks[id]=NULL;
+    --fNVenues;
+    pthread_mutex_unlock(&fMutex);
+    return -1;
+  }
+  fSubscriptions[id]=sub;
+  return id;
+}
+
+int BinanceConsolidatedBook::RemoveVenue(const int& id)
+{
+  if(id<0 || id>=CONSBOOK_MAX_VENUES || !fBooks[id]) return -1;
+  //No callback runs for the venue once Unsubscribe has returned
+  fBooks[id]->Unsubscribe(fSubscriptions[id]);
+  fSubscriptions[id]=-1;
+  pthread_mutex_lock(&fMutex);
+  ClearVenue(fBids, id);
+  ClearVenue(fAsks, id);
+  fBooks[id]=NULL;
+  --fNVenues;
+  pthread_mutex_unlock(&fMutex);
+  return 0;
+}
+
+bool BinanceConsolidatedBook::IsStale()
+{
+  bool ret=false;
+  pthread_mutex_lock(&fMutex);
+
+  for(int i=0; i<CONSBOOK_MAX_VENUES; ++i) if(fBooks[i] && fBooks[i]->IsStale()) ret=true;
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+void BinanceConsolidatedBook::OnBookUpdate(const BinanceOrderBook& bob, const bookupdate& update, void* userdata)
+{
+  BinanceConsolidatedBook& cb=*(BinanceConsolidatedBook*)userdata;
+  int venue;
+  pthread_mutex_lock(&cb.fMutex);
+
+  for(venue=0; venue<CONSBOOK_MAX_VENUES; ++venue) if(cb.fBooks[venue]==&bob) break;
+
+  if(venue==CONSBOOK_MAX_VENUES) {
+    pthread_mutex_unlock(&cb.fMutex);
+    return;
+  }
+
+  if(update.flags&BOOKUPDATE_RESET) cb.Rebuild(venue);
+
+  else {
+    const double factor=cb.fVenues[venue].pricefactor;
+
+    for(uint32_t i=0; i<update.nchanges; ++i) {
+      const booklevelchange& change=update.changes[i];
+      const double quantity=cb.ConvertQuantity(venue, change.price, change.quantity);
+
+      if(change.side==book_bid) SetLevel(cb.fBids, venue, change.price*factor, quantity);
+
+      else SetLevel(cb.fAsks, venue, change.price*factor, quantity);
+    }
+  }
+  pthread_mutex_unlock(&cb.fMutex);
+}
+
+template<typename M> void BinanceConsolidatedBook::SetLevel(M& levels, const int& venue, const double& price, const double& quantity)
+{
+  //fMutex must be locked before calling this function!
+  typename M::iterator it=levels.find(price);
+
+  if(it==levels.end()) {
+
+    if(!quantity) return;
+    conslevel& level=levels[price];
+    memset(&level, 0, sizeof(conslevel));
+    level.quantity=level.venues[venue]=quantity;
+    return;
+  }
+  conslevel& level=it->second;
+  level.venues[venue]=quantity;
+  //Summed from the venue quantities rather than adjusted, so that no
+  //rounding error accumulates. The sum of non-negative quantities is only
+  //0 when every venue has left the level.
+  level.quantity=0;
+
+  for(int i=0; i<CONSBOOK_MAX_VENUES; ++i) level.quantity+=level.venues[i];
+
+  if(!level.quantity) levels.erase(it);
+}
+
+template<typename M> void BinanceConsolidatedBook::ClearVenue(M& levels, const int& venue)
+{
+  //fMutex must be locked before calling this function!
+  for(typename M::iterator it=levels.begin(); it!=levels.end();) {
+
+    if(it->second.venues[venue]) {
+      conslevel& level=it->second;
+      level.venues[venue]=0;
+      level.quantity=0;
+
+      for(int i=0; i<CONSBOOK_MAX_VENUES; ++i) level.quantity+=level.venues[i];
+
+      if(!level.quantity) {
+	it=levels.erase(it);
+	continue;
+      }
+    }
+    ++it;
+  }
+}
+
+void BinanceConsolidatedBook::Rebuild(const int& venue)
+{
+  //fMutex must be locked before calling this function!
+  //Called from the book's callback, with the book's mutex held
+  const BinanceOrderBook& bob=*fBooks[venue];
+  const double factor=fVenues[venue].pricefactor;
+  ClearVenue(fBids, venue);
+  ClearVenue(fAsks, venue);
+  bob.ForEachBid([&](const double& price, const double& quantity){SetLevel(fBids, venue, price*factor, ConvertQuantity(venue, price, quantity)); return true;});
+  bob.ForEachAsk([&](const double& price, const double& quantity){SetLevel(fAsks, venue, price*factor, ConvertQuantity(venue, price, quantity)); return true;});
+}
+
+bool BinanceConsolidatedBook::GetBookAtSum(const double& bidsum, const double& asksum, bookvec* bids, bookvec* asks)
+{
+  double sum=0;
+  pthread_mutex_lock(&fMutex);
+
+  if(fBids.empty() || fAsks.empty()) {
+    pthread_mutex_unlock(&fMutex);
+    return false;
+  }
+
+  if(bidsum>0) {
+    bids->clear();
+
+    for(consbidmap::const_iterator it=fBids.begin(); it!=fBids.end() && sum<bidsum; ++it) {
+      sum+=it->second.quantity;
+      bids->push_back({it->first, it->second.quantity, sum});
+    }
+
+    if(sum<bidsum) {
+      pthread_mutex_unlock(&fMutex);
+      return false;
+    }
+  }
+  sum=0;
+
+  if(asksum>0) {
+    asks->clear();
+
+    for(consaskmap::const_iterator it=fAsks.begin(); it!=fAsks.end() && sum<asksum; ++it) {
+      sum+=it->second.quantity;
+      asks->push_back({it->first, it->second.quantity, sum});
+    }
+
+    if(sum<asksum) {
+      pthread_mutex_unlock(&fMutex);
+      return false;
+    }
+  }
+  pthread_mutex_unlock(&fMutex);
+  return true;
+}
+
+bool BinanceConsolidatedBook::GetSides(vwapside* bids, vwapside* asks, const size_t& maxlevels)
+{
+  size_t n;
+  pthread_mutex_lock(&fMutex);
+
+  if(fBids.empty() || fAsks.empty()) {
+    pthread_mutex_unlock(&fMutex);
+    return false;
+  }
+
+  if(bids) {
+    bids->Clear(true);
+    n=0;
+
+    for(consbidmap::const_iterator it=fBids.begin(); it!=fBids.end() && (!maxlevels || n<maxlevels); ++it, ++n) bids->Push(it->first, it->second.quantity);
+    bids->truncated=(n<fBids.size());
+  }
+
+  if(asks) {
+    asks->Clear(false);
+    n=0;
+
+    for(consaskmap::const_iterator it=fAsks.begin(); it!=fAsks.end() && (!maxlevels || n<maxlevels); ++it, ++n) asks->Push(it->first, it->second.quantity);
+    asks->truncated=(n<fAsks.size());
+  }
+  pthread_mutex_unlock(&fMutex);
+  return true;
+}
+
+template<typename M> bool BinanceConsolidatedBook::Sweep(const M& levels, const bool& bid, const double& quantity, vwapfill* fill, double* venuequantities)
+{
+  double left=quantity, amount=0, take;
+  pthread_mutex_lock(&fMutex);
+
+  if(venuequantities) memset(venuequantities, 0, CONSBOOK_MAX_VENUES*sizeof(double));
+
+  if(levels.empty() || quantity<=0) {
+    pthread_mutex_unlock(&fMutex);
+    return false;
+  }
+  const double best=levels.begin()->first;
+  typename M::const_iterator it;
+
+  for(it=levels.begin(); it!=levels.end(); ++it) {
+    take=(left<it->second.quantity?left:it->second.quantity);
+    amount+=take*it->first;
+
+    //A partially taken level is shared pro rata between its venues
+    if(venuequantities) for(int i=0; i<CONSBOOK_MAX_VENUES; ++i) venuequantities[i]+=it->second.venues[i]*take/it->second.quantity;
+    left-=take;
+
+    if(left<=0) break;
+  }
+
+  if(it==levels.end()) {
+    pthread_mutex_unlock(&fMutex);
+    return false;
+  }
+  fill->quantity=quantity;
+  fill->amount=amount;
+  fill->vwap=amount/quantity;
+  fill->worst=it->first;
+  fill->slippage=(bid?best-fill->vwap:fill->vwap-best)/best*1e4;
+  pthread_mutex_unlock(&fMutex);
+  return true;
+}
+
+bool BinanceConsolidatedBook::SweepAsks(const double& quantity, vwapfill* fill, double* venuequantities)
+{
+  return Sweep(fAsks, false, quantity, fill, venuequantities);
+}
+
+bool BinanceConsolidatedBook::SweepBids(const double& quantity, vwapfill* fill, double* venuequantities)
+{
+  return Sweep(fBids, true, quantity, fill, venuequantities);
+}
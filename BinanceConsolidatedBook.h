@@ -0,0 +1,104 @@
+#ifndef _BINANCECONSOLIDATEDBOOK_
+#define _BINANCECONSOLIDATEDBOOK_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include <vector>
+#include <map>
+#include <functional>
+
+#include <pthread.h>
+
+#include "BinanceOrderBook.h"
+#include "vwap_utils.h"
+
+//Maximum number of books merged into a consolidated book
+#ifndef CONSBOOK_MAX_VENUES
+#define CONSBOOK_MAX_VENUES 4
+#endif
+
+//Conversion of a venue's levels into the consolidated units
+struct consvenue
+{
+  consvenue(const double& contractsize=0, const double& pricefactor=1): contractsize(contractsize), pricefactor(pricefactor) {}
+
+  //Quote value of a contract for books quoted in contracts (COIN-M, e.g.
+  //100 for BTCUSD_PERP), whose quantities are converted to base units as
+  //contracts*contractsize/price. 0 if the quantities are in base units.
+  double contractsize;
+  //Multiplies the venue's prices, to express them in the consolidated
+  //quote currency (e.g. the USDT/USD rate for a USDT-margined book)
+  double pricefactor;
+};
+
+//Consolidated level, with the base quantity offered by each venue
+struct conslevel
+{
+  double quantity; //Sum of the venue quantities
+  double venues[CONSBOOK_MAX_VENUES];
+};
+
+//Merges several books of the same underlying (e.g. spot, USD-M and COIN-M)
+//into a single book in base units and in a common quote currency. The
+//merged levels are updated incrementally from the depth changes notified
+//by each book, so a tick of one venue only touches the levels it
+//changed. A venue whose book is replaced (snapshot, checkpoint) is rebuilt
+//on its own.
+class BinanceConsolidatedBook
+{
+  public:
+  BinanceConsolidatedBook();
+  ~BinanceConsolidatedBook();
+
+  //Returns the venue id, or -1 if there are too many venues. The book must
+  //outlive the consolidated book or be removed first.
+  int AddVenue(BinanceOrderBook* book, const consvenue& venue=consvenue());
+  int RemoveVenue(const int& id);
+
+  //True if any of the venues is being resynchronised
+  bool IsStale();
+
+  //Same semantics as BinanceOrderBook::GetViewBookAtSum, on the merged
+  //levels. Returns false if the book is empty or not deep enough.
+  bool GetBookAtSum(const double& bidsum, const double& asksum, bookvec* bids=NULL, bookvec* asks=NULL);
+
+  //Copies up to maxlevels merged levels per side for the vwap_fill_*
+  //batch queries (all the levels if maxlevels is 0)
+  bool GetSides(vwapside* bids, vwapside* asks, const size_t& maxlevels=0);
+
+  //Sweeps the asks (buy) or the bids (sell) for a base quantity. Returns
+  //false if the book is not deep enough. If not NULL, venuequantities
+  //receives the base quantity taken on each venue (indexed by venue id).
+  bool SweepAsks(const double& quantity, vwapfill* fill, double* venuequantities=NULL);
+  bool SweepBids(const double& quantity, vwapfill* fill, double* venuequantities=NULL);
+
+  inline size_t GetNVenues() const {return fNVenues;}
+
+  protected:
+  typedef std::map<double, conslevel, std::greater<double> > consbidmap;
+  typedef std::map<double, conslevel> consaskmap;
+
+  static void OnBookUpdate(const BinanceOrderBook& bob, const bookupdate& update, void* userdata);
+  template<typename M> bool Sweep(const M& levels, const bool& bid, const double& quantity, vwapfill* fill, double* venuequantities);
+
+  //fMutex must be locked before calling these functions!
+  template<typename M> static void SetLevel(M& levels, const int& venue, const double& price, const double& quantity);
+  template<typename M> static void ClearVenue(M& levels, const int& venue);
+  void Rebuild(const int& venue);
+
+  inline double ConvertQuantity(const int& venue, const double& price, const double& quantity) const {return (fVenues[venue].contractsize>0?quantity*fVenues[venue].contractsize/price:quantity);}
+
+  BinanceOrderBook* fBooks[CONSBOOK_MAX_VENUES];
+  consvenue fVenues[CONSBOOK_MAX_VENUES];
+  int fSubscriptions[CONSBOOK_MAX_VENUES];
+  consbidmap fBids;
+  consaskmap fAsks;
+  pthread_mutex_t fMutex;
+  size_t fNVenues;
+  private:
+};
+
+#endif
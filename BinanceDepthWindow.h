@@ -0,0 +1,115 @@
+#ifndef _BINANCEDEPTHWINDOW_
+#define _BINANCEDEPTHWINDOW_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <vector>
+#include <algorithm>
+
+//Fixed-capacity book side keeping only the best levels. As for
+//BinancePriceLadder, smaller keys are better prices (asks use +price and
+//bids use -price). Levels are stored sorted from the worst to the best key,
+//so that the frequent changes close to the touch only move a few entries.
+//
+//Once the window has been full, it is bounded: the levels worse than the
+//boundary key are unknown and updates beyond it are ignored. Removing levels
+//inside the window does not move the boundary, so the known depth shrinks
+//until the book is reloaded (see IsDepleted).
+template<typename K, typename Q> class BinanceDepthWindow
+{
+  public:
+  BinanceDepthWindow(const size_t& capacity): fKeys(capacity>0?capacity:1), fQty(capacity>0?capacity:1), fCapacity(capacity>0?capacity:1), fSize(0), fBoundary(), fBounded(false) {}
+
+  //Returns 0 if the update lies beyond the boundary and was ignored, 1 if
+  //it was applied and 2 if the worst level was evicted to make room for
+  //it, in which case its key is stored in evicted (if not NULL)
+  inline int Set(const K& key, const Q& qty, K* evicted=NULL)
+  {
+    if(fBounded && key>fBoundary) return 0;
+    //First position (from the worst) whose key is not worse than key
+    const size_t pos=std::lower_bound(fKeys.begin(), fKeys.begin()+fSize, key, [](const K& lhs, const K& rhs){return (lhs>rhs);})-fKeys.begin();
+
+    if(pos<fSize && fKeys[pos]==key) {
+
+      if(qty) fQty[pos]=qty;
+
+      else {
+	memmove(&fKeys[pos], &fKeys[pos+1], (fSize-pos-1)*sizeof(K));
+	memmove(&fQty[pos], &fQty[pos+1], (fSize-pos-1)*sizeof(Q));
+	--fSize;
+      }
+      return 1;
+    }
+
+    if(!qty) return 1;
+
+    if(fSize==fCapacity) {
+
+      //Worse than every stored level: the window becomes bounded by its
+      //worst level and the new one is dropped
+      if(!pos) {
+	fBoundary=fKeys[0];
+	fBounded=true;
+	return 0;
+      }
+      //Otherwise the worst level is evicted
+      if(evicted) *evicted=fKeys[0];
+      memmove(&fKeys[0], &fKeys[1], (pos-1)*sizeof(K));
+      memmove(&fQty[0], &fQty[1], (pos-1)*sizeof(Q));
+      fKeys[pos-1]=key;
+      fQty[pos-1]=qty;
+      fBoundary=fKeys[0];
+      fBounded=true;
+      return 2;
+    }
+    memmove(&fKeys[pos+1], &fKeys[pos], (fSize-pos)*sizeof(K));
+    memmove(&fQty[pos+1], &fQty[pos], (fSize-pos)*sizeof(Q));
+    fKeys[pos]=key;
+    fQty[pos]=qty;
+    ++fSize;
+    return 1;
+  }
+
+  inline Q Get(const K& key) const
+  {
+    const size_t pos=std::lower_bound(fKeys.begin(), fKeys.begin()+fSize, key, [](const K& lhs, const K& rhs){return (lhs>rhs);})-fKeys.begin();
+    return (pos<fSize && fKeys[pos]==key?fQty[pos]:Q());
+  }
+
+  inline void Clear(){fSize=0; fBounded=false;}
+
+  //To be called once a truncated snapshot has been loaded: a full window
+  //gets bounded by its worst level, while a partial one holds the whole side
+  inline void Seal(){if(fSize==fCapacity) {fBoundary=fKeys[0]; fBounded=true;}}
+
+  inline bool Empty() const {return !fSize;}
+  inline size_t Size() const {return fSize;}
+  inline size_t Capacity() const {return fCapacity;}
+  inline bool IsBounded() const {return fBounded;}
+  inline const K& Boundary() const {return fBoundary;}
+
+  //True when less than half of the window is known, in which case the side
+  //should be reloaded
+  inline bool IsDepleted() const {return (fBounded && 2*fSize<fCapacity);}
+
+  inline K BestKey() const {return (fSize?fKeys[fSize-1]:K());}
+
+  //Calls f(key, qty) from the best level outwards until f returns false
+  template<typename F> inline void ForEach(F f) const
+  {
+    for(size_t i=fSize; i>0; --i) if(!f(fKeys[i-1],fQty[i-1])) return;
+  }
+
+  protected:
+  std::vector<K> fKeys;
+  std::vector<Q> fQty;
+  size_t fCapacity;
+  size_t fSize;
+  K fBoundary;
+  bool fBounded;
+  private:
+};
+
+#endif
@@ -1,7 +1,7 @@
 #include "BinanceEndpoint.h"
 #include "conv_utils.h"
 
-BinanceEndpoint::BinanceEndpoint(const char* configfile): fCHandle(curl_easy_init()), fHeaders(NULL), fJSTok(json_tokener_new()), fJObj(NULL), fCode(NULL), fSigBuf(), fCodeLength(0), fNeedCleanup(false)
+BinanceEndpoint::BinanceEndpoint(const char* configfile): fCHandle(), fLoop(NULL), fHeaders(NULL), fJSTok(json_tokener_new()), fJObj(NULL), fCode(NULL), fSigner(), fURLBuf(NULL), fArgBuf(NULL), fURLBufSize(0), fArgBufSize(0), fCodeLength(0), fDebug(0), fNeedCleanup(false)
 {
   int fid=open(configfile,0);
 
@@ -61,6 +61,7 @@ BinanceEndpoint::BinanceEndpoint(const char* configfile): fCHandle(curl_easy_ini
     if(json_object_object_get_ex(jobj, "secretKey", &val)) {
       fCode=(unsigned char*)strdup(json_object_get_string(val));
       fCodeLength=strlen((char*)fCode);
+      fSigner.SetKey(fCode, fCodeLength);
 
     } else {
       fprintf(stderr,"%s: Error: Could not read secretKey\n",__func__);
@@ -72,11 +73,54 @@ BinanceEndpoint::BinanceEndpoint(const char* configfile): fCHandle(curl_easy_ini
     json_tokener_reset(fJSTok);
   }
 
-  curl_easy_setopt(fCHandle,CURLOPT_NOSIGNAL,1);
-  curl_easy_setopt(fCHandle, CURLOPT_WRITEFUNCTION, CurlCB);
-  curl_easy_setopt(fCHandle, CURLOPT_WRITEDATA, this);
-  //curl_easy_setopt(fCHandle, CURLOPT_VERBOSE, 1L);
-  //curl_easy_setopt(fCHandle, CURLOPT_DEBUGFUNCTION, debug_callback);
+
+  if(Reserve(fURLBuf, fURLBufSize, BIN_REQUEST_BUFSIZE) || Reserve(fArgBuf, fArgBufSize, BIN_REQUEST_BUFSIZE)) throw 0;
+
+  //The options of each verb are set once, so a request only sets its URL,
+  //headers and body
+  for(int i=0; i<BIN_EP_NTYPES; ++i) {
+    fCHandle[i]=curl_easy_init();
+
+    if(!fCHandle[i]) {
+      fprintf(stderr,"%s: Error: Could not create a curl handle!\n",__func__);
+      throw 0;
+    }
+    BinanceRestTransport::Instance().Setup(fCHandle[i]);
+    curl_easy_setopt(fCHandle[i],CURLOPT_NOSIGNAL,1);
+    curl_easy_setopt(fCHandle[i], CURLOPT_WRITEFUNCTION, CurlCB);
+    curl_easy_setopt(fCHandle[i], CURLOPT_WRITEDATA, this);
+  }
+  curl_easy_setopt(fCHandle[bieneptype_post], CURLOPT_POST, 1L);
+  curl_easy_setopt(fCHandle[bieneptype_put], CURLOPT_UPLOAD, 1L);
+  curl_easy_setopt(fCHandle[bieneptype_put], CURLOPT_INFILESIZE, 0L);
+  curl_easy_setopt(fCHandle[bieneptype_delete], CURLOPT_CUSTOMREQUEST, "DELETE");
+}
+
+void BinanceEndpoint::SetDebug(const int& level)
+{
+  fDebug=level;
+
+  for(int i=0; i<BIN_EP_NTYPES; ++i) {
+    curl_easy_setopt(fCHandle[i], CURLOPT_VERBOSE, (level>1?1L:0L));
+    curl_easy_setopt(fCHandle[i], CURLOPT_DEBUGFUNCTION, (level>1?debug_callback:NULL));
+  }
+}
+
+int BinanceEndpoint::Reserve(char*& buf, size_t& size, const size_t& needed)
+{
+  if(needed<=size) return 0;
+  size_t newsize=(size?size:BIN_REQUEST_BUFSIZE);
+
+  while(newsize<needed) newsize*=2;
+  char* newbuf=(char*)realloc(buf, newsize);
+
+  if(!newbuf) {
+    fprintf(stderr,"%s: Error: Could not allocate a %lu bytes buffer!\n",__func__,(unsigned long)newsize);
+    return -1;
+  }
+  buf=newbuf;
+  size=newsize;
+  return 0;
 }
 
 int BinanceEndpoint::debug_callback(CURL *handle, curl_infotype type, char *data, size_t size, void *userptr)
@@ -125,151 +169,127 @@ int BinanceEndpoint::PingServer(const bintype& btype)
 }
 
 int BinanceEndpoint::Request(const bintype& btype, const binep& ep, const std::string& args, const int& sign)
+{
+  char* query=BeginRequest(btype, ep.cmd.data(), ep.cmd.size(), ep.type, args.size());
+
+  if(!query) return -1;
+  memcpy(query, args.data(), args.size());
+  return PerformRequest(ep.type, query, args.size(), sign);
+}
+
+char* BinanceEndpoint::BeginRequest(const bintype& btype, const char* cmd, const size_t& cmdlen, const bineptype& type, const size_t& maxarglength)
 {
   if(fNeedCleanup) {
     json_object_put(fJObj);
     json_tokener_reset(fJSTok);
     fNeedCleanup=false;
   }
-  char* url=(char*)malloc(btype.ep.size()+ep.cmd.size()+43+args.size()+2*EVP_MAX_MD_SIZE);
-  memcpy(url, btype.ep.c_str(), btype.ep.size());
-  size_t urllength=btype.ep.size();
-  memcpy(url+urllength, ep.cmd.c_str(), ep.cmd.size());
-  urllength+=ep.cmd.size();
-  char* buf;
-  int arglength;
+  const size_t urllength=btype.ep.size()+cmdlen;
+  char* query;
 
-  if(sign==binepsign_true) {
-    uint64_t mstime=getmstime();
-    int len;
+  //The query follows the URL, except for POST requests where it is the body
+  if(type==bieneptype_post) {
 
-    if(!args.empty()) {
-      buf=(char*)malloc(args.size()+42+2*EVP_MAX_MD_SIZE);
-      memcpy(buf,args.c_str(),args.size());
-      len=args.size()+sprintf(buf+args.size(),"&timestamp=%" PRIu64 "&signature=",mstime);
-      //len=args.size()+sprintf(buf+args.size(),"&signature=");
-
-    } else {
-      buf=(char*)malloc(42+2*EVP_MAX_MD_SIZE);
-      len=sprintf(buf,"timestamp=%" PRIu64 "&signature=",mstime);
-      //len=sprintf(buf,"&signature=");
-    }
-    printf("String to be signed (%i): '%.*s'\n",len,len-11,buf);
-    unsigned int len2=EVP_MAX_MD_SIZE;
-    mx_hmac_sha256(fCode,fCodeLength,buf,len-11,fSigBuf,&len2);
-
-    for(unsigned int i=0; i<len2; ++i) {
-      printf("%02x",fSigBuf[i]);
-      buf[len+2*i]=uint4toasciihex(fSigBuf[i]>>4);
-      buf[len+2*i+1]=uint4toasciihex(fSigBuf[i] & 0xF);
-    }
-    printf("\n");
-    arglength=len+2*len2;
-    printf("Full is '%.*s'\n",arglength,buf);
-    curl_easy_setopt(fCHandle, CURLOPT_HTTPHEADER, fHeaders);
+    if(Reserve(fURLBuf, fURLBufSize, urllength+1) || Reserve(fArgBuf, fArgBufSize, maxarglength+BIN_REQUEST_SIGLENGTH)) return NULL;
+    fURLBuf[urllength]=0;
+    query=fArgBuf;
 
   } else {
-    buf=(char*)malloc(args.size());
 
-    if(args.empty()) arglength=0;
-    else {
-      arglength=args.size();
-      memcpy(buf, args.c_str(), arglength);
-    }
+    if(Reserve(fURLBuf, fURLBufSize, urllength+maxarglength+BIN_REQUEST_SIGLENGTH)) return NULL;
+    query=fURLBuf+urllength;
+  }
+  memcpy(fURLBuf, btype.ep.data(), btype.ep.size());
+  memcpy(fURLBuf+btype.ep.size(), cmd, cmdlen);
+  return query;
+}
+
+int BinanceEndpoint::PerformRequest(const bineptype& type, char* query, size_t arglength, const int& sign)
+{
+  CURL* handle=fCHandle[type];
+
+  if(sign==binepsign_true) {
+
+    if(arglength) query[arglength++]='&';
+    memcpy(query+arglength, "timestamp=", 10);
+    arglength+=10;
+    arglength+=uint64toascii(getmstime(), query+arglength);
+
+    if(fDebug) printf("String to be signed (%i): '%.*s'\n",(int)arglength,(int)arglength,query);
+    memcpy(query+arglength, "&signature=", 11);
+    fSigner.SignHex(query, arglength, query+arglength+11);
+    arglength+=11+HMAC_SHA256_HEXLENGTH;
+  }
+  query[arglength]=0;
 
-    if(sign==binepsign_apikey) curl_easy_setopt(fCHandle, CURLOPT_HTTPHEADER, fHeaders);
+  if(type==bieneptype_post) {
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDS, query);
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)arglength);
 
-    else curl_easy_setopt(fCHandle, CURLOPT_HTTPHEADER, NULL);
+    if(fDebug) printf("Body is '%s'\n",query);
   }
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, (sign==binepsign_false?NULL:fHeaders));
+
+  if(fDebug) printf("URL is '%s'\n",fURLBuf);
+  curl_easy_setopt(handle, CURLOPT_URL, fURLBuf);
 
-  switch(ep.type) {
-
-    case bieneptype_get:
-
-      if(arglength) {
-	memcpy(url+urllength,buf,arglength);
-	url[urllength+arglength]=0;
-
-      } else url[urllength]=0;
-      printf("URL is '%s'\n",url);
-      curl_easy_setopt(fCHandle, CURLOPT_URL, url); 
-      free(url);
-
-      if(curl_easy_perform(fCHandle)) {
-	fprintf(stderr,"curl_easy_perform: An error was returned!\n");
-	free(buf);
-	return -1;
-      }
-      break;
-
-    case bieneptype_post:
-      url[urllength]=0;
-
-      if(arglength) {
-	curl_easy_setopt(fCHandle, CURLOPT_POSTFIELDS, buf);
-	curl_easy_setopt(fCHandle, CURLOPT_POSTFIELDSIZE, arglength);
-
-      } else {
-	curl_easy_setopt(fCHandle, CURLOPT_POST,1L);
-	curl_easy_setopt(fCHandle, CURLOPT_POSTFIELDSIZE, 0);
-      }
-      printf("URL is '%s'\n",url);
-      curl_easy_setopt(fCHandle, CURLOPT_URL, url); 
-      free(url);
-
-      if(curl_easy_perform(fCHandle)) {
-	fprintf(stderr,"curl_easy_perform: An error was returned!\n");
-	free(buf);
-	curl_easy_setopt(fCHandle, CURLOPT_POST,0);
-	return -1;
-      }
-      curl_easy_setopt(fCHandle, CURLOPT_POST,0);
-      break;
-
-    case bieneptype_put:
-
-      if(arglength) {
-	memcpy(url+urllength,buf,arglength);
-	url[urllength+arglength]=0;
-
-      } else url[urllength]=0;
-      curl_easy_setopt(fCHandle, CURLOPT_UPLOAD, 1L);
-      curl_easy_setopt(fCHandle, CURLOPT_INFILESIZE, 0);
-      printf("URL is '%s'\n",url);
-      curl_easy_setopt(fCHandle, CURLOPT_URL, url); 
-      free(url);
-
-      if(curl_easy_perform(fCHandle)) {
-	fprintf(stderr,"curl_easy_perform: An error was returned!\n");
-	free(buf);
-        curl_easy_setopt(fCHandle, CURLOPT_UPLOAD, 0L);
-	return -1;
-      }
-      curl_easy_setopt(fCHandle, CURLOPT_UPLOAD, 0L);
-
-      break;
-
-    case bieneptype_delete:
-
-      if(arglength) {
-	memcpy(url+urllength,buf,arglength);
-	url[urllength+arglength]=0;
-
-      } else url[urllength]=0;
-      curl_easy_setopt(fCHandle, CURLOPT_CUSTOMREQUEST, "DELETE");
-      printf("URL is '%s'\n",url);
-      curl_easy_setopt(fCHandle, CURLOPT_URL, url); 
-      free(url);
-
-      if(curl_easy_perform(fCHandle)) {
-	fprintf(stderr,"curl_easy_perform: An error was returned!\n");
-	free(buf);
-        curl_easy_setopt(fCHandle, CURLOPT_CUSTOMREQUEST, NULL);
-	return -1;
-      }
-      curl_easy_setopt(fCHandle, CURLOPT_CUSTOMREQUEST, NULL);
+  if(curl_easy_perform(handle)) {
+    fprintf(stderr,"curl_easy_perform: An error was returned!\n");
+    return -1;
   }
-  free(buf);
   fNeedCleanup=true;
   return 0;
 }
+
+int BinanceEndpoint::RequestAsync(const bintype& btype, const binep& ep, const std::string& args, const int& sign, binrestcallback callback, void* userdata)
+{
+  if(!fLoop) {
+    fprintf(stderr,"%s: Error: No request loop has been set!\n",__func__);
+    return -1;
+  }
+  restrequest* request=new restrequest;
+  std::string query=args;
+  request->url=btype.ep+ep.cmd;
+  request->type=ep.type;
+  request->headers=(sign==binepsign_false?NULL:fHeaders);
+  request->callback=callback;
+  request->userdata=userdata;
+
+  if(sign==binepsign_true) {
+    //The signer can be used concurrently
+    char buf[HMAC_SHA256_HEXLENGTH];
+    query+=(args.empty()?"timestamp=":"&timestamp=");
+    query.append(buf, uint64toascii(getmstime(), buf));
+    fSigner.SignHex(query.data(), query.size(), buf);
+    query+="&signature=";
+    query.append(buf, HMAC_SHA256_HEXLENGTH);
+  }
+
+  if(ep.type==bieneptype_post) request->fields.swap(query);
+
+  else request->url+=query;
+  fLoop->Submit(request);
+  return 0;
+}
+
+void BinanceEndpoint::SetPromise(const binresponse& response, void* userdata)
+{
+  std::promise<binresponse>* promise=(std::promise<binresponse>*)userdata;
+
+  //The reply outlives the callback
+  if(response.jobj) json_object_get(response.jobj);
+  promise->set_value(response);
+  delete promise;
+}
+
+std::future<binresponse> BinanceEndpoint::RequestAsync(const bintype& btype, const binep& ep, const std::string& args, const int& sign)
+{
+  std::promise<binresponse>* promise=new std::promise<binresponse>;
+  std::future<binresponse> future=promise->get_future();
+
+  if(RequestAsync(btype, ep, args, sign, SetPromise, promise)) {
+    promise->set_value({-1, 0, NULL});
+    delete promise;
+  }
+  return future;
+}
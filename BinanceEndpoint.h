@@ -12,7 +12,7 @@
 #include <fcntl.h>
 
 #include <string>
-
+#include <future>
 
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
@@ -21,6 +21,19 @@
 #include <json-c/json.h>
 
 #include "binance_base.h"
+#include "hmac_utils.h"
+#include "binance_orders.h"
+#include "BinanceRestTransport.h"
+#include "BinanceRestLoop.h"
+
+//Initial size of the URL and argument buffers, which grow as needed
+#ifndef BIN_REQUEST_BUFSIZE
+#define BIN_REQUEST_BUFSIZE 512
+#endif
+
+//Room taken by the timestamp, the signature and the terminating null
+//character of a signed query
+#define BIN_REQUEST_SIGLENGTH (43+HMAC_SHA256_HEXLENGTH)
 
 inline unsigned char *mx_hmac_sha256(const unsigned char* code, int codelen,
     const void *data, int datalen,
@@ -33,26 +46,92 @@ class BinanceEndpoint
 {
   public:
     BinanceEndpoint(const char* configfile);
-    ~BinanceEndpoint(){if(fNeedCleanup) {json_object_put(fJObj); json_tokener_reset(fJSTok);} if(fCode) free(fCode); json_tokener_free(fJSTok); if(fHeaders) curl_slist_free_all(fHeaders); curl_easy_cleanup(fCHandle);}
+    ~BinanceEndpoint(){if(fNeedCleanup) {json_object_put(fJObj); json_tokener_reset(fJSTok);} if(fCode) free(fCode); json_tokener_free(fJSTok); if(fHeaders) curl_slist_free_all(fHeaders); for(int i=0; i<BIN_EP_NTYPES; ++i) curl_easy_cleanup(fCHandle[i]); free(fURLBuf); free(fArgBuf);}
 
     inline json_object*& GetJObj(){return fJObj;}
+    //Credentials, for clients signing their own requests (e.g.
+    //BinanceWSOrderClient)
+    inline const char* GetAPIKey() const {return fHeaders->data+14;}
+    inline const hmacsigner& GetSigner() const {return fSigner;}
 
+    //The URL and the query are built in buffers reused from one request to
+    //the next, and the request is performed by a curl handle already
+    //configured for its HTTP verb, so the request itself does not allocate
+    //memory once the buffers are large enough.
     int Request(const bintype& btype, const binep& ep, const std::string& args=binempty, const int& sign=binepsign_false);
 
+    //Typed request (binneworder, bincancelorder, bincancelreplace or
+    //binqueryorder), whose endpoint, verb and signing mode are resolved at
+    //compile time, and which is serialized straight into the request buffer
+    template<typename T> int Request(const bintype& btype, const T& req)
+    {
+      constexpr binepdesc ep=T::Endpoint();
+      char* query=BeginRequest(btype, ep.cmd, ep.cmdlen, ep.type, req.MaxLength());
+
+      if(!query) return -1;
+      return PerformRequest(ep.type, query, req.Serialize(query), ep.sign);
+    }
+
+    //Level 0 prints nothing to stdout, level 1 prints the signed strings and
+    //the URLs, and level 2 also prints curl's verbose output
+    void SetDebug(const int& level);
+
+    //Requests performed by loop, several of them being in flight at once.
+    //The loop can be shared by several endpoints.
+    inline void SetRestLoop(BinanceRestLoop* loop){fLoop=loop;}
+
+    //Builds and signs the request on the calling thread, and returns 0
+    //once it has been queued. callback is invoked from the loop's thread.
+    //Returns -1 without invoking the callback if no loop is set.
+    int RequestAsync(const bintype& btype, const binep& ep, const std::string& args, const int& sign, binrestcallback callback, void* userdata=NULL);
+
+    //Same, completing a future. The caller owns the jobj of the response
+    //and must release it with json_object_put.
+    std::future<binresponse> RequestAsync(const bintype& btype, const binep& ep, const std::string& args=binempty, const int& sign=binepsign_false);
+
+    //Typed asynchronous request
+    template<typename T> int RequestAsync(const bintype& btype, const T& req, binrestcallback callback, void* userdata=NULL)
+    {
+      constexpr binepdesc ep=T::Endpoint();
+      std::string args(req.MaxLength(), 0);
+      args.resize(req.Serialize(&args[0]));
+      return RequestAsync(btype, binep{std::string(ep.cmd, ep.cmdlen), ep.type}, args, ep.sign, callback, userdata);
+    }
+
     uint64_t GetServerTime(const bintype& btype);
     int PingServer(const bintype& btype);
 
     static size_t CurlCB(char *ptr, size_t size, size_t nmemb, void *instance);
     static int debug_callback(CURL *handle, curl_infotype type, char *data, size_t size, void *userptr);
 
+    //Callback completing the std::promise<binresponse>* passed as userdata,
+    //which it deletes
+    static void SetPromise(const binresponse& response, void* userdata);
+
   protected:
-    CURL* fCHandle;
+    static int Reserve(char*& buf, size_t& size, const size_t& needed);
+
+    //Writes the URL of a request whose query is at most maxarglength
+    //characters long, and returns where the query must be written (NULL on
+    //error)
+    char* BeginRequest(const bintype& btype, const char* cmd, const size_t& cmdlen, const bineptype& type, const size_t& maxarglength);
+    //Signs the query of arglength characters at query if needed, and
+    //performs the request
+    int PerformRequest(const bineptype& type, char* query, size_t arglength, const int& sign);
+
+    CURL* fCHandle[BIN_EP_NTYPES]; //One handle per HTTP verb, indexed by bineptype
+    BinanceRestLoop* fLoop;
     struct curl_slist *fHeaders;
     json_tokener* fJSTok;
     json_object* fJObj;
     unsigned char* fCode;
-    unsigned char fSigBuf[EVP_MAX_MD_SIZE];
+    hmacsigner fSigner; //Keyed with fCode
+    char* fURLBuf;
+    char* fArgBuf; //Body of POST requests
+    size_t fURLBufSize;
+    size_t fArgBufSize;
     int fCodeLength;
+    int fDebug;
     bool fNeedCleanup;
   public:
 };
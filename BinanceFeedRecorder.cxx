@@ -0,0 +1,174 @@
+#include "BinanceFeedRecorder.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "BinanceOrderBook.h"
+
+BinanceFeedRecorder::BinanceFeedRecorder(const char* path): fFile(fopen(path,"ab")), fMutex()
+{
+  if(!fFile) {
+    fprintf(stderr,"%s: Error: Could not open %s!\n",__func__,path);
+    throw 0;
+  }
+  pthread_mutex_init(&fMutex,NULL);
+  setvbuf(fFile, NULL, _IOFBF, 1<<20);
+
+  //New logs start with the header
+  if(!ftell(fFile)) {
+    feedlogheader header={FEEDLOG_MAGIC, FEEDLOG_VERSION, 0};
+
+    if(fwrite(&header, sizeof(header), 1, fFile)!=1) {
+      fprintf(stderr,"%s: Error: Could not write to %s!\n",__func__,path);
+      fclose(fFile);
+      throw 0;
+    }
+  }
+}
+
+BinanceFeedRecorder::~BinanceFeedRecorder()
+{
+  fclose(fFile);
+  pthread_mutex_destroy(&fMutex);
+}
+
+int BinanceFeedRecorder::Record(const uint16_t& type, const int& conn, const uint32_t& stream, const char* data, const size_t& len, uint64_t timestamp)
+{
+  static const char padding[8]={0};
+  feedrecord record;
+  record.timestamp=(timestamp?timestamp:feedlog_now());
+  record.length=len;
+  record.type=type;
+  record.conn=conn;
+  record.stream=stream;
+  record.reserved=0;
+  int ret=0;
+  pthread_mutex_lock(&fMutex);
+
+  if(fwrite(&record, sizeof(record), 1, fFile)!=1 || fwrite(data, 1, len, fFile)!=len || fwrite(padding, 1, (8-len%8)%8, fFile)!=(8-len%8)%8) {
+    fprintf(stderr,"%s: Error: Could not write record!\n",__func__);
+    ret=-1;
+  }
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+int BinanceFeedRecorder::Flush()
+{
+  pthread_mutex_lock(&fMutex);
+  const int ret=fflush(fFile);
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+BinanceFeedReplay::BinanceFeedReplay(const char* path): fData(NULL), fSize(0), fBooks()
+{
+  struct stat st;
+  const int fd=open(path, O_RDONLY);
+
+  if(fd<0 || fstat(fd, &st)) {
+    fprintf(stderr,"%s: Error: Could not open %s!\n",__func__,path);
+
+    if(fd>=0) close(fd);
+    throw 0;
+  }
+  fSize=st.st_size;
+
+  if(fSize<sizeof(feedlogheader)) {
+    fprintf(stderr,"%s: Error: %s is not a feed log!\n",__func__,path);
+    close(fd);
+    throw 0;
+  }
+  void* data=mmap(NULL, fSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if(data==MAP_FAILED) {
+    fprintf(stderr,"%s: Error: Could not map %s!\n",__func__,path);
+    throw 0;
+  }
+  madvise(data, fSize, MADV_SEQUENTIAL);
+  fData=(const char*)data;
+  const feedlogheader* header=(const feedlogheader*)fData;
+
+  if(header->magic!=FEEDLOG_MAGIC || header->version!=FEEDLOG_VERSION) {
+    fprintf(stderr,"%s: Error: %s is not a feed log or has an unsupported version!\n",__func__,path);
+    munmap((void*)fData, fSize);
+    throw 0;
+  }
+}
+
+BinanceFeedReplay::~BinanceFeedReplay()
+{
+  for(std::unordered_map<uint32_t, BinanceOrderBook*>::iterator it=fBooks.begin(); it!=fBooks.end(); ++it) {
+    pthread_mutex_lock(&it->second->fOBMutex);
+    it->second->fOffline=false;
+    pthread_mutex_unlock(&it->second->fOBMutex);
+  }
+  munmap((void*)fData, fSize);
+}
+
+void BinanceFeedReplay::AddBook(const uint32_t& stream, BinanceOrderBook* book)
+{
+  pthread_mutex_lock(&book->fOBMutex);
+  book->fOffline=true;
+  pthread_mutex_unlock(&book->fOBMutex);
+  fBooks[stream]=book;
+}
+
+int64_t BinanceFeedReplay::Run(const double& speed, feedhandler handler, void* userdata)
+{
+  const char* p=fData+sizeof(feedlogheader);
+  const char* const end=fData+fSize;
+  struct timespec start, now, wait;
+  uint64_t first=0;
+  int64_t n=0;
+  depthsnapshot ds;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while(end-p>=(ptrdiff_t)sizeof(feedrecord)) {
+    const feedrecord& record=*(const feedrecord*)p;
+    const char* data=p+sizeof(feedrecord);
+
+    if((size_t)(end-data)<record.length) {
+      fprintf(stderr,"%s: Error: Truncated record at offset %zu!\n",__func__,(size_t)(p-fData));
+      return -1;
+    }
+    p=data+record.length+(8-record.length%8)%8;
+
+    if(speed>0) {
+
+      if(!n) first=record.timestamp;
+      const uint64_t offset=(record.timestamp>first?(record.timestamp-first)/speed:0);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      timespecdiff(&now, &start, &wait);
+      const uint64_t elapsed=(uint64_t)wait.tv_sec*1000000000ULL+wait.tv_nsec;
+
+      if(offset>elapsed) {
+	wait.tv_sec=(offset-elapsed)/1000000000ULL;
+	wait.tv_nsec=(offset-elapsed)%1000000000ULL;
+	nanosleep(&wait, NULL);
+      }
+    }
+    ++n;
+
+    if(handler && handler(record, data, userdata)) break;
+    std::unordered_map<uint32_t, BinanceOrderBook*>::const_iterator it=fBooks.find(record.stream);
+
+    if(it==fBooks.end()) continue;
+    BinanceOrderBook& bob=*it->second;
+
+    if(record.type==feed_frame) bob.OnPayload(data, record.length);
+
+    //Recorded snapshots are only applied when the book waits for one, as
+    //during the recording
+    else if(record.type==feed_snapshot && !snapshot_scan(data, record.length, &ds)) {
+      pthread_mutex_lock(&bob.fOBMutex);
+
+      if(bob.fHasValidUpdate<0) bob.ApplySnapshot(ds, data+record.length);
+      pthread_mutex_unlock(&bob.fOBMutex);
+    }
+  }
+  return n;
+}
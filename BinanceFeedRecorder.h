@@ -0,0 +1,89 @@
+#ifndef _BINANCEFEEDRECORDER_
+#define _BINANCEFEEDRECORDER_
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+
+#include <unordered_map>
+
+#include <pthread.h>
+#include <time.h>
+
+//Binary feed log: a feedlogheader followed by records, each made of a
+//feedrecord and its payload padded to 8 bytes. Timestamps are the local
+//reception times (CLOCK_REALTIME) in nanoseconds.
+#define FEEDLOG_MAGIC 0x474f4c4445454642ULL //"BFEEDLOG"
+#define FEEDLOG_VERSION 1
+
+enum {feed_frame, feed_snapshot};
+
+struct feedlogheader
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct feedrecord
+{
+  uint64_t timestamp;
+  uint32_t length; //Payload length, without the padding
+  uint16_t type; //feed_frame or feed_snapshot
+  uint16_t conn; //Connection id (index of the connection for books fed by BinanceOrderBookManager)
+  uint32_t stream; //Stream id chosen by the recording side
+  uint32_t reserved;
+};
+
+inline static uint64_t feedlog_now(){struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts); return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;}
+
+class BinanceOrderBook;
+
+//Appends records to a feed log. It can be shared by several books and
+//connections.
+class BinanceFeedRecorder
+{
+  public:
+  BinanceFeedRecorder(const char* path);
+  ~BinanceFeedRecorder();
+
+  //A timestamp of 0 is replaced by the current time
+  int Record(const uint16_t& type, const int& conn, const uint32_t& stream, const char* data, const size_t& len, uint64_t timestamp=0);
+  int Flush();
+
+  protected:
+  FILE* fFile;
+  pthread_mutex_t fMutex;
+  private:
+};
+
+//Memory-maps a feed log and replays it, either at the recorded pace
+//(scaled by speed) or as fast as possible (speed<=0)
+class BinanceFeedReplay
+{
+  public:
+  typedef int (*feedhandler)(const feedrecord& record, const char* data, void* userdata);
+
+  BinanceFeedReplay(const char* path);
+  ~BinanceFeedReplay();
+
+  //Records of stream are fed to book, whose snapshots are then only taken
+  //from the log
+  void AddBook(const uint32_t& stream, BinanceOrderBook* book);
+
+  //Calls handler for each record (if not NULL) and feeds the records of
+  //the added books. Stops early if the handler returns non-zero. Returns
+  //the number of records replayed, or -1 if the log is corrupted.
+  int64_t Run(const double& speed=0, feedhandler handler=NULL, void* userdata=NULL);
+
+  inline size_t GetSize() const {return fSize;}
+
+  protected:
+  const char* fData;
+  size_t fSize;
+  std::unordered_map<uint32_t, BinanceOrderBook*> fBooks;
+  private:
+};
+
+#endif
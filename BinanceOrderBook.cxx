@@ -1,12 +1,21 @@
 #include "BinanceOrderBook.h"
 
-BinanceOrderBook::BinanceOrderBook(WebSocketManager* manager, const int& btype, const char* symbol, const int& depthlimit): fManager(manager), fCHandle(curl_easy_init()), fJSTok(json_tokener_new()), fCheckFunction(NULL), fAsksPrice(), fBidsPrice(), fSocketCache(), fOBMutex(), fOBCond(), fLastUpdateID(0), fType(btype), fDepthLimit(), fSymbol(strdup(symbol)), fId(-1), fHasValidUpdate(0), fNewDataReady(false), fLastBidSum(-1), fLastAskSum(-1)
+BinanceOrderBook::BinanceOrderBook(WebSocketManager* manager, const int& btype, const char* symbol, const int& depthlimit, const int& booktype, const binfxspec& fxspec): fManager(manager), fCHandle(curl_easy_init()), fCheckFunction(NULL), fAsksPrice(), fBidsPrice(), fAsksLadder(NULL), fBidsLadder(NULL), fAsksWindow(NULL), fBidsWindow(NULL), fFXSpec(fxspec), fCache(BOOK_CACHE_SLOTS), fCacheStart(0), fCacheSize(0), fCacheOverflow(false), fOBMutex(), fOBCond(), fView(), fViewSlot(&fView), fStats(), fChanges(), fCallbacks(), fCallbackData(), fNSubscribers(0), fRecordChanges(false), fBestBid(), fBestAsk(), fLastUpdateID(0), fLastEventTime(0), fViewDepth(BOOKVIEW_LEVELS), fStatsLevels(0), fStatsBand(0), fType(btype), fDepthLimit(), fSymbol(strdup(symbol)), fId(-1), fHasValidUpdate(-1), fStale(true), fSnapshotRequested(false), fStopSnapshot(false), fResume(false), fOffline(false), fRecorder(NULL), fRecordStream(0), fRecordConn(-1), fNewDataReady(false), fLastBidSum(-1), fLastAskSum(-1)
 {
   pthread_mutex_init(&fOBMutex,NULL);
   pthread_cond_init(&fOBCond,NULL);
+#ifdef BIN_LATENCY_STATS
+  ResetLatency();
+  fLatParsed=fLatApplied=0;
+  fLatDumpStream=NULL;
+  fLatDumpInterval=fLatLastDump=0;
+#endif
+  fChanges.reserve(1024);
+  //Snapshots reuse the connections of the other books and endpoints
+  BinanceRestTransport::Instance().Setup(fCHandle);
   curl_easy_setopt(fCHandle,CURLOPT_NOSIGNAL,1);
+  curl_easy_setopt(fCHandle, CURLOPT_TIMEOUT, 10L);
   curl_easy_setopt(fCHandle, CURLOPT_WRITEFUNCTION, GetSnapshotCB);
-  curl_easy_setopt(fCHandle, CURLOPT_WRITEDATA, this);
   char wsuri[1024];
   char symb[128];
 
@@ -29,6 +38,32 @@ BinanceOrderBook::BinanceOrderBook(WebSocketManager* manager, const int& btype,
     throw 0;
   }
 
+  switch(booktype) {
+    case binance_book_map:
+      break;
+
+    case binance_book_ladder:
+    case binance_book_ladder_indexed:
+
+      if(!fFXSpec.IsValid()) {
+	fprintf(stderr,"%s: Error: Invalid fixed-point specification for a ladder order book!\n",__func__);
+	throw 0;
+      }
+      fAsksLadder=new priceladder(1<<14, booktype==binance_book_ladder_indexed);
+      fBidsLadder=new priceladder(1<<14, booktype==binance_book_ladder_indexed);
+      break;
+
+    case binance_book_capped:
+      //Same depth as the snapshot
+      fAsksWindow=new depthwindow(fDepthLimit?fDepthLimit:1000);
+      fBidsWindow=new depthwindow(fDepthLimit?fDepthLimit:1000);
+      break;
+
+    default:
+      fprintf(stderr,"%s: Error: Invalid order book type\n",__func__);
+      throw 0;
+  }
+
   size_t len=strlen(fSymbol);
 
   for(int i=len-1; i>=0; --i) symb[i]=toupper(fSymbol[i]);
@@ -58,306 +93,628 @@ BinanceOrderBook::BinanceOrderBook(WebSocketManager* manager, const int& btype,
   printf("Curl URI is '%s'\n",wsuri);
 }
 
-void BinanceOrderBook::OnMessage(websocketpp::connection_hdl, client::message_ptr msg)
+void BinanceOrderBook::OnPayload(const char* payload, const size_t& len)
 {
-  //std::cout << msg->get_payload() << std::endl;
+  //printf("%.*s\n",(int)len,payload);
   //printf("%s\n",__func__);
+#ifdef BIN_LATENCY_STATS
+  //Frames that did not come through WebSocketManager (replays) are timed
+  //from here, without an exchange latency
+  uint64_t rxtime=lat_rxtime(), rxrealtime=lat_rxrealtime();
+  lat_rxtime()=0;
+
+  if(!rxtime) {
+    rxtime=lat_now();
+    rxrealtime=0;
+  }
+  fLatParsed=0;
+#endif
 
-  if(fHasValidUpdate < 0) return;
-
-  if(!fHasValidUpdate) {
+  pthread_mutex_lock(&fOBMutex);
 
-    //If does not have a valid update and the mutex is already locked
-    if(pthread_mutex_trylock(&fOBMutex)) {
-      //Mutex was locked 
-      fSocketCache.push_back(msg->get_payload());
-      return;
-    }
-    //The mutex is locked
+  //Recorded with fOBMutex held, so SetRecorder can swap or stop the recorder
+  if(fRecorder) fRecorder->Record(feed_frame, (fRecordConn>=0?fRecordConn:fId), fRecordStream, payload, len);
 
-  //Else if there is already an update, we enforce the lock
-  } else pthread_mutex_lock(&fOBMutex);
+  //Diffs are buffered until the snapshot worker has loaded the book
+  if(fHasValidUpdate<0) {
+    CacheUpdate(payload,len);
+    pthread_mutex_unlock(&fOBMutex);
+    return;
+  }
+  int8_t ret;
 
-  //If ReloadBook has not initialised the order book yet
-  if(fAsksPrice.empty()) fSocketCache.push_back(msg->get_payload());
+  if(fHasValidUpdate>0) ret=_OnMessage(payload,len);
 
-  //Otherwise if the order book has been initialised
   else {
-    size_t i=0;
-    size_t csize=fSocketCache.size();
-    int8_t ret=0;
-    size_t pos;
-    uint64_t U, u;
+    depthupdate du;
+    ret=(depth_scan(payload,len,&du) || !du.hasU || !du.hasu?-1:ApplyUpdate(payload,len,du.U,du.u));
+  }
 
-    //If it is the first update since the order book was initialised
-    if(csize) {
-      printf("Reading from cache\n");
+  if(ret<0) {
+    fprintf(stderr,"%s: Inconsistent data, resynchronising the book!\n",__func__);
+    RequestSnapshot();
 
-      for(i=0; i<csize; ++i) {
-	const std::string& str=fSocketCache[i];
-	pos=str.find("\"U\"");
+  } else if(IsDepleted()) {
+    printf("Depth window of %s is depleted, reloading the book\n",fSymbol);
+    RequestSnapshot();
 
-	if(pos==std::string::npos || str.size()<pos+5) goto message_error;
-	sscanf(str.c_str()+pos+4,"%" PRIu64,&U);
+  //An applied update was already published for its subscribers
+  } else if(fHasValidUpdate>0 && (ret<=0 || !fNSubscribers)) Publish();
+#ifdef BIN_LATENCY_STATS
 
-	pos=str.find("\"u\"",pos+5);
+  if(ret>0 && fLatParsed) {
+    const uint64_t now=lat_now();
+    fLatency[lat_parse].Record(fLatParsed-rxtime);
+    fLatency[lat_apply].Record(fLatApplied-fLatParsed);
+    fLatency[lat_notify].Record(now-fLatApplied);
+    fLatency[lat_total].Record(now-rxtime);
 
-	if(pos==std::string::npos || str.size()<pos+5) goto message_error;
-	sscanf(str.c_str()+pos+4,"%" PRIu64,&u);
+    if(rxrealtime && fLastEventTime) fLatency[lat_exchange].Record(rxrealtime>fLastEventTime*1000000?rxrealtime-fLastEventTime*1000000:0);
+  }
+  const bool dump=(fLatDumpStream && rxtime-fLatLastDump>=fLatDumpInterval);
 
-	if(u>=fLastUpdateID) {
-	  printf("First valid update has ID %" PRIu64 "\n",u);
+  if(dump) fLatLastDump=rxtime;
+  pthread_mutex_unlock(&fOBMutex);
 
-	  if(U > fLastUpdateID) {
-	    fprintf(stderr,"%s: Error: Missing update before snapshot!\n",__func__);
-	    goto message_error;
-	  }
-	  fHasValidUpdate=1;
-	  fLastUpdateID=U-1; //This is necessary for the spot price order book
-	  ret=_OnMessage(str);
+  if(dump) DumpLatency(fLatDumpStream);
+#else
+  pthread_mutex_unlock(&fOBMutex);
+#endif
+}
 
-	  if(ret<=0) goto message_error; //Here we need to ensure that at least one update has been done
+int8_t BinanceOrderBook::ApplyUpdate(const char* payload, const size_t& len, const uint64_t& U, const uint64_t& u)
+{
+  //fOBMutex must be locked before calling this function!
+  //U and u are the first and last update IDs of the diff
+  if(fHasValidUpdate>0) return _OnMessage(payload,len);
 
-	  for(++i; i<csize; ++i) {
-	    ret=_OnMessage(fSocketCache[i]);
+  if(u<fLastUpdateID) {
+    printf("Skipping update ID %" PRIu64 "\n",u);
+    return 0;
+  }
+  printf("First valid update has ID %" PRIu64 "\n",u);
 
-	    if(ret<0) goto message_error;
+  if(U > fLastUpdateID) {
+    fprintf(stderr,"%s: Error: Missing update before snapshot!\n",__func__);
+    return -1;
+  }
+  fHasValidUpdate=1;
+  fStale.store(false, std::memory_order_relaxed);
+  fLastUpdateID=U-1; //This is necessary for the spot price order book
+  const int8_t ret=_OnMessage(payload,len);
 
-	  }
-	  break;
+  //Here we need to ensure that at least one update has been done
+  return (ret>0?ret:-1);
+}
 
-	} else printf("Skipping update ID %" PRIu64 "\n",u);
-      }
-      printf("Cache has been drained!\n");
-      fSocketCache.clear();
-    }
+void BinanceOrderBook::CacheUpdate(const char* payload, const size_t& len)
+{
+  //fOBMutex must be locked before calling this function!
+  //Losing a diff breaks the chain the snapshot is applied to, so a full
+  //cache or an unreadable diff restarts the buffering and voids any
+  //snapshot request in flight
+  uint64_t U, u;
+
+  if(depth_scan_ids(payload,len,&U,&u)) {
+    fprintf(stderr,"%s: Error: Invalid diff, dropping the cache!\n",__func__);
+    ClearCache();
+    fCacheOverflow=true;
+    return;
+  }
 
-    if(fHasValidUpdate) {
-      ret=_OnMessage(msg->get_payload());
+  if(fCacheSize==fCache.size()) {
+    fprintf(stderr,"%s: Error: Diff cache overflow, resynchronising!\n",__func__);
+    ClearCache();
+    fCacheOverflow=true;
+  }
+  bookcacheslot& slot=fCache[(fCacheStart+fCacheSize)%fCache.size()];
+  slot.payload.assign(payload,len);
+  slot.U=U;
+  slot.u=u;
 
-      if(ret<0) goto message_error;
+  if(!fCacheSize++) WakeSnapshot();
+}
 
-    } else {
-      printf("Looking for valid update\n");
-      const std::string& str=msg->get_payload();
-      pos=str.find("\"U\"");
+int8_t BinanceOrderBook::_OnMessage(const char* msg, const size_t& len)
+{
+  //fOBMutex must be locked before calling this function!
+  
+  //printf("%.*s\n",(int)len,msg);
+  depthupdate du;
+  const char* const end=msg+len;
+  int8_t ret;
+  int n;
+
+  //The level arrays are validated here, so a malformed message never gets
+  //partially applied below
+  if(depth_scan(msg, len, &du)) {
+    fprintf(stderr,"%s: Error parsing depth update\n",__func__);
+    return 0;
+  }
+  ret=fCheckFunction(*this, du);
+
+  if(ret!=1) return ret;
+#ifdef BIN_LATENCY_STATS
+  fLatParsed=lat_now();
+#endif
+
+  if(du.hasu) {
+    fLastUpdateID = du.u;
+    fLastEventTime = du.E;
+    fNewDataReady=true;
+    pthread_cond_signal(&fOBCond);
+    //printf("Update ID is %" PRIu64 "\n",fLastUpdateID);
+
+  } else return 0;
+  fRecordChanges=(fNSubscribers>0);
+
+  if(fRecordChanges) fChanges.clear();
+
+  if(du.bids) {
+    n=depth_levels(du.bids, end, [this](const char* price, const size_t& plen, const char* quantity, const size_t& qlen){
+	//printf("Quantity %.*s set for bid price %.*s\n",(int)qlen,quantity,(int)plen,price);
+	SetBid(price,plen,quantity,qlen);
+	});
+
+    if(n<0) {
+      fprintf(stderr,"%s: Error: Bid levels are invalid!\n",__func__);
+      fRecordChanges=false;
+      return -1;
+    }
 
-      if(pos==std::string::npos || str.size()<pos+5) goto message_error;
-      sscanf(str.c_str()+pos+4,"%" PRIu64,&U);
+    if(n) ret+=1;
+  }
 
-      pos=str.find("\"u\"",pos+5);
+  if(du.asks) {
+    n=depth_levels(du.asks, end, [this](const char* price, const size_t& plen, const char* quantity, const size_t& qlen){
+	//printf("Quantity %.*s set for ask price %.*s\n",(int)qlen,quantity,(int)plen,price);
+	SetAsk(price,plen,quantity,qlen);
+	});
 
-      if(pos==std::string::npos || str.size()<pos+5) goto message_error;
-      sscanf(str.c_str()+pos+4,"%" PRIu64,&u);
+    if(n<0) {
+      fprintf(stderr,"%s: Error: Ask levels are invalid!\n",__func__);
+      fRecordChanges=false;
+      return -1;
+    }
 
-      if(u>=fLastUpdateID) {
-	printf("First valid update has ID %" PRIu64 "\n",u);
+    if(n) ret+=2;
+  }
+#ifdef BIN_LATENCY_STATS
+  fLatApplied=lat_now();
+#endif
+
+  //The view and the stats are published first, so the subscribers read
+  //them at this update
+  if(fRecordChanges) {
+    Publish();
+    NotifySubscribers();
+    fRecordChanges=false;
+  }
+  return ret;
+}
 
-	if(U > fLastUpdateID) {
-	  fprintf(stderr,"%s: Error: Missing update before snapshot!\n",__func__);
-	  goto message_error;
-	}
-	fHasValidUpdate=1;
-	fLastUpdateID=U-1; //This is necessary for the spot price order book
-	ret=_OnMessage(str);
+int8_t BinanceOrderBook::WaitForUpdate(const double& bidsum, const double& asksum, const struct timespec& waittime)
+{
+  //Returns 0 once the book can be read, with fOBMutex locked. A stale book
+  //is returned as is, the resync never happens on the caller's thread.
+  struct timespec timeout;
+  clock_gettime(CLOCK_REALTIME, &timeout);
+  timespecsum(&timeout, &waittime, &timeout);
+  pthread_mutex_lock(&fOBMutex);
 
-	if(ret<=0) goto message_error; //Here we need to ensure that at least one update has been done
+  while(!fLastUpdateID) {
+    //printf("No book loaded yet\n");
 
-      } else printf("Skipping update ID %" PRIu64 "\n",u);
+    if(pthread_cond_timedwait(&fOBCond, &fOBMutex, &timeout)==ETIMEDOUT) {
+      pthread_mutex_unlock(&fOBMutex);
+      return -1;
     }
   }
-  pthread_mutex_unlock(&fOBMutex);
-  return;
 
-message_error:
-  fprintf(stderr,"%s: Inconsistent data!\n",__func__);
-  fHasValidUpdate=-1;
-  fAsksPrice.clear();
-  fBidsPrice.clear();
-  fLastUpdateID=0;
+  if(!fNewDataReady && bidsum<=fLastBidSum && asksum<=fLastAskSum) {
+    //printf("Waiting...\n");
+    
+    if(pthread_cond_timedwait(&fOBCond, &fOBMutex, &timeout)==ETIMEDOUT) {
+      pthread_mutex_unlock(&fOBMutex);
+      //printf("Returning false\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+bool BinanceOrderBook::GetBookAtSum(const double& bidsum, const double& asksum, const struct timespec& waittime, bookvec* bids, bookvec* asks)
+{
+  //Can return additional book entries if more entries were requested the
+  //previous time and that has not been any update since. The book is
+  //walked with fOBMutex held, so GetView/GetViewBookAtSum should be
+  //preferred when the feed thread must not be blocked.
+  if(WaitForUpdate(bidsum, asksum, waittime)) return false;
+
+  if(bidsum>0) {
+    double sum=0;
+    bids->clear();
+
+    ForEachBid([&](const double& price, const double& quantity){
+	sum+=quantity;
+	bids->push_back({price, quantity, sum});
+	return (sum < bidsum);
+	});
+  }
+
+  if(asksum>0) {
+    double sum=0;
+    asks->clear();
+
+    ForEachAsk([&](const double& price, const double& quantity){
+	sum+=quantity;
+	asks->push_back({price, quantity, sum});
+	return (sum < asksum);
+	});
+  }
   fNewDataReady=false;
-  fLastBidSum=fLastAskSum=-1;
-  pthread_cond_signal(&fOBCond);
+  fLastBidSum=bidsum;
+  fLastAskSum=asksum;
   pthread_mutex_unlock(&fOBMutex);
+  return true;
 }
 
-int8_t BinanceOrderBook::_OnMessage(const std::string& msg)
+bool BinanceOrderBook::GetFxBookAtSum(const fxint& bidsum, const fxint& asksum, const struct timespec& waittime, fxbookvec* bids, fxbookvec* asks)
 {
-  //fOBMutex must be locked before calling this function!
-  
-  //std::cout << msg << std::endl;
-  json_object* jobj=json_tokener_parse_ex(fJSTok, msg.c_str(), msg.size());
-  enum json_tokener_error jerr=json_tokener_get_error(fJSTok);
-  int8_t ret=0;
+  if(!fAsksLadder) {
+    fprintf(stderr,"%s: Error: Fixed-point books require the ladder storage type!\n",__func__);
+    return false;
+  }
+  const double dbidsum=fFXSpec.QuantityToDouble(bidsum);
+  const double dasksum=fFXSpec.QuantityToDouble(asksum);
 
-  if(!jobj || jerr!=json_tokener_success) {
+  if(WaitForUpdate(dbidsum, dasksum, waittime)) return false;
 
-    if(jerr==json_tokener_continue) fprintf(stderr,"%s: Incomplete JSON reply\n",__func__);
+  if(bidsum>0) {
+    fxint sum=0;
+    bids->clear();
 
-    else fprintf(stderr,"%s: Error parsing JSON reply: %s\n",__func__,json_tokener_error_desc(jerr));
-    
-    if(jobj) json_object_put(jobj);
-    json_tokener_reset(fJSTok);
-    return 0;
+    ForEachBidFx([&](const fxint& price, const fxint& quantity){
+	sum+=quantity;
+	bids->push_back({price, quantity, sum});
+	return (sum < bidsum);
+	});
+  }
 
-  } else {
-    json_object *val, *obj;
-    double price, quantity;
+  if(asksum>0) {
+    fxint sum=0;
+    asks->clear();
 
-    ret=fCheckFunction(*this, jobj, val);
+    ForEachAskFx([&](const fxint& price, const fxint& quantity){
+	sum+=quantity;
+	asks->push_back({price, quantity, sum});
+	return (sum < asksum);
+	});
+  }
+  fNewDataReady=false;
+  fLastBidSum=dbidsum;
+  fLastAskSum=dasksum;
+  pthread_mutex_unlock(&fOBMutex);
+  return true;
+}
 
-    if(ret!=1) {
-      json_object_put(jobj);
-      json_tokener_reset(fJSTok);
-      return ret;
+bool BinanceOrderBook::GetViewBookAtSum(const double& bidsum, const double& asksum, bookvec* bids, bookvec* asks) const
+{
+  bookview view;
+
+  if(!GetView(&view)) return false;
+
+  if(bidsum>0) {
+
+    if(view.nbids==view.depth && view.bids[view.nbids-1].sum<bidsum) return false;
+    bids->clear();
+
+    for(uint32_t i=0; i<view.nbids; ++i) {
+      bids->push_back({view.bids[i].price, view.bids[i].quantity, view.bids[i].sum});
+
+      if(view.bids[i].sum >= bidsum) break;
     }
+  }
+
+  if(asksum>0) {
+
+    if(view.nasks==view.depth && view.asks[view.nasks-1].sum<asksum) return false;
+    asks->clear();
 
-    if(json_object_object_get_ex(jobj, "u", &val)) {
-      fLastUpdateID = json_object_get_int64(val);
-      fNewDataReady=true;
-      pthread_cond_signal(&fOBCond);
-      //printf("Update ID is %" PRIu64 "\n",fLastUpdateID);
+    for(uint32_t i=0; i<view.nasks; ++i) {
+      asks->push_back({view.asks[i].price, view.asks[i].quantity, view.asks[i].sum});
 
-    } else {
-      json_object_put(jobj);
-      json_tokener_reset(fJSTok);
-      return 0;
+      if(view.asks[i].sum >= asksum) break;
     }
+  }
+  return true;
+}
 
-    if(json_object_object_get_ex(jobj, "b", &val)) {
+bool BinanceOrderBook::GetViewSides(vwapside* bids, vwapside* asks) const
+{
+  bookview view;
 
-      if(json_object_get_type(val)!=json_type_array) {
-	fprintf(stderr,"%s: Error: Returned JSON object is invalid!\n",__func__);
-	json_object_put(jobj);
-	json_tokener_reset(fJSTok);
-	return -1;
-      }
+  if(!GetView(&view)) return false;
 
-      const size_t alength=json_object_array_length(val);
+  if(bids) {
+    bids->Clear(true);
 
-      if(alength) {
+    for(uint32_t i=0; i<view.nbids; ++i) bids->Push(view.bids[i].price, view.bids[i].quantity);
+    bids->truncated=(view.nbids==view.depth);
+  }
 
-	for(size_t i=0; i<alength; ++i) {
-	  obj=json_object_array_get_idx(val,i);
-	  price=json_object_get_double(json_object_array_get_idx(obj,0));
-	  quantity=json_object_get_double(json_object_array_get_idx(obj,1));
+  if(asks) {
+    asks->Clear(false);
 
-	  if(quantity) {
-	    //printf("Quantity %f set for bid price %f\n",quantity,price);
-	    fBidsPrice[price]=quantity;
-	  } else {
-	    //printf("Erasing bid price %f\n",price);
-	    fBidsPrice.erase(price);
-	  }
-	}
-	ret+=1;
-      }
-    }
+    for(uint32_t i=0; i<view.nasks; ++i) asks->Push(view.asks[i].price, view.asks[i].quantity);
+    asks->truncated=(view.nasks==view.depth);
+  }
+  return true;
+}
 
-    if(json_object_object_get_ex(jobj, "a", &val)) {
+bool BinanceOrderBook::GetSides(vwapside* bids, vwapside* asks, const size_t& maxlevels)
+{
+  size_t n;
+  pthread_mutex_lock(&fOBMutex);
 
-      if(json_object_get_type(val)!=json_type_array) {
-	fprintf(stderr,"%s: Error: Returned JSON object is invalid!\n",__func__);
-	json_object_put(jobj);
-	json_tokener_reset(fJSTok);
-	return -1;
-      }
+  if(!fLastUpdateID) {
+    pthread_mutex_unlock(&fOBMutex);
+    return false;
+  }
 
-      const size_t alength=json_object_array_length(val);
+  if(bids) {
+    bids->Clear(true);
+    n=0;
 
-      if(alength) {
+    ForEachBid([&](const double& price, const double& quantity){
 
-	for(size_t i=0; i<alength; ++i) {
-	  obj=json_object_array_get_idx(val,i);
-	  price=json_object_get_double(json_object_array_get_idx(obj,0));
-	  quantity=json_object_get_double(json_object_array_get_idx(obj,1));
+	if(maxlevels && n==maxlevels) {
+	  bids->truncated=true;
+	  return false;
+	}
+	bids->Push(price, quantity);
+	++n;
+	return true;
+	});
+  }
+
+  if(asks) {
+    asks->Clear(false);
+    n=0;
+
+    ForEachAsk([&](const double& price, const double& quantity){
 
-	  if(quantity) {
-	    //printf("Quantity %f set for ask price %f\n",quantity,price);
-	    fAsksPrice[price]=quantity;
-	  } else {
-	    //printf("Erasing ask price %f\n",price);
-	    fAsksPrice.erase(price);
-	  }
+	if(maxlevels && n==maxlevels) {
+	  asks->truncated=true;
+	  return false;
 	}
-	ret+=2;
-      }
-    }
+	asks->Push(price, quantity);
+	++n;
+	return true;
+	});
   }
-  json_object_put(jobj);
-  json_tokener_reset(fJSTok);
-  return ret;
+  pthread_mutex_unlock(&fOBMutex);
+  return true;
 }
 
-bool BinanceOrderBook::GetBookAtSum(const double& bidsum, const double& asksum, const struct timespec& waittime, bookvec* bids, bookvec* asks)
+bool BinanceOrderBook::GetFillForQuantity(const priceladder* ladder, const double& quantity, double* price, double* vwap)
 {
-  //Can return additional book entries if more entries were requested the
-  //previous time and that has not been any update since
-  struct timespec timeout;
-  clock_gettime(CLOCK_REALTIME, &timeout);
-  timespecsum(&timeout, &waittime, &timeout);
+  if(!ladder) {
+    fprintf(stderr,"%s: Error: Fill queries require a ladder storage type!\n",__func__);
+    return false;
+  }
+  const fxint fxquantity=fFXSpec.QuantityFromDouble(quantity);
+  int64_t key;
+  fxint amount;
   pthread_mutex_lock(&fOBMutex);
+  const bool ret=(fLastUpdateID && ladder->FillQuantity(fxquantity, &key, &amount));
+  pthread_mutex_unlock(&fOBMutex);
 
-  if(fHasValidUpdate < 0) {
-    //printf("No valid update\n");
+  if(!ret) return false;
+  //Amounts are in ticks x lots
+  *price=fFXSpec.PriceToDouble((key<0?-key:key)*fFXSpec.tick);
 
-    if(ReloadBook()) {
-      pthread_mutex_unlock(&fOBMutex);
-      //printf("Reloadbook failed\n");
-      return false;
-    }
-  }
+  if(vwap) *vwap=fFXSpec.PriceToDouble(1)*fFXSpec.tick*amount/fxquantity;
+  return true;
+}
 
-  if(!fNewDataReady && bidsum<=fLastBidSum && asksum<=fLastAskSum) {
-    //printf("Waiting...\n");
-    
-    if(pthread_cond_timedwait(&fOBCond, &fOBMutex, &timeout)==ETIMEDOUT) {
-      pthread_mutex_unlock(&fOBMutex);
-      //printf("Returning false\n");
-      return false;
-    }
+bool BinanceOrderBook::GetFillForAmount(const priceladder* ladder, const double& amount, double* quantity, double* price)
+{
+  if(!ladder) {
+    fprintf(stderr,"%s: Error: Fill queries require a ladder storage type!\n",__func__);
+    return false;
   }
+  //Quote amount converted to ticks x lots
+  const fxint fxamount=llround(amount*_fx_pow10[fFXSpec.pricedecimals]*_fx_pow10[fFXSpec.qtydecimals]/fFXSpec.tick);
+  int64_t key;
+  fxint fxquantity;
+  pthread_mutex_lock(&fOBMutex);
+  const bool ret=(fLastUpdateID && ladder->FillAmount(fxamount, &key, &fxquantity));
   pthread_mutex_unlock(&fOBMutex);
 
-  if(bidsum>0) {
-    double sum=0;
-    bids->clear();
+  if(!ret) return false;
+  *quantity=fFXSpec.QuantityToDouble(fxquantity);
+
+  if(price) *price=fFXSpec.PriceToDouble((key<0?-key:key)*fFXSpec.tick);
+  return true;
+}
 
-    for(bidmap::const_iterator it=fBidsPrice.begin(); it!=fBidsPrice.end(); ++it) {
-      sum+=it->second;
-      bids->push_back({it->first, it->second, sum});
+int BinanceOrderBook::Subscribe(bookcallback callback, void* userdata)
+{
+  int ret=-1;
+  pthread_mutex_lock(&fOBMutex);
 
-      if(sum >= bidsum) break;
+  for(int i=0; i<BOOK_MAX_SUBSCRIBERS; ++i) {
+
+    if(!fCallbacks[i]) {
+      fCallbacks[i]=callback;
+      fCallbackData[i]=userdata;
+      ++fNSubscribers;
+      ret=i;
+
+      if(fLastUpdateID) NotifySubscribers(BOOKUPDATE_RESET, i);
+      break;
     }
   }
+  pthread_mutex_unlock(&fOBMutex);
+  return ret;
+}
 
-  if(asksum>0) {
-    double sum=0;
-    asks->clear();
+void BinanceOrderBook::Unsubscribe(const int& id)
+{
+  pthread_mutex_lock(&fOBMutex);
+
+  if(id>=0 && id<BOOK_MAX_SUBSCRIBERS && fCallbacks[id]) {
+    fCallbacks[id]=NULL;
+    fCallbackData[id]=NULL;
+    --fNSubscribers;
+  }
+  pthread_mutex_unlock(&fOBMutex);
+}
+
+void BinanceOrderBook::NotifySubscribers(const uint32_t& flags, const int& subscriber)
+{
+  //fOBMutex must be locked before calling this function!
+  bookupdate update;
+  update.updateid=fLastUpdateID;
+  update.eventtime=fLastEventTime;
+  update.changes=fChanges.data();
+  update.nchanges=(flags&BOOKUPDATE_RESET?0:fChanges.size());
+  update.bestbid=update.bestbidquantity=update.bestask=update.bestaskquantity=0;
+  ForEachBid([&](const double& price, const double& quantity){update.bestbid=price; update.bestbidquantity=quantity; return false;});
+  ForEachAsk([&](const double& price, const double& quantity){update.bestask=price; update.bestaskquantity=quantity; return false;});
+  update.flags=flags | (update.bestbid!=fBestBid[0]?BOOKUPDATE_BESTBID_PRICE:0) | (update.bestbidquantity!=fBestBid[1]?BOOKUPDATE_BESTBID_QUANTITY:0) | (update.bestask!=fBestAsk[0]?BOOKUPDATE_BESTASK_PRICE:0) | (update.bestaskquantity!=fBestAsk[1]?BOOKUPDATE_BESTASK_QUANTITY:0);
+  fBestBid[0]=update.bestbid;
+  fBestBid[1]=update.bestbidquantity;
+  fBestAsk[0]=update.bestask;
+  fBestAsk[1]=update.bestaskquantity;
+
+  if(subscriber>=0) fCallbacks[subscriber](*this, update, fCallbackData[subscriber]);
+
+  else for(int i=0; i<BOOK_MAX_SUBSCRIBERS; ++i) if(fCallbacks[i]) fCallbacks[i](*this, update, fCallbackData[i]);
+}
 
-    for(askmap::const_iterator it=fAsksPrice.begin(); it!=fAsksPrice.end(); ++it) {
-      sum+=it->second;
-      asks->push_back({it->first, it->second, sum});
+void BinanceOrderBook::PublishView()
+{
+  //fOBMutex must be locked before calling this function!
+  seqlock<bookview>& slot=*fViewSlot.load(std::memory_order_relaxed);
+
+  //A disabled view is invalidated once and then left untouched
+  if(!fViewDepth && !slot.data.updateid) return;
+  bookview& view=slot.BeginWrite();
+  double sum=0;
+  uint32_t n=0;
+  //The last good book stays published, flagged, during a resync
+  view.updateid=(fViewDepth?fLastUpdateID:0);
+  view.eventtime=fLastEventTime;
+  view.depth=fViewDepth;
+  view.stale=(fHasValidUpdate<=0);
+
+  if(view.updateid) ForEachBid([&](const double& price, const double& quantity){
+      sum+=quantity;
+      view.bids[n]={price, quantity, sum};
+      return (++n<view.depth);
+      });
+  view.nbids=n;
+  sum=0;
+  n=0;
+
+  if(view.updateid) ForEachAsk([&](const double& price, const double& quantity){
+      sum+=quantity;
+      view.asks[n]={price, quantity, sum};
+      return (++n<view.depth);
+      });
+  view.nasks=n;
+  slot.EndWrite();
+}
 
-      if(sum >= asksum) break;
+void BinanceOrderBook::PublishStats()
+{
+  //fOBMutex must be locked before calling this function!
+  if(fStatsLevels<=0 && !fStats.data.updateid) return;
+  bookstats& stats=fStats.BeginWrite();
+  int n=0;
+  memset(&stats,0,sizeof(bookstats));
+  stats.eventtime=fLastEventTime;
+  stats.levels=(fStatsLevels>0?fStatsLevels:0);
+  stats.bandbps=fStatsBand;
+  stats.stale=(fHasValidUpdate<=0);
+
+  if(stats.levels && fLastUpdateID) {
+    ForEachBid([&](const double& price, const double& quantity){
+	if(!n) {
+	  stats.bestbid=price;
+	  stats.bestbidquantity=quantity;
+	}
+	stats.bidquantity+=quantity;
+	return (++n<fStatsLevels);
+	});
+    n=0;
+
+    ForEachAsk([&](const double& price, const double& quantity){
+	if(!n) {
+	  stats.bestask=price;
+	  stats.bestaskquantity=quantity;
+	}
+	stats.askquantity+=quantity;
+	return (++n<fStatsLevels);
+	});
+  }
+
+  if(stats.bestbidquantity>0 && stats.bestaskquantity>0) {
+    stats.updateid=fLastUpdateID;
+    stats.mid=0.5*(stats.bestbid+stats.bestask);
+    stats.spread=stats.bestask-stats.bestbid;
+    stats.microprice=(stats.bestbid*stats.bestaskquantity+stats.bestask*stats.bestbidquantity)/(stats.bestbidquantity+stats.bestaskquantity);
+    stats.imbalance=(stats.bidquantity-stats.askquantity)/(stats.bidquantity+stats.askquantity);
+
+    if(fStatsBand>0) {
+      stats.bidbandquantity=BandQuantity(true, stats.mid*(1-fStatsBand*1e-4));
+      stats.askbandquantity=BandQuantity(false, stats.mid*(1+fStatsBand*1e-4));
     }
   }
-  fNewDataReady=false;
-  fLastBidSum=bidsum;
-  fLastAskSum=asksum;
-  pthread_mutex_unlock(&fOBMutex);
-  return true;
+  fStats.EndWrite();
+}
+
+double BinanceOrderBook::BandQuantity(const bool& bid, const double& bound) const
+{
+  //fOBMutex must be locked before calling this function!
+  //Quantity of the bids at or above bound, or of the asks at or below it
+  double ret=0;
+
+  if(fAsksLadder) {
+    const double ticks=bound*_fx_pow10[fFXSpec.pricedecimals]/fFXSpec.tick;
+    return fFXSpec.QuantityToDouble(bid?fBidsLadder->QuantityTo(-(int64_t)ceil(ticks)):fAsksLadder->QuantityTo((int64_t)floor(ticks)));
+  }
+
+  if(bid) ForEachBid([&](const double& price, const double& quantity){
+      if(price<bound) return false;
+      ret+=quantity;
+      return true;
+      });
+
+  else ForEachAsk([&](const double& price, const double& quantity){
+      if(price>bound) return false;
+      ret+=quantity;
+      return true;
+      });
+  return ret;
 }
 
 void BinanceOrderBook::Init()
 {
-  fSocketCache.clear();
-  fAsksPrice.clear();
-  fBidsPrice.clear();
-  fHasValidUpdate=0;
+  pthread_mutex_lock(&fOBMutex);
+  ClearCache();
+  ClearBook();
+  fHasValidUpdate=-1;
+  fStale.store(true, std::memory_order_relaxed);
+  fSnapshotRequested=false;
+  fResume=false;
   fLastUpdateID=0;
   fNewDataReady=false;
   fLastBidSum=fLastAskSum=-1;
+  Publish();
+  pthread_mutex_unlock(&fOBMutex);
 }
 
 void BinanceOrderBook::Print(const size_t limit)
@@ -366,131 +723,419 @@ void BinanceOrderBook::Print(const size_t limit)
   printf("\nBids for update %" PRIu64 ":\n",fLastUpdateID);
   size_t i=0;
 
-  for(bidmap::const_iterator it=fBidsPrice.begin(); it!=fBidsPrice.end(); ++it) {
-    printf("%22f:\t%22f\n",it->first,it->second);
-    ++i;
-
-    if(limit && i==limit) break;
-  }
+  ForEachBid([&](const double& price, const double& quantity){
+      printf("%22f:\t%22f\n",price,quantity);
+      ++i;
+      return (!limit || i!=limit);
+      });
   printf("\nAsk for update %" PRIu64 ":\n",fLastUpdateID);
   i=0;
 
-  for(askmap::const_iterator it=fAsksPrice.begin(); it!=fAsksPrice.end(); ++it) {
-    printf("%22f:\t%22f\n",it->first,it->second);
-    ++i;
-
-    if(limit && i==limit) break;
-  }
+  ForEachAsk([&](const double& price, const double& quantity){
+      printf("%22f:\t%22f\n",price,quantity);
+      ++i;
+      return (!limit || i!=limit);
+      });
   pthread_mutex_unlock(&fOBMutex);
 }
 
-size_t BinanceOrderBook::GetSnapshotCB(char *ptr, size_t size, size_t nmemb, void *instance)
+size_t BinanceOrderBook::GetSnapshotCB(char *ptr, size_t size, size_t nmemb, void *body)
 {
+  //The body is parsed once complete, see LoadSnapshot
   const size_t nbytes=size*nmemb;
-  printf("Curl returned '%.*s'\n",(int)nbytes,ptr);
-  BinanceOrderBook& bob=*(BinanceOrderBook*)instance;
+  ((std::string*)body)->append(ptr,nbytes);
+  return nbytes;
+}
 
-  json_object* jobj=json_tokener_parse_ex(bob.fJSTok, ptr, nbytes);
-  enum json_tokener_error jerr=json_tokener_get_error(bob.fJSTok);
-  printf("jobj=%p\n",jobj);
+BinanceSnapshotWorker& BinanceSnapshotWorker::Instance()
+{
+  //Constructed on first use, which is thread-safe
+  static BinanceSnapshotWorker worker;
+  return worker;
+}
 
-  if(!jobj && jerr!=json_tokener_continue) {
-    fprintf(stderr,"%s: Error parsing JSON reply: %s\n",__func__,json_tokener_error_desc(jerr));
-    
-    if(jobj) json_object_put(jobj);
-    json_tokener_reset(bob.fJSTok);
-    return 0;
+BinanceSnapshotWorker::BinanceSnapshotWorker(): fQueue(), fBody(), fCurrent(NULL), fMutex(), fCond(), fThread(), fStop(false)
+{
+  pthread_mutex_init(&fMutex,NULL);
+  pthread_cond_init(&fCond,NULL);
 
-  } else if(jerr==json_tokener_success) {
-    json_object *val, *obj;
-    double price, quantity;
+  if(pthread_create(&fThread, NULL, Thread, this)) {
+    fprintf(stderr,"%s: Error: Could not start the snapshot thread!\n",__func__);
+    throw 0;
+  }
+}
 
-    if(json_object_object_get_ex(jobj, "lastUpdateId", &val)) {
-      bob.fLastUpdateID=json_object_get_int64(val)+(bob.fType==binance_spot); //fLastUpdateID+1 is used for spot!!
-      printf("Order book lastUpdateID is %" PRIu64 "\n",bob.fLastUpdateID);
+BinanceSnapshotWorker::~BinanceSnapshotWorker()
+{
+  pthread_mutex_lock(&fMutex);
+  fStop=true;
+  pthread_cond_signal(&fCond);
+  pthread_mutex_unlock(&fMutex);
+  pthread_join(fThread, NULL);
+  pthread_cond_destroy(&fCond);
+  pthread_mutex_destroy(&fMutex);
+}
 
-    } else {
-      fprintf(stderr,"%s: Error: Could not read lastUpdateID!\n",__func__);
-      json_object_put(jobj);
-      json_tokener_reset(bob.fJSTok);
-      return 0;
+void BinanceSnapshotWorker::Wake(BinanceOrderBook* book, const uint64_t& delay)
+{
+  pthread_mutex_lock(&fMutex);
+
+  for(size_t i=0; i<fQueue.size(); ++i) if(fQueue[i].book==book) {
+    pthread_mutex_unlock(&fMutex);
+    return;
+  }
+  fQueue.push_back({book, getmstime()+delay});
+  pthread_cond_signal(&fCond);
+  pthread_mutex_unlock(&fMutex);
+}
+
+void BinanceSnapshotWorker::Remove(BinanceOrderBook* book)
+{
+  pthread_mutex_lock(&fMutex);
+
+  while(fCurrent==book) pthread_cond_wait(&fCond, &fMutex);
+
+  for(size_t i=0; i<fQueue.size();) {
+
+    if(fQueue[i].book==book) fQueue.erase(fQueue.begin()+i);
+
+    else ++i;
+  }
+  pthread_mutex_unlock(&fMutex);
+}
+
+void* BinanceSnapshotWorker::Thread(void* instance)
+{
+  BinanceSnapshotWorker& worker=*(BinanceSnapshotWorker*)instance;
+  struct timespec timeout;
+  pthread_mutex_lock(&worker.fMutex);
+
+  while(!worker.fStop) {
+
+    if(worker.fQueue.empty()) {
+      pthread_cond_wait(&worker.fCond, &worker.fMutex);
+      continue;
     }
+    size_t next=0;
 
-    if(json_object_object_get_ex(jobj, "bids", &val)) {
+    for(size_t i=1; i<worker.fQueue.size(); ++i) if(worker.fQueue[i].due<worker.fQueue[next].due) next=i;
+    const uint64_t now=getmstime();
 
-	if(json_object_get_type(val)!=json_type_array) {
-	  fprintf(stderr,"%s: Error: Returned JSON object is invalid!\n",__func__);
-	  json_object_put(jobj);
-          json_tokener_reset(bob.fJSTok);
-	  return 0;
-	}
+    if(worker.fQueue[next].due>now) {
+      timeout.tv_sec=worker.fQueue[next].due/1000;
+      timeout.tv_nsec=(worker.fQueue[next].due%1000)*1000000;
+      pthread_cond_timedwait(&worker.fCond, &worker.fMutex, &timeout);
+      continue;
+    }
+    worker.fCurrent=worker.fQueue[next].book;
+    worker.fQueue.erase(worker.fQueue.begin()+next);
+    pthread_mutex_unlock(&worker.fMutex);
+    worker.fCurrent->ProcessSnapshot(&worker.fBody);
+    pthread_mutex_lock(&worker.fMutex);
+    worker.fCurrent=NULL;
+    pthread_cond_broadcast(&worker.fCond);
+  }
+  pthread_mutex_unlock(&worker.fMutex);
+  return NULL;
+}
 
-	const size_t alength=json_object_array_length(val);
+void BinanceOrderBook::ProcessSnapshot(std::string* body)
+{
+  pthread_mutex_lock(&fOBMutex);
 
-	for(size_t i=0; i<alength; ++i) {
-	  obj=json_object_array_get_idx(val,i);
-	  price=json_object_get_double(json_object_array_get_idx(obj,0));
-	  quantity=json_object_get_double(json_object_array_get_idx(obj,1));
-	  bob.fBidsPrice.insert(std::pair<double, double>(price, quantity));
-	  //printf("price=%f, quantity=%f\n",price,quantity);
-	}
+  //Binance requires the snapshot to be requested after the first diff
+  //has been buffered, which wakes the book again
+  if(fStopSnapshot || !fSnapshotRequested || !fCacheSize || fOffline) {
+    pthread_mutex_unlock(&fOBMutex);
+    return;
+  }
+
+  //A checkpoint is tried first. If the cached diffs are all older than
+  //it, the next ones are waited for.
+  if(fResume) {
+    const int8_t ret=ResumeCheckpoint();
+
+    if(ret>=0) {
 
-    } else {
-      fprintf(stderr,"%s: Error: Could not read bids!\n",__func__);
-      json_object_put(jobj);
-      json_tokener_reset(bob.fJSTok);
-      return 0;
+      if(!ret) fSnapshotRequested=false;
+      pthread_mutex_unlock(&fOBMutex);
+      return;
     }
+  }
+  fSnapshotRequested=false;
 
-    if(json_object_object_get_ex(jobj, "asks", &val)) {
+  //Retry after a delay unless the book has been reinitialised meanwhile
+  if(LoadSnapshot(body)) {
+    fSnapshotRequested=(fHasValidUpdate<0);
 
-	if(json_object_get_type(val)!=json_type_array) {
-	  fprintf(stderr,"%s: Error: Returned JSON object is invalid!\n",__func__);
-	  json_object_put(jobj);
-          json_tokener_reset(bob.fJSTok);
-	  return 0;
-	}
+    if(fSnapshotRequested) WakeSnapshot(BOOK_SNAPSHOT_RETRY);
+  }
+  pthread_mutex_unlock(&fOBMutex);
+}
 
-	const size_t alength=json_object_array_length(val);
+void BinanceOrderBook::StopSnapshots()
+{
+  pthread_mutex_lock(&fOBMutex);
+  fStopSnapshot=true;
+  pthread_mutex_unlock(&fOBMutex);
+  BinanceSnapshotWorker::Instance().Remove(this);
+}
 
-	for(size_t i=0; i<alength; ++i) {
-	  obj=json_object_array_get_idx(val,i);
-	  price=json_object_get_double(json_object_array_get_idx(obj,0));
-	  quantity=json_object_get_double(json_object_array_get_idx(obj,1));
-	  bob.fAsksPrice.insert(std::pair<double, double>(price, quantity));
-	  //printf("price=%f, quantity=%f\n",price,quantity);
-	}
+int8_t BinanceOrderBook::LoadSnapshot(std::string* body)
+{
+  //fOBMutex must be locked before calling this function! It is released
+  //during the HTTP request and the parsing, so the feed thread keeps
+  //buffering diffs and readers keep seeing the last good book.
+  depthsnapshot ds;
+  CURLcode res;
+  long code=0;
+  fCacheOverflow=false;
+  pthread_mutex_unlock(&fOBMutex);
+  body->clear();
+  curl_easy_setopt(fCHandle, CURLOPT_WRITEDATA, body);
+  res=curl_easy_perform(fCHandle);
+
+  if(res==CURLE_OK) curl_easy_getinfo(fCHandle, CURLINFO_RESPONSE_CODE, &code);
+
+  if(res!=CURLE_OK || code!=200) {
+    pthread_mutex_lock(&fOBMutex);
+    fprintf(stderr,"%s: Error: Snapshot request failed (%s, HTTP code %li)!\n",__func__,curl_easy_strerror(res),code);
+    return -1;
+  }
+
+  const int sret=snapshot_scan(body->data(), body->size(), &ds);
+  pthread_mutex_lock(&fOBMutex);
+
+  if(fRecorder) fRecorder->Record(feed_snapshot, (fRecordConn>=0?fRecordConn:fId), fRecordStream, body->data(), body->size());
 
-    } else {
-      fprintf(stderr,"%s: Error: Could not read asks!\n",__func__);
-      json_object_put(jobj);
-      json_tokener_reset(bob.fJSTok);
-      return 0;
+  //Init or ReloadBook may have been called during the request
+  if(fHasValidUpdate>=0 || fStopSnapshot) return 0;
+
+  //Diffs following the snapshot may have been dropped
+  if(fCacheOverflow) {
+    fprintf(stderr,"%s: Error: Diff cache overflowed during the request!\n",__func__);
+    return -1;
+  }
+
+  if(sret) {
+    fprintf(stderr,"%s: Error: Returned snapshot is invalid!\n",__func__);
+    return -1;
+  }
+  return ApplySnapshot(ds, body->data()+body->size());
+}
+
+int8_t BinanceOrderBook::ApplySnapshot(const depthsnapshot& ds, const char* end)
+{
+  //fOBMutex must be locked before calling this function!
+  //The stale book is only replaced here, with the mutex held
+  ClearBook();
+  fLastUpdateID=ds.lastupdateid+(fType==binance_spot); //fLastUpdateID+1 is used for spot!!
+  printf("Order book lastUpdateID is %" PRIu64 "\n",fLastUpdateID);
+
+  if(depth_levels(ds.bids, end, [this](const char* price, const size_t& plen, const char* quantity, const size_t& qlen){SetBid(price,plen,quantity,qlen);})<0 || depth_levels(ds.asks, end, [this](const char* price, const size_t& plen, const char* quantity, const size_t& qlen){SetAsk(price,plen,quantity,qlen);})<0) {
+    fprintf(stderr,"%s: Error: Snapshot levels are invalid!\n",__func__);
+    ClearBook();
+    fLastUpdateID=0;
+    return -1;
+  }
+
+  if(fAsksWindow) {
+    fAsksWindow->Seal();
+    fBidsWindow->Seal();
+  }
+
+  fHasValidUpdate=0;
+
+  if(fNSubscribers) {
+    Publish();
+    NotifySubscribers(BOOKUPDATE_RESET);
+  }
+  printf("Reading from cache\n");
+
+  for(size_t i=0; i<fCacheSize; ++i) {
+    const bookcacheslot& slot=fCache[(fCacheStart+i)%fCache.size()];
+
+    if(ApplyUpdate(slot.payload.data(), slot.payload.size(), slot.U, slot.u)<0) {
+      fprintf(stderr,"%s: Inconsistent cached data!\n",__func__);
+      RequestSnapshot();
+      return -1;
     }
-    bob.fNewDataReady=true;
-    json_object_put(jobj);
-    json_tokener_reset(bob.fJSTok);
   }
-  return nbytes;
+  printf("Cache has been drained!\n");
+  ClearCache();
+  fNewDataReady=true;
+  Publish();
+  pthread_cond_broadcast(&fOBCond);
+  return 0;
 }
 
-int BinanceOrderBook::ReloadBook()
+int8_t BinanceOrderBook::ResumeCheckpoint()
 {
+  //fOBMutex must be locked before calling this function!
+  //Returns 0 if the book resumed from the checkpoint, 1 if more diffs are
+  //needed to decide and -1 if the snapshot must be fetched
+  size_t i;
 
-  while(fSocketCache.empty()) usleep(1);
+  for(i=0; i<fCacheSize; ++i) if(fCache[(fCacheStart+i)%fCache.size()].u>fLastUpdateID) break;
 
+  if(i==fCacheSize) {
+    ClearCache();
+    return 1;
+  }
+  fResume=false;
+  //The first newer diff must pass the regular continuity check
+  fHasValidUpdate=1;
+
+  for(; i<fCacheSize; ++i) {
+    const bookcacheslot& slot=fCache[(fCacheStart+i)%fCache.size()];
+
+    if(_OnMessage(slot.payload.data(), slot.payload.size())<=0) {
+      fprintf(stderr,"%s: Checkpoint of %s does not chain with the stream, fetching the snapshot\n",__func__,fSymbol);
+      fHasValidUpdate=-1;
+      return -1;
+    }
+  }
+  printf("Resumed %s from checkpoint at update ID %" PRIu64 "\n",fSymbol,fLastUpdateID);
+  ClearCache();
+  fStale.store(false, std::memory_order_relaxed);
+  fNewDataReady=true;
+  Publish();
+  pthread_cond_broadcast(&fOBCond);
+  return 0;
+}
+
+int BinanceOrderBook::SaveCheckpoint(const char* path)
+{
+  std::vector<bookcheckpointlevel> levels;
+  bookcheckpoint header;
+  memset(&header,0,sizeof(header));
+  header.magic=BOOK_CHECKPOINT_MAGIC;
+  header.version=BOOK_CHECKPOINT_VERSION;
+  header.type=fType;
+  strncpy(header.symbol,fSymbol,sizeof(header.symbol)-1);
   pthread_mutex_lock(&fOBMutex);
 
-  if(curl_easy_perform(fCHandle)) {
-    fprintf(stderr,"curl_easy_perform: An error was returned!\n");
+  if(fHasValidUpdate<=0) {
     pthread_mutex_unlock(&fOBMutex);
+    fprintf(stderr,"%s: Error: Book of %s is not synchronised!\n",__func__,fSymbol);
     return -1;
   }
-  fHasValidUpdate=0;
+  header.lastupdateid=fLastUpdateID;
+  header.eventtime=fLastEventTime;
+  ForEachBid([&](const double& price, const double& quantity){levels.push_back({price, quantity}); return true;});
+  header.nbids=levels.size();
+  ForEachAsk([&](const double& price, const double& quantity){levels.push_back({price, quantity}); return true;});
+  header.nasks=levels.size()-header.nbids;
+  pthread_mutex_unlock(&fOBMutex);
+
+  std::string tmppath(path);
+  tmppath+=".tmp";
+  FILE* file=fopen(tmppath.c_str(),"wb");
+
+  if(!file) {
+    fprintf(stderr,"%s: Error: Could not open %s!\n",__func__,tmppath.c_str());
+    return -1;
+  }
+
+  if(fwrite(&header, sizeof(header), 1, file)!=1 || (levels.size() && fwrite(levels.data(), sizeof(bookcheckpointlevel), levels.size(), file)!=levels.size())) {
+    fprintf(stderr,"%s: Error: Could not write %s!\n",__func__,tmppath.c_str());
+    fclose(file);
+    unlink(tmppath.c_str());
+    return -1;
+  }
+
+  if(fclose(file) || rename(tmppath.c_str(), path)) {
+    fprintf(stderr,"%s: Error: Could not write %s!\n",__func__,path);
+    unlink(tmppath.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int BinanceOrderBook::LoadCheckpoint(const char* path)
+{
+  bookcheckpoint header;
+  std::vector<bookcheckpointlevel> levels;
+  FILE* file=fopen(path,"rb");
+
+  if(!file) {
+    fprintf(stderr,"%s: Error: Could not open %s!\n",__func__,path);
+    return -1;
+  }
+
+  if(fread(&header, sizeof(header), 1, file)!=1 || header.magic!=BOOK_CHECKPOINT_MAGIC || header.version!=BOOK_CHECKPOINT_VERSION || header.type!=fType || strncmp(header.symbol,fSymbol,sizeof(header.symbol)) || !header.lastupdateid) {
+    fprintf(stderr,"%s: Error: %s is not a checkpoint of this book!\n",__func__,path);
+    fclose(file);
+    return -1;
+  }
+  levels.resize((size_t)header.nbids+header.nasks);
+
+  if(levels.size() && fread(levels.data(), sizeof(bookcheckpointlevel), levels.size(), file)!=levels.size()) {
+    fprintf(stderr,"%s: Error: %s is truncated!\n",__func__,path);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+  pthread_mutex_lock(&fOBMutex);
+  ClearBook();
+
+  for(size_t i=0; i<levels.size(); ++i) {
+    const double& price=levels[i].price;
+    const double& quantity=levels[i].quantity;
+    const bool bid=(i<header.nbids);
+
+    if(fAsksLadder) (bid?fBidsLadder:fAsksLadder)->Set((bid?-1:1)*fFXSpec.PriceFromDouble(price)/fFXSpec.tick, fFXSpec.QuantityFromDouble(quantity));
+
+    else if(fAsksWindow) (bid?fBidsWindow->Set(-price, quantity):fAsksWindow->Set(price, quantity));
+
+    else if(bid) fBidsPrice[price]=quantity;
+
+    else fAsksPrice[price]=quantity;
+  }
+
+  if(fAsksWindow) {
+    fAsksWindow->Seal();
+    fBidsWindow->Seal();
+  }
+  fLastUpdateID=header.lastupdateid;
+  fLastEventTime=header.eventtime;
+
+  fHasValidUpdate=-1;
+  fStale.store(true, std::memory_order_relaxed);
+  fResume=true;
+  Publish();
+
+  if(fNSubscribers) NotifySubscribers(BOOKUPDATE_RESET);
   pthread_mutex_unlock(&fOBMutex);
+  printf("Loaded checkpoint of %s at update ID %" PRIu64 "\n",fSymbol,fLastUpdateID);
   return 0;
 }
 
+int BinanceOrderBook::ReloadBook()
+{
+  //Only requests the snapshot, which is loaded by the snapshot worker
+  pthread_mutex_lock(&fOBMutex);
+  RequestSnapshot();
+  pthread_mutex_unlock(&fOBMutex);
+  return 0;
+}
+
+void BinanceOrderBook::RequestSnapshot()
+{
+  //fOBMutex must be locked before calling this function!
+  //The current book is kept, flagged as stale, until the new snapshot is
+  //loaded, and diffs are buffered in the meantime
+  if(fHasValidUpdate>=0) ClearCache();
+  fHasValidUpdate=-1;
+  fStale.store(true, std::memory_order_relaxed);
+  fSnapshotRequested=true;
+  fNewDataReady=false;
+  fLastBidSum=fLastAskSum=-1;
+  Publish();
+  WakeSnapshot();
+  pthread_cond_broadcast(&fOBCond);
+}
+
 void BinanceOrderBook::StartSocket()
 {
   char wsuri[1024];
@@ -525,3 +1170,58 @@ void BinanceOrderBook::StartSocket()
   printf("Socket URI is %s\n",wsuri);
   fId=fManager->Connect(wsuri, websocketpp::lib::bind(&BinanceOrderBook::OnMessage, this, websocketpp::lib::placeholders::_1, websocketpp::lib::placeholders::_2));
 }
+
+bool BinanceOrderBook::GetLatency(const int& stage, latsummary* summary)
+{
+#ifdef BIN_LATENCY_STATS
+
+  if(stage<0 || stage>=lat_nstages) return false;
+  pthread_mutex_lock(&fOBMutex);
+  fLatency[stage].Summary(summary);
+  pthread_mutex_unlock(&fOBMutex);
+  return true;
+#else
+  memset(summary, 0, sizeof(latsummary));
+  return false;
+#endif
+}
+
+void BinanceOrderBook::ResetLatency()
+{
+#ifdef BIN_LATENCY_STATS
+  pthread_mutex_lock(&fOBMutex);
+
+  for(int i=0; i<lat_nstages; ++i) fLatency[i].Clear();
+  pthread_mutex_unlock(&fOBMutex);
+#endif
+}
+
+void BinanceOrderBook::DumpLatency(FILE* stream)
+{
+#ifdef BIN_LATENCY_STATS
+  latsummary summaries[lat_nstages];
+  pthread_mutex_lock(&fOBMutex);
+
+  for(int i=0; i<lat_nstages; ++i) fLatency[i].Summary(summaries+i);
+  pthread_mutex_unlock(&fOBMutex);
+  //Printed without the book locked
+  fprintf(stream,"Latency of %s (us):\n",fSymbol);
+
+  for(int i=0; i<lat_nstages; ++i) {
+    const latsummary& s=summaries[i];
+    fprintf(stream,"%10s: n=%-10" PRIu64 " min=%-9.3f mean=%-9.3f p50=%-9.3f p90=%-9.3f p99=%-9.3f p99.9=%-9.3f max=%.3f\n",lat_stagenames[i],s.count,s.min*1e-3,s.mean*1e-3,s.p50*1e-3,s.p90*1e-3,s.p99*1e-3,s.p999*1e-3,s.max*1e-3);
+  }
+  fflush(stream);
+#endif
+}
+
+void BinanceOrderBook::SetLatencyDump(FILE* stream, const int& interval)
+{
+#ifdef BIN_LATENCY_STATS
+  pthread_mutex_lock(&fOBMutex);
+  fLatDumpStream=stream;
+  fLatDumpInterval=(interval>0?interval:0)*1000000000ULL;
+  fLatLastDump=lat_now();
+  pthread_mutex_unlock(&fOBMutex);
+#endif
+}
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <cstdint>
 #include <cinttypes>
+#include <cmath>
 #include <ctype.h>
 
 #include <unistd.h>
@@ -14,21 +15,38 @@
 #include <string>
 #include <algorithm>
 
+#include <atomic>
+
 #include <pthread.h>
 
 #include <curl/curl.h>
-#include <json-c/json.h>
 
 extern "C" {
 #include "timeutils.h"
 }
 
 #include "binance_base.h"
+#include "BinanceRestTransport.h"
 
 #include "WebSocketManager.h"
+#include "BinancePriceLadder.h"
+#include "BinanceDepthWindow.h"
+#include "fxdec_utils.h"
+#include "depth_parser.h"
+#include "seqlock_utils.h"
+#include "vwap_utils.h"
+#include "BinanceFeedRecorder.h"
+#include "BinanceSharedBook.h"
+#include "latency_utils.h"
 
 enum {binance_spot, binance_usdm_future, binance_coinm_future};
 
+//Order book storage types. The indexed ladder also maintains cumulative
+//depth indices for the GetAskFill*/GetBidFill* queries. The capped book
+//only keeps the best depthlimit levels per side (1000 if depthlimit is 0)
+//and reloads the snapshot when less than half of them are known.
+enum {binance_book_map, binance_book_ladder, binance_book_ladder_indexed, binance_book_capped};
+
 #define BINANCE_SPOT_URI BINANCE_SPOT_BASEURI "depth?symbol="
 #define BINANCE_USDM_FUTURE_URI BINANCE_USDM_FUTURE_BASEURI "depth?symbol="
 #define BINANCE_COINM_FUTURE_URI BINANCE_COINM_FUTURE_BASEURI "depth?symbol="
@@ -57,6 +75,9 @@ struct depth_compare {
 };
 */
 template<typename U, typename V, typename W> struct triplet {
+  typedef U x_type;
+  typedef V y_type;
+  typedef W z_type;
   triplet(): x(), y(), z(){}
   triplet(const U& x, const V& y, const W& z): x(x), y(y), z(z){}
   const triplet& operator=(const triplet& rhs){x=rhs.x; y=rhs.y; z=rhs.z; return *this;}
@@ -69,56 +90,466 @@ typedef std::map<double, double, std::less<double> > askmap;
 typedef std::map<double, double, std::greater<double> > bidmap;
 typedef std::vector<bookentry> bookvec;
 
+//Fixed-point book entries: price and quantities scaled by the symbol's
+//binfxspec. Quote amounts (price x quantity) then have
+//pricedecimals+qtydecimals decimals.
+typedef triplet<fxint, fxint, fxint> fxbookentry;
+typedef std::vector<fxbookentry> fxbookvec;
+typedef BinancePriceLadder<fxint> priceladder;
+typedef BinanceDepthWindow<double,double> depthwindow;
+
+//Scalars derived from the top of the book after each applied update
+struct bookstats
+{
+  uint64_t updateid; //0 if the statistics are not valid
+  uint64_t eventtime;
+  double bestbid;
+  double bestbidquantity;
+  double bestask;
+  double bestaskquantity;
+  double mid;
+  double spread;
+  double microprice; //Mid weighted by the opposite best quantities
+  double bidquantity; //Over the top levels
+  double askquantity;
+  double imbalance; //(bidquantity-askquantity)/(bidquantity+askquantity)
+  double bidbandquantity; //Within bandbps of mid
+  double askbandquantity;
+  double bandbps;
+  uint32_t levels;
+  uint32_t stale; //Non-zero while the book is being resynchronised
+};
+
+//On-disk checkpoint: a bookcheckpoint followed by nbids then nasks levels,
+//from the best price outwards
+#define BOOK_CHECKPOINT_MAGIC 0x54504b434b4f4f42ULL //"BOOKCKPT"
+#define BOOK_CHECKPOINT_VERSION 1
+
+struct bookcheckpoint
+{
+  uint64_t magic;
+  uint32_t version;
+  int32_t type; //binance_spot, ...
+  uint64_t lastupdateid;
+  uint64_t eventtime;
+  uint32_t nbids;
+  uint32_t nasks;
+  char symbol[32];
+};
+
+struct bookcheckpointlevel
+{
+  double price;
+  double quantity;
+};
+
+enum {book_bid, book_ask};
+
+//Level change applied by a depth update (a zero quantity removes the level)
+struct booklevelchange
+{
+  double price;
+  double quantity;
+  uint8_t side;
+};
+
+//Flags of bookupdate
+#define BOOKUPDATE_BESTBID_PRICE 0x1
+#define BOOKUPDATE_BESTBID_QUANTITY 0x2
+#define BOOKUPDATE_BESTASK_PRICE 0x4
+#define BOOKUPDATE_BESTASK_QUANTITY 0x8
+//The whole book was replaced (snapshot or checkpoint), or the subscription
+//is new: changes is empty and the subscriber has to read the whole book
+#define BOOKUPDATE_RESET 0x10
+
+//Passed to the subscribers after each applied depth update. changes is
+//only valid for the duration of the callback.
+struct bookupdate
+{
+  uint64_t updateid;
+  uint64_t eventtime;
+  const booklevelchange* changes;
+  uint32_t nchanges;
+  uint32_t flags; //Which sides of the top of book moved
+  double bestbid;
+  double bestbidquantity;
+  double bestask;
+  double bestaskquantity;
+};
+
+class BinanceOrderBook;
+
+//Called with fOBMutex held, on the feed thread, or on the snapshot
+//worker's thread for the reset and the buffered diffs applied with a
+//snapshot. It must not call the blocking BinanceOrderBook methods
+//(GetBookAtSum, Print, ...). The view and the stats are published before
+//the subscribers are notified, so GetView, GetViewBookAtSum, GetViewSides
+//and GetStats return the book at update.updateid, resets included.
+typedef void (*bookcallback)(const BinanceOrderBook& bob, const bookupdate& update, void* userdata);
+
+#ifndef BOOK_MAX_SUBSCRIBERS
+#define BOOK_MAX_SUBSCRIBERS 8
+#endif
+
+//Diff buffered until the snapshot is loaded. Slots are reused, so their
+//payload buffers stop allocating once they have grown to the diff size.
+struct bookcacheslot
+{
+  std::string payload;
+  uint64_t U;
+  uint64_t u;
+};
+
+//Capacity of the diff cache. Overflowing it restarts the synchronisation.
+#ifndef BOOK_CACHE_SLOTS
+#define BOOK_CACHE_SLOTS 256
+#endif
+
+//Delay before retrying a failed snapshot request, in ms
+#ifndef BOOK_SNAPSHOT_RETRY
+#define BOOK_SNAPSHOT_RETRY 1000
+#endif
+
+//Loads the snapshots of all the books on a single thread, one at a time
+//and in the order they are needed, which also keeps processes with many
+//books within the exchange's request weight limits. Failed requests are
+//retried after BOOK_SNAPSHOT_RETRY ms without holding up the other books.
+//The response buffer is shared and only grows to the largest snapshot.
+class BinanceSnapshotWorker
+{
+  public:
+  static BinanceSnapshotWorker& Instance();
+
+  //Queues book to be processed after delay ms, unless it is already
+  //queued. Called with the book's fOBMutex held.
+  void Wake(BinanceOrderBook* book, const uint64_t& delay=0);
+
+  //Dequeues book, once the worker is done with it if it is being
+  //processed. Called with the book's fOBMutex unlocked.
+  void Remove(BinanceOrderBook* book);
+
+  protected:
+  BinanceSnapshotWorker();
+  ~BinanceSnapshotWorker();
+
+  static void* Thread(void* instance);
+
+  struct queuedbook
+  {
+    BinanceOrderBook* book;
+    uint64_t due; //getmstime() at which the book is processed
+  };
+
+  std::vector<queuedbook> fQueue;
+  std::string fBody; //Only accessed by the worker thread
+  BinanceOrderBook* fCurrent; //Book being processed, or NULL
+  pthread_mutex_t fMutex;
+  pthread_cond_t fCond;
+  pthread_t fThread;
+  bool fStop;
+  private:
+  BinanceSnapshotWorker(const BinanceSnapshotWorker&);
+  BinanceSnapshotWorker& operator=(const BinanceSnapshotWorker&);
+};
+
+//Accumulator type and value returned when a book cannot fill a request
+template<typename T> struct bookvalue_traits;
+template<> struct bookvalue_traits<double> {typedef double acc; static inline double inf(){return INFINITY;}};
+template<> struct bookvalue_traits<fxint> {typedef __int128 acc; static inline fxint inf(){return INT64_MAX;}};
+
 
 class BinanceOrderBook
 {
+  friend class BinanceOrderBookManager;
+  friend class BinanceFeedReplay;
+  friend class BinanceSharedBookPublisher;
+  friend class BinanceConsolidatedBook;
+  friend class BinanceSnapshotWorker;
+
   public:
-  BinanceOrderBook(WebSocketManager* manager, const int& btype, const char* symbol, const int& depthlimit=0);
-  ~BinanceOrderBook(){StopSocket(); json_tokener_free(fJSTok); curl_easy_cleanup(fCHandle); pthread_cond_destroy(&fOBCond); pthread_mutex_destroy(&fOBMutex); free(fSymbol);}
+  //fxspec is required for the ladder storage types
+  BinanceOrderBook(WebSocketManager* manager, const int& btype, const char* symbol, const int& depthlimit=0, const int& booktype=binance_book_map, const binfxspec& fxspec=binfxspec());
+  ~BinanceOrderBook(){StopSocket(); StopSnapshots(); curl_easy_cleanup(fCHandle); pthread_cond_destroy(&fOBCond); pthread_mutex_destroy(&fOBMutex); free(fSymbol); delete fAsksLadder; delete fBidsLadder; delete fAsksWindow; delete fBidsWindow;}
 
   static inline bool depth_compare(const bookentry& lhs, const double& rhs){return (lhs.z<rhs);}
 
+  //Readers keep being served the last good book while it is resynchronised
+  //in the background after a sequence gap, with IsStale() returning true.
+  //GetBookAtSum only fails if no book has been loaded within waittime.
   bool GetBookAtSum(const double& bidsum, const double& asksum, const struct timespec& waittime={1,0}, bookvec* bids=NULL, bookvec* asks=NULL);
 
-  static inline double GetAverageAskPriceAtOrderQuantity(const bookvec& asks, const double& orderquantity){double dbuf=0; bookvec::const_iterator it; for(it=asks.begin(); it!=asks.end(); ++it) {dbuf+=it->x*it->y; if(dbuf>=orderquantity) {dbuf=it->z-(dbuf-orderquantity)/it->x; return orderquantity/dbuf;}} return INFINITY;}
+  inline bool IsStale() const {return fStale.load(std::memory_order_relaxed);}
+
+  //Lock-free copy of the published top of book, never blocking the feed
+  //thread. Returns false if no valid book has been published. Must not run
+  //concurrently with the destruction of a BinanceSharedBookPublisher the
+  //book has been added to.
+  inline bool GetView(bookview* view) const {fViewSlot.load(std::memory_order_acquire)->Read(view); return (view->updateid!=0);}
+
+  //Lock-free equivalent of GetBookAtSum served from the published view.
+  //Returns false if the view is invalid or not deep enough for the sums.
+  bool GetViewBookAtSum(const double& bidsum, const double& asksum, bookvec* bids=NULL, bookvec* asks=NULL) const;
+
+  //Lock-free copy of the published levels for the vwap_fill_* batch queries.
+  //The view holds at most BOOKVIEW_LEVELS levels per side, and a side that
+  //fills the view depth is flagged as truncated: sizes it cannot fill
+  //should be retried with GetSides.
+  bool GetViewSides(vwapside* bids, vwapside* asks) const;
+
+  //Same, copying up to maxlevels levels per side (all the levels if
+  //maxlevels is 0) with fOBMutex held, for sizes beyond the view depth.
+  //Returns false if no book has been loaded.
+  bool GetSides(vwapside* bids, vwapside* asks, const size_t& maxlevels=0);
+
+  //Lock-free copy of the statistics published after each update. Returns
+  //false if they are disabled or if a side of the book is empty.
+  inline bool GetStats(bookstats* stats) const {fStats.Read(stats); return (stats->updateid!=0);}
+
+  //Imbalance is computed over the top levels, and depth within bandbps of
+  //mid if bandbps>0 (in logarithmic time for indexed ladder books). A
+  //number of levels <=0 disables the statistics, which is the default.
+  inline void SetStats(const int& levels, const double& bandbps){pthread_mutex_lock(&fOBMutex); fStatsLevels=levels; fStatsBand=bandbps; PublishStats(); pthread_mutex_unlock(&fOBMutex);}
+
+  //Number of levels published per side (0 disables the view)
+  inline void SetViewDepth(const int& depth){pthread_mutex_lock(&fOBMutex); fViewDepth=(depth<0?0:(depth>BOOKVIEW_LEVELS?BOOKVIEW_LEVELS:depth)); PublishView(); pthread_mutex_unlock(&fOBMutex);}
+
+  //Cumulative depth queries answered without copying levels out, in
+  //logarithmic time for binance_book_ladder_indexed books (linearly for
+  //binance_book_ladder books). Not available for map books.
+  //Worst price reached and VWAP when filling a base quantity:
+  inline bool GetAskFillForQuantity(const double& quantity, double* price, double* vwap=NULL){return GetFillForQuantity(fAsksLadder, quantity, price, vwap);}
+  inline bool GetBidFillForQuantity(const double& quantity, double* price, double* vwap=NULL){return GetFillForQuantity(fBidsLadder, quantity, price, vwap);}
+  //Base quantity filled and worst price reached for a quote amount:
+  inline bool GetAskFillForAmount(const double& amount, double* quantity, double* price=NULL){return GetFillForAmount(fAsksLadder, amount, quantity, price);}
+  inline bool GetBidFillForAmount(const double& amount, double* quantity, double* price=NULL){return GetFillForAmount(fBidsLadder, amount, quantity, price);}
 
-  static inline double GetAverageAskPriceAtQuantity(const bookvec& asks, const double& quantity){if(quantity>asks.back().z) return INFINITY; double ret=0; bookvec::const_iterator it; for(it=asks.begin(); it->z<=quantity; ++it) ret+=it->x*it->y; ret+=it->x*(quantity-it->z+it->y); return ret/quantity;}
+  //Registers a callback invoked after each applied depth update. Returns
+  //the subscription id, or -1 if there are too many subscribers. If the
+  //book is already loaded, the callback is first invoked with
+  //BOOKUPDATE_RESET.
+  int Subscribe(bookcallback callback, void* userdata=NULL);
+  void Unsubscribe(const int& id);
 
-  static inline double GetAverageBidPriceAtOrderQuantity(const bookvec& bids, const double& orderquantity){double dbuf=0; bookvec::const_iterator it; for(it=bids.begin(); it!=bids.end(); ++it) {dbuf+=it->x*it->y; if(dbuf>=orderquantity) {dbuf=it->z-(dbuf-orderquantity)/it->x; return orderquantity/dbuf;}} return 0;}
+  //Fixed-point books are only available with the ladder storage types
+  bool GetFxBookAtSum(const fxint& bidsum, const fxint& asksum, const struct timespec& waittime={1,0}, fxbookvec* bids=NULL, fxbookvec* asks=NULL);
 
-  static inline double GetAverageBidPriceAtQuantity(const bookvec& bids, const double& quantity){double ret=0; bookvec::const_iterator it; for(it=bids.begin(); it!=bids.end() && it->z<=quantity; ++it) ret+=it->x*it->y; if(it!=bids.end()) ret+=it->x*(quantity-it->z+it->y); return ret/quantity;}
+  inline const binfxspec& GetFxSpec() const {return fFXSpec;}
+
+  //The GetAverage* helpers accept both bookvec and fxbookvec. To evaluate
+  //many sizes at once, see vwapside and vwap_fill_* in vwap_utils.h. Order
+  //quantities are quote amounts, and fixed-point results are truncated.
+  template<typename V> static inline typename V::value_type::x_type GetAverageAskPriceAtOrderQuantity(const V& asks, const typename V::value_type::x_type& orderquantity){typedef typename V::value_type::x_type T; typename bookvalue_traits<T>::acc dbuf=0; typename V::const_iterator it; for(it=asks.begin(); it!=asks.end(); ++it) {dbuf+=(typename bookvalue_traits<T>::acc)it->x*it->y; if(dbuf>=orderquantity) {dbuf=it->z-(dbuf-orderquantity)/it->x; return (T)(orderquantity/dbuf);}} return bookvalue_traits<T>::inf();}
+
+  template<typename V> static inline typename V::value_type::x_type GetAverageAskPriceAtQuantity(const V& asks, const typename V::value_type::z_type& quantity){typedef typename V::value_type::x_type T; if(asks.empty() || quantity>asks.back().z) return bookvalue_traits<T>::inf(); typename bookvalue_traits<T>::acc ret=0; typename V::const_iterator it; for(it=asks.begin(); it->z<=quantity; ++it) ret+=(typename bookvalue_traits<T>::acc)it->x*it->y; ret+=(typename bookvalue_traits<T>::acc)it->x*(quantity-it->z+it->y); return (T)(ret/quantity);}
+
+  template<typename V> static inline typename V::value_type::x_type GetAverageBidPriceAtOrderQuantity(const V& bids, const typename V::value_type::x_type& orderquantity){typedef typename V::value_type::x_type T; typename bookvalue_traits<T>::acc dbuf=0; typename V::const_iterator it; for(it=bids.begin(); it!=bids.end(); ++it) {dbuf+=(typename bookvalue_traits<T>::acc)it->x*it->y; if(dbuf>=orderquantity) {dbuf=it->z-(dbuf-orderquantity)/it->x; return (T)(orderquantity/dbuf);}} return 0;}
+
+  template<typename V> static inline typename V::value_type::x_type GetAverageBidPriceAtQuantity(const V& bids, const typename V::value_type::z_type& quantity){typedef typename V::value_type::x_type T; typename bookvalue_traits<T>::acc ret=0; typename V::const_iterator it; for(it=bids.begin(); it!=bids.end() && it->z<=quantity; ++it) ret+=(typename bookvalue_traits<T>::acc)it->x*it->y; if(it!=bids.end()) ret+=(typename bookvalue_traits<T>::acc)it->x*(quantity-it->z+it->y); return (T)(ret/quantity);}
 
   void Init();
 
-  int Launch(){Init(); StartSocket(); return ReloadBook();}
+  //Returns without waiting for the snapshot, which is fetched in the
+  //background once the first diff has been buffered
+  //If a checkpoint is given, the book resumes from it when the first
+  //buffered diff chains from its update ID, and falls back to the REST
+  //snapshot otherwise
+  int Launch(const char* checkpoint=NULL){Init(); if(checkpoint && LoadCheckpoint(checkpoint)) fprintf(stderr,"%s: Warning: Could not load the checkpoint of %s, falling back to the snapshot\n",__func__,fSymbol); StartSocket(); return ReloadBook();}
+
+  //Writes the synchronised book to path (through a temporary file renamed
+  //over it). The book is only locked while its levels are copied.
+  int SaveCheckpoint(const char* path);
+
+  //Loads a checkpoint to be resumed by the next ReloadBook. The book is
+  //flagged as stale until the resumption succeeds.
+  int LoadCheckpoint(const char* path);
+
+  inline void OnMessage(websocketpp::connection_hdl, client::message_ptr msg){const std::string& payload=msg->get_payload(); OnPayload(payload.data(), payload.size());}
 
-  void OnMessage(websocketpp::connection_hdl, client::message_ptr msg);
+  //Processes a raw depthUpdate payload, for books fed by an external source
+  //(e.g. BinanceOrderBookManager) rather than by their own socket
+  void OnPayload(const char* payload, const size_t& len);
 
   void Print(const size_t limit=0);
 
+  //Appends the received payloads and snapshot bodies to recorder, tagged
+  //with stream and conn (the book's own connection if -1). NULL stops the
+  //recording. The previous recorder is no longer used once it returns.
+  inline void SetRecorder(BinanceFeedRecorder* recorder, const uint32_t& stream=0, const int& conn=-1){pthread_mutex_lock(&fOBMutex); fRecorder=recorder; fRecordStream=stream; fRecordConn=conn; pthread_mutex_unlock(&fOBMutex);}
+
+  //Latency of the diffs applied while synchronised, per stage (lat_* in
+  //latency_utils.h), in nanoseconds. Only collected if BIN_LATENCY_STATS
+  //is defined, GetLatency returning false otherwise.
+  bool GetLatency(const int& stage, latsummary* summary);
+  void ResetLatency();
+  void DumpLatency(FILE* stream);
+
+  //Dumps the latencies to stream every interval seconds, from the feed
+  //thread once a diff has been processed (NULL stops the dumps)
+  void SetLatencyDump(FILE* stream, const int& interval);
+
   protected:
-  static size_t GetSnapshotCB(char *ptr, size_t size, size_t nmemb, void *instance);
+  static size_t GetSnapshotCB(char *ptr, size_t size, size_t nmemb, void *body);
+  //Takes the next step of the synchronisation on the snapshot worker's
+  //thread, with body as the response buffer
+  void ProcessSnapshot(std::string* body);
+  //fOBMutex must be locked before calling this function!
+  inline void WakeSnapshot(const uint64_t& delay=0){if(!fStopSnapshot) BinanceSnapshotWorker::Instance().Wake(this, delay);}
+  void StopSnapshots();
+  int8_t LoadSnapshot(std::string* body);
+  int8_t ResumeCheckpoint();
+  int8_t ApplySnapshot(const depthsnapshot& ds, const char* end);
   int ReloadBook();
+  void RequestSnapshot();
+  int8_t ApplyUpdate(const char* payload, const size_t& len, const uint64_t& U, const uint64_t& u);
+  void CacheUpdate(const char* payload, const size_t& len);
+  inline void ClearCache(){fCacheStart=fCacheSize=0;}
   void StartSocket();
   void StopSocket(){if(fId!=-1) fManager->Close(fId, websocketpp::close::status::normal, "");}
-  int8_t _OnMessage(const std::string& msg);
-  inline static int CheckUpdateIDSpot(const BinanceOrderBook& bob, const json_object* jobj, json_object* val){
-    if(json_object_object_get_ex(jobj, "U", &val)) {
+  int8_t _OnMessage(const char* msg, const size_t& len);
+  inline int8_t _OnMessage(const std::string& msg){return _OnMessage(msg.data(),msg.size());}
+
+  void PublishView();
+  void PublishStats();
+  inline void Publish(){PublishView(); PublishStats();}
+  double BandQuantity(const bool& bid, const double& bound) const;
+  //Notifies a single subscriber if subscriber>=0
+  void NotifySubscribers(const uint32_t& flags=0, const int& subscriber=-1);
+  bool GetFillForQuantity(const priceladder* ladder, const double& quantity, double* price, double* vwap);
+  bool GetFillForAmount(const priceladder* ladder, const double& amount, double* quantity, double* price);
+  int8_t WaitForUpdate(const double& bidsum, const double& asksum, const struct timespec& waittime);
+
+  //Prices and quantities are passed as the exchange's decimal strings
+  inline void SetBid(const char* price, const size_t& plen, const char* quantity, const size_t& qlen)
+  {
+    if(fBidsLadder) {
+      const fxint p=fFXSpec.ParsePrice(price,plen);
+      const fxint q=fFXSpec.ParseQuantity(quantity,qlen);
+      fBidsLadder->Set(-p/fFXSpec.tick,q);
+
+      if(fRecordChanges) fChanges.push_back({fFXSpec.PriceToDouble(p),fFXSpec.QuantityToDouble(q),book_bid});
+
+    } else if(fBidsWindow) {
+      const double p=strtod(price,NULL);
+      const double q=strtod(quantity,NULL);
+
+      double evicted;
+      //Levels beyond the window boundary are ignored, and the level evicted
+      //to make room for a new one is notified as removed
+      const int ret=fBidsWindow->Set(-p,q,&evicted);
+
+      if(ret && fRecordChanges) {
+
+	if(ret==2) fChanges.push_back({-evicted,0,book_bid});
+	fChanges.push_back({p,q,book_bid});
+      }
+
+    } else {
+      const double p=strtod(price,NULL);
+      const double q=strtod(quantity,NULL);
+
+      if(q) fBidsPrice[p]=q;
+
+      else fBidsPrice.erase(p);
+
+      if(fRecordChanges) fChanges.push_back({p,q,book_bid});
+    }
+  }
+
+  inline void SetAsk(const char* price, const size_t& plen, const char* quantity, const size_t& qlen)
+  {
+    if(fAsksLadder) {
+      const fxint p=fFXSpec.ParsePrice(price,plen);
+      const fxint q=fFXSpec.ParseQuantity(quantity,qlen);
+      fAsksLadder->Set(p/fFXSpec.tick,q);
+
+      if(fRecordChanges) fChanges.push_back({fFXSpec.PriceToDouble(p),fFXSpec.QuantityToDouble(q),book_ask});
+
+    } else if(fAsksWindow) {
+      const double p=strtod(price,NULL);
+      const double q=strtod(quantity,NULL);
+
+      double evicted;
+      const int ret=fAsksWindow->Set(p,q,&evicted);
 
-      if((uint64_t)json_object_get_int64(val) != bob.fLastUpdateID+1) {
-        fprintf(stderr,"%s: Error: previous update id %" PRIu64 " does not match expected value %" PRIu64 "!\n",__func__,(uint64_t)json_object_get_int64(val),bob.fLastUpdateID+1);
+      if(ret && fRecordChanges) {
+
+	if(ret==2) fChanges.push_back({evicted,0,book_ask});
+	fChanges.push_back({p,q,book_ask});
+      }
+
+    } else {
+      const double p=strtod(price,NULL);
+      const double q=strtod(quantity,NULL);
+
+      if(q) fAsksPrice[p]=q;
+
+      else fAsksPrice.erase(p);
+
+      if(fRecordChanges) fChanges.push_back({p,q,book_ask});
+    }
+  }
+
+  inline bool AsksEmpty() const {return (fAsksLadder?fAsksLadder->Empty():(fAsksWindow?fAsksWindow->Empty():fAsksPrice.empty()));}
+
+  inline bool IsDepleted() const {return (fAsksWindow && (fAsksWindow->IsDepleted() || fBidsWindow->IsDepleted()));}
+
+  inline void ClearBook()
+  {
+    if(fAsksLadder) {
+      fAsksLadder->Clear();
+      fBidsLadder->Clear();
+
+    } else if(fAsksWindow) {
+      fAsksWindow->Clear();
+      fBidsWindow->Clear();
+
+    } else {
+      fAsksPrice.clear();
+      fBidsPrice.clear();
+    }
+    fBestBid[0]=fBestBid[1]=fBestAsk[0]=fBestAsk[1]=0;
+  }
+
+  //Call f(price, quantity) from the best bid (ask) outwards until f returns false
+  template<typename F> inline void ForEachBid(F f) const
+  {
+    if(fBidsLadder) fBidsLadder->ForEach([&](const int64_t& key, const fxint& quantity){return f(fFXSpec.PriceToDouble(-key*fFXSpec.tick),fFXSpec.QuantityToDouble(quantity));});
+
+    else if(fBidsWindow) fBidsWindow->ForEach([&](const double& key, const double& quantity){return f(-key,quantity);});
+
+    else for(bidmap::const_iterator it=fBidsPrice.begin(); it!=fBidsPrice.end(); ++it) if(!f(it->first,it->second)) return;
+  }
+
+  template<typename F> inline void ForEachAsk(F f) const
+  {
+    if(fAsksLadder) fAsksLadder->ForEach([&](const int64_t& key, const fxint& quantity){return f(fFXSpec.PriceToDouble(key*fFXSpec.tick),fFXSpec.QuantityToDouble(quantity));});
+
+    else if(fAsksWindow) fAsksWindow->ForEach(f);
+
+    else for(askmap::const_iterator it=fAsksPrice.begin(); it!=fAsksPrice.end(); ++it) if(!f(it->first,it->second)) return;
+  }
+
+  //Fixed-point iteration, for the ladder storage type only
+  template<typename F> inline void ForEachBidFx(F f) const {fBidsLadder->ForEach([&](const int64_t& key, const fxint& quantity){return f(-key*fFXSpec.tick,quantity);});}
+  template<typename F> inline void ForEachAskFx(F f) const {fAsksLadder->ForEach([&](const int64_t& key, const fxint& quantity){return f(key*fFXSpec.tick,quantity);});}
+
+  inline static int CheckUpdateIDSpot(const BinanceOrderBook& bob, const depthupdate& du){
+    if(du.hasU) {
+
+      if(du.U != bob.fLastUpdateID+1) {
+        fprintf(stderr,"%s: Error: previous update id %" PRIu64 " does not match expected value %" PRIu64 "!\n",__func__,du.U,bob.fLastUpdateID+1);
         return -1;
       }
 
     } else return 0;
     return 1;
   }
-  inline static int CheckUpdateIDFuture(const BinanceOrderBook& bob, const json_object* jobj, json_object* val)
+  inline static int CheckUpdateIDFuture(const BinanceOrderBook& bob, const depthupdate& du)
   {
-    if(json_object_object_get_ex(jobj, "pu", &val)) {
+    if(du.haspu) {
 
-      if((uint64_t)json_object_get_int64(val) > bob.fLastUpdateID) {
-	fprintf(stderr,"%s: Error: previous update id %" PRIu64 " does not match expected value %" PRIu64 "!\n",__func__,(uint64_t)json_object_get_int64(val),bob.fLastUpdateID);
+      if(du.pu > bob.fLastUpdateID) {
+	fprintf(stderr,"%s: Error: previous update id %" PRIu64 " does not match expected value %" PRIu64 "!\n",__func__,du.pu,bob.fLastUpdateID);
 	return -1;
       }
 
@@ -128,22 +559,59 @@ class BinanceOrderBook
 
   WebSocketManager* fManager;
   CURL* fCHandle;
-  json_tokener* fJSTok;
-  int (*fCheckFunction)(const BinanceOrderBook& bob, const json_object* jobj, json_object* val);
+  int (*fCheckFunction)(const BinanceOrderBook& bob, const depthupdate& du);
   askmap fAsksPrice;
   bidmap fBidsPrice;
-  std::vector<std::string> fSocketCache;
+  priceladder* fAsksLadder;
+  priceladder* fBidsLadder;
+  depthwindow* fAsksWindow;
+  depthwindow* fBidsWindow;
+  binfxspec fFXSpec;
+  std::vector<bookcacheslot> fCache; //Ring of BOOK_CACHE_SLOTS slots
+  size_t fCacheStart;
+  size_t fCacheSize;
+  bool fCacheOverflow;
   pthread_mutex_t fOBMutex;
   pthread_cond_t fOBCond;
+  seqlock<bookview> fView;
+  std::atomic<seqlock<bookview>*> fViewSlot; //fView, or a slot of a BinanceSharedBookPublisher
+  seqlock<bookstats> fStats;
+  std::vector<booklevelchange> fChanges;
+  bookcallback fCallbacks[BOOK_MAX_SUBSCRIBERS];
+  void* fCallbackData[BOOK_MAX_SUBSCRIBERS];
+  int fNSubscribers;
+  bool fRecordChanges;
+  double fBestBid[2]; //Price and quantity as last notified
+  double fBestAsk[2];
   uint64_t fLastUpdateID;
+  uint64_t fLastEventTime;
+  int fViewDepth;
+  int fStatsLevels;
+  double fStatsBand;
   int fType;
   int fDepthLimit;
   char* fSymbol;
   int fId;
-  int fHasValidUpdate;
+  int fHasValidUpdate; //-1: waiting for a snapshot, 0: looking for the first diff, 1: synchronised
+  std::atomic<bool> fStale;
+  bool fSnapshotRequested;
+  bool fStopSnapshot;
+  bool fResume; //A loaded checkpoint waits for its first chaining diff
+  bool fOffline; //Snapshots are provided by a replay instead of fetched
+  BinanceFeedRecorder* fRecorder;
+  uint32_t fRecordStream;
+  int fRecordConn;
   bool fNewDataReady;
   double fLastBidSum;
   double fLastAskSum;
+#ifdef BIN_LATENCY_STATS
+  lathist fLatency[lat_nstages];
+  uint64_t fLatParsed; //Times at which the diff being applied was scanned and applied
+  uint64_t fLatApplied;
+  FILE* fLatDumpStream;
+  uint64_t fLatDumpInterval;
+  uint64_t fLatLastDump;
+#endif
   private:
 };
 
@@ -0,0 +1,529 @@
+#include "BinanceOrderBookManager.h"
+
+//Splits a combined stream frame {"stream":"<name>","data":{...}} into the
+//stream name and the raw data payload. Returns 0 on success.
+static int SplitStreamFrame(const char* p, const char* end, const char** name, size_t* namelen, const char** data, size_t* datalen)
+{
+  p=scan_skipws(p,end);
+
+  if(p==end || *p!='{') return -1;
+  p=scan_skipws(p+1,end);
+
+  if(end-p<9 || memcmp(p,"\"stream\"",8)) return -1;
+  p=scan_find(p+8,end,'"');
+
+  if(p==end) return -1;
+  *name=++p;
+  p=scan_find(p,end,'"');
+
+  if(p==end) return -1;
+  *namelen=p-*name;
+  p=scan_find(p+1,end,'"');
+
+  if(end-p<7 || memcmp(p,"\"data\"",6)) return -1;
+  p=scan_find(p+6,end,':');
+
+  if(p==end) return -1;
+  p=scan_skipws(p+1,end);
+
+  //The data object ends before the closing brace of the frame
+  while(end>p && (end[-1]==' ' || end[-1]=='\t' || end[-1]=='\n' || end[-1]=='\r')) --end;
+
+  if(end<=p || end[-1]!='}') return -1;
+  --end;
+
+  while(end>p && (end[-1]==' ' || end[-1]=='\t' || end[-1]=='\n' || end[-1]=='\r')) --end;
+  *data=p;
+  *datalen=end-p;
+  return 0;
+}
+
+BinanceOrderBookManager::BinanceOrderBookManager(WebSocketManager* manager, const int& btype, const int& streamsperconnection): fManager(manager), fBooks(), fConnections(), fRoutes(), fRecorder(NULL), fPublisher(NULL), fMutex(), fCond(), fCheckpointCond(), fCheckpointThread(), fCheckpointDirectory(), fCheckpointInterval(0), fCheckpointThreadRunning(false), fStreamURI(NULL), fType(btype), fMaxStreams(streamsperconnection), fRequestID(0), fLaunched(false), fClosing(false)
+{
+  pthread_mutex_init(&fMutex,NULL);
+  pthread_cond_init(&fCond,NULL);
+  pthread_cond_init(&fCheckpointCond,NULL);
+  int maxstreams;
+
+  switch(fType) {
+    case binance_spot:
+      fStreamURI=BINANCE_SPOT_WS_STREAM_URI;
+      maxstreams=BINANCE_SPOT_MAX_STREAMS;
+      break;
+
+    case binance_usdm_future:
+      fStreamURI=BINANCE_USDM_FUTURE_WS_STREAM_URI;
+      maxstreams=BINANCE_FUTURE_MAX_STREAMS;
+      break;
+
+    case binance_coinm_future:
+      fStreamURI=BINANCE_COINM_FUTURE_WS_STREAM_URI;
+      maxstreams=BINANCE_FUTURE_MAX_STREAMS;
+      break;
+
+    default:
+      fprintf(stderr,"%s: Error: Invalid binance type\n",__func__);
+      throw 0;
+  }
+
+  if(fMaxStreams<=0 || fMaxStreams>maxstreams) fMaxStreams=maxstreams;
+}
+
+BinanceOrderBookManager::~BinanceOrderBookManager()
+{
+  struct timespec timeout;
+  std::string checkpoints;
+  size_t i;
+  pthread_mutex_lock(&fMutex);
+  checkpoints=fCheckpointDirectory;
+  pthread_mutex_unlock(&fMutex);
+  SetCheckpointDirectory(NULL);
+  pthread_mutex_lock(&fMutex);
+  fClosing=true;
+
+  for(i=0; i<fConnections.size(); ++i) {
+
+    if(fConnections[i].timer) fConnections[i].timer->cancel();
+
+    if(fConnections[i].id!=-1) fManager->Close(fConnections[i].id, websocketpp::close::status::normal, "");
+  }
+  fRoutes.clear();
+  //The handlers of the connections and of the timers must have run before
+  //the manager goes away
+  clock_gettime(CLOCK_REALTIME, &timeout);
+  timeout.tv_sec+=5;
+
+  for(i=0; i<fConnections.size();) {
+
+    if(fConnections[i].id==-1 && !fConnections[i].reconnecting) ++i;
+
+    else if(pthread_cond_timedwait(&fCond, &fMutex, &timeout)==ETIMEDOUT) {
+      fprintf(stderr,"%s: Warning: Timed out waiting for the connections to close\n",__func__);
+      break;
+    }
+  }
+
+  //The books are saved once no more frames are routed to them
+  if(!checkpoints.empty()) {
+    pthread_mutex_unlock(&fMutex);
+    SaveCheckpoints(checkpoints.c_str());
+    pthread_mutex_lock(&fMutex);
+  }
+
+  for(i=0; i<fBooks.size(); ++i) {
+
+    while(fBooks[i].busy) pthread_cond_wait(&fCond, &fMutex);
+
+    if(fBooks[i].book && fBooks[i].slot>=0) fPublisher->RemoveBook(fBooks[i].slot);
+    delete fBooks[i].book;
+  }
+  fBooks.clear();
+
+  for(i=0; i<fConnections.size(); ++i) delete fConnections[i].timer;
+  fConnections.clear();
+  pthread_mutex_unlock(&fMutex);
+  pthread_mutex_destroy(&fMutex);
+  pthread_cond_destroy(&fCond);
+  pthread_cond_destroy(&fCheckpointCond);
+}
+
+int BinanceOrderBookManager::AddBook(const char* symbol, const int& depthlimit, const int& booktype, const binfxspec& fxspec)
+{
+  bobmbook entry;
+  const size_t len=strlen(symbol);
+  entry.stream.resize(len);
+
+  for(size_t i=0; i<len; ++i) entry.stream[i]=tolower(symbol[i]);
+  entry.stream+=WS_DEPTH_CONF1 WS_DEPTH_CONF2;
+  entry.hash=StreamHash(entry.stream.data(), entry.stream.size());
+  entry.busy=0;
+
+  try {
+    entry.book=new BinanceOrderBook(fManager, fType, entry.stream.substr(0,len).c_str(), depthlimit, booktype, fxspec);
+
+  } catch(...) {
+    return -1;
+  }
+  entry.book->Init();
+
+  pthread_mutex_lock(&fMutex);
+
+  if(fRoutes.find(entry.hash)!=fRoutes.end()) {
+    pthread_mutex_unlock(&fMutex);
+    fprintf(stderr,"%s: Error: Stream %s is already tracked!\n",__func__,entry.stream.c_str());
+    delete entry.book;
+    return -1;
+  }
+  const int id=fBooks.size();
+  entry.conn=AssignConnection();
+  bobmconnection& conn=fConnections[entry.conn];
+  ++conn.nstreams;
+
+  if(fRecorder) entry.book->SetRecorder(fRecorder, id, entry.conn);
+  entry.slot=(fPublisher?fPublisher->AddBook(entry.book, entry.stream.c_str()):-1);
+  fBooks.push_back(entry);
+  fRoutes[entry.hash]=id;
+  int ret=0;
+
+  if(fLaunched) {
+
+    if(conn.open) ret=Subscribe(entry.conn, std::vector<std::string>(1,entry.stream));
+
+    //A scheduled reconnection subscribes to the streams of all the
+    //connection's books
+    else if(conn.id==-1) {
+
+      if(!conn.reconnecting) ret=Connect(entry.conn, GetStreams(entry.conn));
+
+    } else conn.pending.push_back(entry.stream);
+  }
+  //The book is kept busy while its snapshot is reloaded outside of fMutex,
+  //so RemoveBook waits for it
+  const bool reload=(fLaunched && !ret);
+
+  if(reload) ++fBooks[id].busy;
+  pthread_mutex_unlock(&fMutex);
+
+  if(ret) {
+    RemoveBook(id);
+    return -1;
+  }
+
+  if(reload) {
+    entry.book->ReloadBook();
+    pthread_mutex_lock(&fMutex);
+
+    if(!--fBooks[id].busy) pthread_cond_broadcast(&fCond);
+    pthread_mutex_unlock(&fMutex);
+  }
+  return id;
+}
+
+int BinanceOrderBookManager::RemoveBook(const int& id)
+{
+  pthread_mutex_lock(&fMutex);
+
+  if(id<0 || (size_t)id>=fBooks.size() || !fBooks[id].book) {
+    pthread_mutex_unlock(&fMutex);
+    return -1;
+  }
+  bobmbook& entry=fBooks[id];
+  bobmconnection& conn=fConnections[entry.conn];
+  BinanceOrderBook* book=entry.book;
+  fRoutes.erase(entry.hash);
+
+  if(conn.open) Subscribe(entry.conn, std::vector<std::string>(1,entry.stream), false);
+
+  else {
+    std::vector<std::string>::iterator it=std::find(conn.pending.begin(), conn.pending.end(), entry.stream);
+
+    if(it!=conn.pending.end()) conn.pending.erase(it);
+  }
+  --conn.nstreams;
+
+  if(entry.slot>=0) fPublisher->RemoveBook(entry.slot);
+  entry.book=NULL;
+
+  //The book can no longer be routed to, but a frame may still be applied
+  //to it. fBooks may grow while waiting, so entry is not used anymore.
+  while(fBooks[id].busy) pthread_cond_wait(&fCond, &fMutex);
+  pthread_mutex_unlock(&fMutex);
+  delete book;
+  return 0;
+}
+
+void BinanceOrderBookManager::SetRecorder(BinanceFeedRecorder* recorder)
+{
+  pthread_mutex_lock(&fMutex);
+  fRecorder=recorder;
+
+  for(size_t i=0; i<fBooks.size(); ++i) if(fBooks[i].book) fBooks[i].book->SetRecorder(recorder, i, fBooks[i].conn);
+  pthread_mutex_unlock(&fMutex);
+}
+
+void BinanceOrderBookManager::SetPublisher(BinanceSharedBookPublisher* publisher)
+{
+  pthread_mutex_lock(&fMutex);
+
+  for(size_t i=0; i<fBooks.size(); ++i) if(fBooks[i].book) {
+
+    if(fBooks[i].slot>=0) fPublisher->RemoveBook(fBooks[i].slot);
+    fBooks[i].slot=(publisher?publisher->AddBook(fBooks[i].book, fBooks[i].stream.c_str()):-1);
+  }
+  fPublisher=publisher;
+  pthread_mutex_unlock(&fMutex);
+}
+
+int BinanceOrderBookManager::SaveCheckpoints(const char* directory)
+{
+  std::vector<std::pair<int,BinanceOrderBook*> > books;
+  std::string path;
+  int ret=0;
+  pthread_mutex_lock(&fMutex);
+
+  //The books are kept busy rather than locking fMutex while their files
+  //are written, so RemoveBook waits for them
+  for(size_t i=0; i<fBooks.size(); ++i) if(fBooks[i].book) {
+    ++fBooks[i].busy;
+    books.push_back(std::make_pair((int)i, fBooks[i].book));
+  }
+
+  for(size_t i=0; i<books.size(); ++i) {
+    path=std::string(directory)+'/'+fBooks[books[i].first].stream+".ckpt";
+    pthread_mutex_unlock(&fMutex);
+
+    if(books[i].second->SaveCheckpoint(path.c_str())) ++ret;
+    pthread_mutex_lock(&fMutex);
+
+    if(!--fBooks[books[i].first].busy) pthread_cond_broadcast(&fCond);
+  }
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+int BinanceOrderBookManager::LoadCheckpoints(const char* directory)
+{
+  std::string path;
+  int ret=0;
+  pthread_mutex_lock(&fMutex);
+
+  for(size_t i=0; i<fBooks.size(); ++i) {
+
+    if(!fBooks[i].book) continue;
+    path=std::string(directory)+'/'+fBooks[i].stream+".ckpt";
+
+    if(fBooks[i].book->LoadCheckpoint(path.c_str())) ++ret;
+  }
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+int BinanceOrderBookManager::SetCheckpointDirectory(const char* directory, const int& interval)
+{
+  pthread_mutex_lock(&fMutex);
+  fCheckpointDirectory=(directory?directory:"");
+  fCheckpointInterval=(directory && interval>0?interval:0);
+
+  if(fCheckpointThreadRunning) {
+    pthread_cond_signal(&fCheckpointCond);
+
+    if(fCheckpointInterval) {
+      pthread_mutex_unlock(&fMutex);
+      return 0;
+    }
+    pthread_mutex_unlock(&fMutex);
+    pthread_join(fCheckpointThread, NULL);
+    fCheckpointThreadRunning=false;
+    return 0;
+  }
+
+  if(fCheckpointInterval) {
+
+    if(pthread_create(&fCheckpointThread, NULL, CheckpointThread, this)) {
+      fprintf(stderr,"%s: Error: Could not start the checkpoint thread!\n",__func__);
+      fCheckpointInterval=0;
+      pthread_mutex_unlock(&fMutex);
+      return -1;
+    }
+    fCheckpointThreadRunning=true;
+  }
+  pthread_mutex_unlock(&fMutex);
+  return 0;
+}
+
+void* BinanceOrderBookManager::CheckpointThread(void* instance)
+{
+  BinanceOrderBookManager& bobm=*(BinanceOrderBookManager*)instance;
+  struct timespec timeout;
+  std::string directory;
+  pthread_mutex_lock(&bobm.fMutex);
+
+  while(bobm.fCheckpointInterval) {
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_sec+=bobm.fCheckpointInterval;
+
+    //Woken up early when the interval is changed
+    if(pthread_cond_timedwait(&bobm.fCheckpointCond, &bobm.fMutex, &timeout)!=ETIMEDOUT) continue;
+    directory=bobm.fCheckpointDirectory;
+    pthread_mutex_unlock(&bobm.fMutex);
+    bobm.SaveCheckpoints(directory.c_str());
+    pthread_mutex_lock(&bobm.fMutex);
+  }
+  pthread_mutex_unlock(&bobm.fMutex);
+  return NULL;
+}
+
+int BinanceOrderBookManager::Launch()
+{
+  std::vector<BinanceOrderBook*> books;
+  int ret=0;
+  pthread_mutex_lock(&fMutex);
+
+  for(size_t i=0; i<fConnections.size(); ++i) {
+
+    if(fConnections[i].id!=-1 || !fConnections[i].nstreams) continue;
+
+    if(Connect(i, GetStreams(i))) ret=-1;
+  }
+  fLaunched=true;
+
+  for(size_t j=0; j<fBooks.size(); ++j) if(fBooks[j].book) books.push_back(fBooks[j].book);
+  pthread_mutex_unlock(&fMutex);
+
+  //Snapshots are fetched by each book once its first frame has been cached
+  for(size_t j=0; j<books.size(); ++j) books[j]->ReloadBook();
+  return ret;
+}
+
+void BinanceOrderBookManager::OnMessage(const size_t& conn, websocketpp::connection_hdl, client::message_ptr msg)
+{
+  const std::string& payload=msg->get_payload();
+  const char *name, *data;
+  size_t namelen, datalen;
+
+  if(SplitStreamFrame(payload.data(), payload.data()+payload.size(), &name, &namelen, &data, &datalen)) {
+
+    //Replies to SUBSCRIBE/UNSUBSCRIBE requests
+    if(payload.find("\"error\"")!=std::string::npos) fprintf(stderr,"%s: Error on connection %zu: %s\n",__func__,conn,payload.c_str());
+    return;
+  }
+  BinanceOrderBook* book=NULL;
+  int id=-1;
+  pthread_mutex_lock(&fMutex);
+  std::unordered_map<uint64_t, int>::const_iterator it=fRoutes.find(StreamHash(name, namelen));
+
+  if(it!=fRoutes.end()) {
+    bobmbook& entry=fBooks[it->second];
+
+    if(entry.stream.size()==namelen && !memcmp(entry.stream.data(), name, namelen)) {
+      id=it->second;
+      book=entry.book;
+      ++entry.busy;
+    }
+  }
+  pthread_mutex_unlock(&fMutex);
+
+  if(!book) return;
+  //The book cannot be deleted while busy, and is protected by its own mutex
+  book->OnPayload(data, datalen);
+  pthread_mutex_lock(&fMutex);
+
+  if(!--fBooks[id].busy) pthread_cond_broadcast(&fCond);
+  pthread_mutex_unlock(&fMutex);
+}
+
+void BinanceOrderBookManager::OnOpen(const size_t& conn, websocketpp::connection_hdl)
+{
+  pthread_mutex_lock(&fMutex);
+  bobmconnection& c=fConnections[conn];
+  c.open=true;
+  c.attempts=0;
+
+  if(!c.pending.empty()) {
+    Subscribe(conn, c.pending);
+    c.pending.clear();
+  }
+  pthread_mutex_unlock(&fMutex);
+}
+
+void BinanceOrderBookManager::OnClose(const size_t& conn, websocketpp::connection_hdl)
+{
+  pthread_mutex_lock(&fMutex);
+  bobmconnection& c=fConnections[conn];
+  c.open=false;
+  c.id=-1;
+  pthread_cond_broadcast(&fCond);
+
+  if(!fClosing && c.nstreams) ScheduleReconnect(conn);
+  pthread_mutex_unlock(&fMutex);
+}
+
+int BinanceOrderBookManager::Connect(const size_t& conn, const std::string& streams)
+{
+  //fMutex must be locked before calling this function!
+  std::string uri(fStreamURI);
+  uri+=streams;
+  printf("Socket URI is %s\n",uri.c_str());
+  fConnections[conn].open=false;
+  fConnections[conn].pending.clear();
+  fConnections[conn].id=fManager->Connect(uri.c_str(), websocketpp::lib::bind(&BinanceOrderBookManager::OnMessage, this, conn, websocketpp::lib::placeholders::_1, websocketpp::lib::placeholders::_2), websocketpp::lib::bind(&BinanceOrderBookManager::OnOpen, this, conn, websocketpp::lib::placeholders::_1), websocketpp::lib::bind(&BinanceOrderBookManager::OnClose, this, conn, websocketpp::lib::placeholders::_1));
+  return (fConnections[conn].id<0);
+}
+
+void BinanceOrderBookManager::ScheduleReconnect(const size_t& conn)
+{
+  //fMutex must be locked before calling this function!
+  bobmconnection& c=fConnections[conn];
+
+  if(c.reconnecting) return;
+  const int delay=binreconnectdelay(c.attempts++);
+  fprintf(stderr,"%s: Warning: Connection %zu is closed, reconnecting in %i ms\n",__func__,conn,delay);
+
+  if(!c.timer) c.timer=new boost::asio::steady_timer(fManager->GetIOService());
+  c.reconnecting=true;
+  c.timer->expires_from_now(std::chrono::milliseconds(delay));
+  c.timer->async_wait([this, conn](const boost::system::error_code& ec){Reconnect(conn, !ec);});
+}
+
+void BinanceOrderBookManager::Reconnect(const size_t& conn, const bool& expired)
+{
+  pthread_mutex_lock(&fMutex);
+  bobmconnection& c=fConnections[conn];
+  c.reconnecting=false;
+  pthread_cond_broadcast(&fCond);
+
+  //The connection subscribes to the streams of its current books
+  if(expired && !fClosing && c.id==-1 && c.nstreams && Connect(conn, GetStreams(conn))) ScheduleReconnect(conn);
+  pthread_mutex_unlock(&fMutex);
+}
+
+std::string BinanceOrderBookManager::GetStreams(const size_t& conn) const
+{
+  //fMutex must be locked before calling this function!
+  std::string streams;
+
+  for(size_t j=0; j<fBooks.size(); ++j) {
+
+    if(fBooks[j].book && fBooks[j].conn==(int)conn) {
+
+      if(!streams.empty()) streams+='/';
+      streams+=fBooks[j].stream;
+    }
+  }
+  return streams;
+}
+
+int BinanceOrderBookManager::Subscribe(const size_t& conn, const std::vector<std::string>& streams, const bool& subscribe)
+{
+  //fMutex must be locked before calling this function!
+  //Note that the exchange limits the number of such messages per second
+  std::string request(subscribe?"{\"method\":\"SUBSCRIBE\",\"params\":[":"{\"method\":\"UNSUBSCRIBE\",\"params\":[");
+  char buf[32];
+
+  for(size_t i=0; i<streams.size(); ++i) {
+
+    if(i) request+=',';
+    request+='"';
+    request+=streams[i];
+    request+='"';
+  }
+  sprintf(buf,"],\"id\":%i}",++fRequestID);
+  request+=buf;
+  fManager->Send(fConnections[conn].id, request);
+  return 0;
+}
+
+int BinanceOrderBookManager::AssignConnection()
+{
+  //fMutex must be locked before calling this function!
+  for(size_t i=0; i<fConnections.size(); ++i) if(fConnections[i].nstreams<fMaxStreams) return i;
+  bobmconnection conn;
+  conn.id=-1;
+  conn.nstreams=0;
+  conn.attempts=0;
+  conn.open=false;
+  conn.reconnecting=false;
+  conn.timer=NULL;
+  fConnections.push_back(conn);
+  return fConnections.size()-1;
+}
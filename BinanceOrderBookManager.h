@@ -0,0 +1,136 @@
+#ifndef _BINANCEORDERBOOKMANAGER_
+#define _BINANCEORDERBOOKMANAGER_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctype.h>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+
+#include <pthread.h>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include "binance_base.h"
+
+#include "WebSocketManager.h"
+#include "BinanceOrderBook.h"
+
+#define BINANCE_SPOT_WS_STREAM_URI BINANCE_SPOT_WS_STREAM_BASEURI
+#define BINANCE_USDM_FUTURE_WS_STREAM_URI BINANCE_USDM_FUTURE_WS_STREAM_BASEURI
+#define BINANCE_COINM_FUTURE_WS_STREAM_URI BINANCE_COINM_FUTURE_WS_STREAM_BASEURI
+
+struct bobmbook
+{
+  BinanceOrderBook* book; //NULL once removed
+  std::string stream;
+  uint64_t hash;
+  int conn; //Index in fConnections
+  int slot; //Slot in fPublisher, -1 if not published
+  int busy; //Number of frames being applied to the book outside of fMutex
+};
+
+struct bobmconnection
+{
+  int id; //WebSocketManager connection id, -1 if not connected
+  int nstreams;
+  int attempts; //Connection attempts since the connection was last open
+  bool open;
+  bool reconnecting; //A reconnection is scheduled on timer
+  boost::asio::steady_timer* timer; //NULL until the connection first closes
+  std::vector<std::string> pending; //Streams to subscribe once the connection is open
+};
+
+//Tracks many order books of the same binance type over a few combined
+//stream connections (/stream?streams=a@depth/b@depth/...). Books are
+//packed onto connections up to the per-connection stream limit, streams
+//are added and removed live with SUBSCRIBE/UNSUBSCRIBE, and each frame is
+//dispatched to its book through a precomputed stream name hash. Frames
+//are applied to their book outside of the manager's mutex, so books on
+//other connections and the manager's functions never wait for them.
+//Connections that close or fail to open are reconnected with an
+//exponential backoff, and their books resynchronise on the sequence gap.
+class BinanceOrderBookManager
+{
+  public:
+  BinanceOrderBookManager(WebSocketManager* manager, const int& btype, const int& streamsperconnection=0);
+  ~BinanceOrderBookManager();
+
+  //Returns the book id, or -1 on failure. Books added after Launch are
+  //subscribed immediately and loaded in the background.
+  int AddBook(const char* symbol, const int& depthlimit=0, const int& booktype=binance_book_map, const binfxspec& fxspec=binfxspec());
+  //Waits for the frame being applied to the book, if any, before deleting
+  //it, so it must not be called from the book's own callbacks
+  int RemoveBook(const int& id);
+
+  inline BinanceOrderBook* GetBook(const int& id) const {return (id>=0 && (size_t)id<fBooks.size()?fBooks[id].book:NULL);}
+  inline size_t GetNConnections() const {return fConnections.size();}
+
+  //Records the payloads and snapshots of all the books, tagged with their
+  //book id and connection index
+  void SetRecorder(BinanceFeedRecorder* recorder);
+
+  //Publishes the views of all the books into a shared memory segment,
+  //under their stream names. The publisher must outlive the manager or be
+  //replaced (possibly by NULL) first, and the lock-free view readers of
+  //the books must be quiescent when it is destroyed.
+  void SetPublisher(BinanceSharedBookPublisher* publisher);
+
+  //Checkpoints of all the books, stored as <directory>/<stream>.ckpt.
+  //LoadCheckpoints is to be called before Launch. Both return the number
+  //of books that failed. The files are written without holding the
+  //manager's mutex.
+  int SaveCheckpoints(const char* directory);
+  int LoadCheckpoints(const char* directory);
+
+  //Saves the checkpoints to directory every interval seconds from a
+  //background thread, and a last time when the manager is destroyed (only
+  //then if interval<=0), so a restart resumes the books without their
+  //snapshots. NULL stops the checkpointing.
+  int SetCheckpointDirectory(const char* directory, const int& interval=0);
+
+  //Opens the connections for all the books added so far and loads them
+  int Launch();
+
+  void OnMessage(const size_t& conn, websocketpp::connection_hdl, client::message_ptr msg);
+  void OnOpen(const size_t& conn, websocketpp::connection_hdl);
+  void OnClose(const size_t& conn, websocketpp::connection_hdl);
+
+  static inline uint64_t StreamHash(const char* name, const size_t& len){uint64_t h=14695981039346656037ULL; for(size_t i=0; i<len; ++i) h=(h^(uint8_t)name[i])*1099511628211ULL; return h;}
+
+  protected:
+  int Connect(const size_t& conn, const std::string& streams);
+  void ScheduleReconnect(const size_t& conn);
+  void Reconnect(const size_t& conn, const bool& expired);
+  std::string GetStreams(const size_t& conn) const;
+  int Subscribe(const size_t& conn, const std::vector<std::string>& streams, const bool& subscribe=true);
+  int AssignConnection();
+  static void* CheckpointThread(void* instance);
+
+  WebSocketManager* fManager;
+  std::vector<bobmbook> fBooks;
+  std::vector<bobmconnection> fConnections;
+  std::unordered_map<uint64_t, int> fRoutes;
+  BinanceFeedRecorder* fRecorder;
+  BinanceSharedBookPublisher* fPublisher;
+  pthread_mutex_t fMutex;
+  pthread_cond_t fCond; //Signalled when a book is released, a connection closes or a reconnection timer completes
+  pthread_cond_t fCheckpointCond; //Signalled when the checkpoint interval is changed
+  pthread_t fCheckpointThread;
+  std::string fCheckpointDirectory; //Empty if the books are not checkpointed
+  int fCheckpointInterval;
+  bool fCheckpointThreadRunning;
+  const char* fStreamURI;
+  int fType;
+  int fMaxStreams;
+  int fRequestID;
+  bool fLaunched;
+  bool fClosing;
+  private:
+};
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef _BINANCEPRICELADDER_
+#define _BINANCEPRICELADDER_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <vector>
+#include <map>
+#include <algorithm>
+
+//Contiguous tick-indexed book side. Levels are addressed by an integer key
+//(price in ticks) relative to a moving base, so that smaller keys are always
+//better prices: asks use +ticks and bids use -ticks. Occupied levels are
+//tracked in a bitmap for fast best-price search. Levels falling beyond the
+//end of the window are kept in an overflow map, which therefore only ever
+//contains keys worse than any level in the window.
+//
+//Indexed ladders also maintain Fenwick trees of the window quantities and
+//amounts (|key| x quantity), so that cumulative depth queries are answered
+//in logarithmic time. Overflow levels are then walked linearly.
+template<typename Q> class BinancePriceLadder
+{
+  public:
+  BinancePriceLadder(const size_t& capacity=(1<<14), const bool& indexed=false): fQty(), fBits(), fQtyTree(), fAmountTree(), fOverflow(), fBase(0), fCapacity(), fMargin(), fTreeStep(0), fBestIdx(-1), fWinCount(0)
+  {
+    //Capacity is rounded up to a multiple of 64 ticks
+    fCapacity=((capacity>64?capacity:64)+63)&~(size_t)63;
+    fMargin=fCapacity/4;
+    fQty.resize(fCapacity,Q());
+    fBits.resize(fCapacity/64,0);
+
+    if(indexed) {
+      fQtyTree.resize(fCapacity+1,Q());
+      fAmountTree.resize(fCapacity+1,Q());
+
+      for(fTreeStep=1; fTreeStep*2<=fCapacity; fTreeStep*=2);
+    }
+  }
+
+  inline void Set(const int64_t& key, const Q& qty)
+  {
+    int64_t idx=key-fBase;
+
+    //Better than anything the window can hold
+    if(idx<0) {
+
+      if(!qty) return;
+      Rebase(key-(int64_t)fMargin);
+      idx=key-fBase;
+
+    } else if(idx>=(int64_t)fCapacity) {
+
+      if(!fWinCount && qty && fOverflow.empty()) {
+	Rebase(key-(int64_t)fMargin);
+	idx=key-fBase;
+
+      } else {
+
+	if(qty) fOverflow[key]=qty;
+
+	else fOverflow.erase(key);
+	return;
+      }
+    }
+
+    if(fTreeStep && qty!=fQty[idx]) TreeAdd(idx,qty-fQty[idx]);
+
+    if(qty) {
+
+      if(!fQty[idx]) {
+	fBits[idx>>6]|=((uint64_t)1<<(idx&63));
+	++fWinCount;
+
+	if(fBestIdx<0 || idx<fBestIdx) fBestIdx=idx;
+      }
+      fQty[idx]=qty;
+
+    } else if(fQty[idx]) {
+      fQty[idx]=Q();
+      fBits[idx>>6]&=~((uint64_t)1<<(idx&63));
+      --fWinCount;
+
+      if(idx==fBestIdx) {
+	fBestIdx=NextIdx(idx+1);
+
+	//Recenter lazily once the touch has drifted away from the front
+	if(fBestIdx<0) {
+
+	  if(!fOverflow.empty()) Rebase(fOverflow.begin()->first-(int64_t)fMargin);
+
+	} else if(fBestIdx>=(int64_t)(fCapacity/2)) Rebase(fBase+fBestIdx-(int64_t)fMargin);
+      }
+    }
+  }
+
+  inline Q Get(const int64_t& key) const
+  {
+    const int64_t idx=key-fBase;
+
+    if(idx<0) return Q();
+
+    if(idx<(int64_t)fCapacity) return fQty[idx];
+    typename std::map<int64_t, Q>::const_iterator it=fOverflow.find(key);
+    return (it!=fOverflow.end()?it->second:Q());
+  }
+
+  void Clear()
+  {
+    for(int64_t idx=NextIdx(0); idx>=0; idx=NextIdx(idx+1)) fQty[idx]=Q();
+    memset(fBits.data(),0,fBits.size()*sizeof(uint64_t));
+    fOverflow.clear();
+    fBestIdx=-1;
+    fWinCount=0;
+
+    if(fTreeStep) {
+      std::fill(fQtyTree.begin(),fQtyTree.end(),Q());
+      std::fill(fAmountTree.begin(),fAmountTree.end(),Q());
+    }
+  }
+
+  inline bool Empty() const {return (!fWinCount && fOverflow.empty());}
+  inline size_t Size() const {return fWinCount+fOverflow.size();}
+  inline size_t Capacity() const {return fCapacity;}
+  inline bool IsIndexed() const {return (fTreeStep!=0);}
+
+  //Only valid if the ladder is not empty
+  inline int64_t BestKey() const {return (fBestIdx>=0?fBase+fBestIdx:fOverflow.begin()->first);}
+
+  //Calls f(key, qty) from the best level outwards until f returns false
+  template<typename F> inline void ForEach(F f) const
+  {
+    for(int64_t idx=fBestIdx; idx>=0; idx=NextIdx(idx+1)) if(!f(fBase+idx,fQty[idx])) return;
+
+    for(typename std::map<int64_t, Q>::const_iterator it=fOverflow.begin(); it!=fOverflow.end(); ++it) if(!f(it->first,it->second)) return;
+  }
+
+  //Total quantity of the levels with keys up to key (included), in
+  //logarithmic time over the window for indexed ladders
+  Q QuantityTo(const int64_t& key) const
+  {
+    const int64_t last=key-fBase;
+    Q ret=Q();
+
+    if(last<0) return ret;
+
+    if(fTreeStep) {
+
+      for(size_t pos=(last<(int64_t)fCapacity?last+1:fCapacity); pos; pos&=pos-1) ret+=fQtyTree[pos];
+
+    } else for(int64_t idx=fBestIdx; idx>=0 && idx<=last; idx=NextIdx(idx+1)) ret+=fQty[idx];
+
+    if(last>=(int64_t)fCapacity) for(typename std::map<int64_t, Q>::const_iterator it=fOverflow.begin(); it!=fOverflow.end() && it->first<=key; ++it) ret+=it->second;
+    return ret;
+  }
+
+  //Walks quantity from the best level outwards. Returns false if the
+  //ladder does not hold enough quantity. Otherwise lastkey is the key of
+  //the last level reached and amount is the total |key| x quantity.
+  bool FillQuantity(const Q& quantity, int64_t* lastkey, Q* amount) const
+  {
+    if(!(quantity>Q())) return false;
+    Q rem=quantity;
+    Q acc=Q();
+    size_t pos=0;
+
+    if(fTreeStep) {
+
+      //Descend to the last level whose inclusive prefix is below quantity
+      for(size_t step=fTreeStep; step; step>>=1) {
+
+	if(pos+step<=fCapacity && fQtyTree[pos+step]<rem) {
+	  pos+=step;
+	  rem-=fQtyTree[pos];
+	  acc+=fAmountTree[pos];
+	}
+      }
+
+      if(pos<fCapacity) {
+	*lastkey=fBase+(int64_t)pos;
+	*amount=acc+KeyAbs(*lastkey)*rem;
+	return true;
+      }
+
+    } else {
+      //Plain ladders are walked level by level
+      for(int64_t idx=fBestIdx; idx>=0; idx=NextIdx(idx+1)) {
+
+	if(fQty[idx]>=rem) {
+	  *lastkey=fBase+idx;
+	  *amount=acc+KeyAbs(*lastkey)*rem;
+	  return true;
+	}
+	rem-=fQty[idx];
+	acc+=KeyAbs(fBase+idx)*fQty[idx];
+      }
+    }
+
+    for(typename std::map<int64_t, Q>::const_iterator it=fOverflow.begin(); it!=fOverflow.end(); ++it) {
+
+      if(it->second>=rem) {
+	*lastkey=it->first;
+	*amount=acc+KeyAbs(it->first)*rem;
+	return true;
+      }
+      rem-=it->second;
+      acc+=KeyAbs(it->first)*it->second;
+    }
+    return false;
+  }
+
+  //Walks amount (|key| x quantity) from the best level outwards. Returns
+  //false if the ladder does not hold enough. Otherwise lastkey is the key
+  //of the last level reached and quantity the total quantity filled
+  //(truncated for integer quantities).
+  bool FillAmount(const Q& amount, int64_t* lastkey, Q* quantity) const
+  {
+    if(!(amount>Q())) return false;
+    Q rem=amount;
+    Q acc=Q();
+    size_t pos=0;
+
+    if(fTreeStep) {
+
+      for(size_t step=fTreeStep; step; step>>=1) {
+
+	if(pos+step<=fCapacity && fAmountTree[pos+step]<rem) {
+	  pos+=step;
+	  rem-=fAmountTree[pos];
+	  acc+=fQtyTree[pos];
+	}
+      }
+
+      if(pos<fCapacity) {
+	*lastkey=fBase+(int64_t)pos;
+	*quantity=acc+rem/KeyAbs(*lastkey);
+	return true;
+      }
+
+    } else {
+
+      for(int64_t idx=fBestIdx; idx>=0; idx=NextIdx(idx+1)) {
+	const Q lamount=KeyAbs(fBase+idx)*fQty[idx];
+
+	if(lamount>=rem) {
+	  *lastkey=fBase+idx;
+	  *quantity=acc+rem/KeyAbs(*lastkey);
+	  return true;
+	}
+	rem-=lamount;
+	acc+=fQty[idx];
+      }
+    }
+
+    for(typename std::map<int64_t, Q>::const_iterator it=fOverflow.begin(); it!=fOverflow.end(); ++it) {
+      const Q lamount=KeyAbs(it->first)*it->second;
+
+      if(lamount>=rem) {
+	*lastkey=it->first;
+	*quantity=acc+rem/KeyAbs(it->first);
+	return true;
+      }
+      rem-=lamount;
+      acc+=it->second;
+    }
+    return false;
+  }
+
+  protected:
+  static inline Q KeyAbs(const int64_t& key){return (Q)(key<0?-key:key);}
+
+  inline void TreeAdd(const int64_t& idx, const Q& dqty)
+  {
+    const Q damount=KeyAbs(fBase+idx)*dqty;
+
+    for(size_t pos=idx+1; pos<=fCapacity; pos+=pos&(~pos+1)) {
+      fQtyTree[pos]+=dqty;
+      fAmountTree[pos]+=damount;
+    }
+  }
+
+  void TreeRebuild()
+  {
+    for(size_t pos=1; pos<=fCapacity; ++pos) {
+      fQtyTree[pos]=fQty[pos-1];
+      fAmountTree[pos]=KeyAbs(fBase+(int64_t)pos-1)*fQty[pos-1];
+    }
+
+    for(size_t pos=1; pos<=fCapacity; ++pos) {
+      const size_t parent=pos+(pos&(~pos+1));
+
+      if(parent<=fCapacity) {
+	fQtyTree[parent]+=fQtyTree[pos];
+	fAmountTree[parent]+=fAmountTree[pos];
+      }
+    }
+  }
+
+  inline int64_t NextIdx(int64_t idx) const
+  {
+    if(idx>=(int64_t)fCapacity) return -1;
+    size_t w=idx>>6;
+    uint64_t bits=fBits[w]&(~(uint64_t)0<<(idx&63));
+    const size_t nw=fBits.size();
+
+    while(!bits) {
+
+      if(++w==nw) return -1;
+      bits=fBits[w];
+    }
+    return (int64_t)(w<<6)+__builtin_ctzll(bits);
+  }
+
+  void Rebase(const int64_t& newbase)
+  {
+    const int64_t shift=newbase-fBase;
+
+    if(!shift) return;
+
+    if(shift<0) {
+      //Window moves towards better prices: spill the far end into the overflow
+      for(int64_t idx=NextIdx((int64_t)fCapacity+shift>0?(int64_t)fCapacity+shift:0); idx>=0; idx=NextIdx(idx+1)) {
+	fOverflow[fBase+idx]=fQty[idx];
+	fQty[idx]=Q();
+	--fWinCount;
+      }
+
+      if(-shift<(int64_t)fCapacity) memmove(fQty.data()-shift,fQty.data(),(fCapacity+shift)*sizeof(Q));
+      std::fill(fQty.begin(),fQty.begin()+(-shift<(int64_t)fCapacity?-shift:(int64_t)fCapacity),Q());
+
+    } else {
+      //Window moves towards worse prices: levels in front of the new base
+      //cannot exist since rebasing never goes past the best level
+      if(shift<(int64_t)fCapacity) {
+	memmove(fQty.data(),fQty.data()+shift,(fCapacity-shift)*sizeof(Q));
+	std::fill(fQty.end()-shift,fQty.end(),Q());
+
+      } else std::fill(fQty.begin(),fQty.end(),Q());
+    }
+    fBase=newbase;
+
+    //Pull overflow levels that now fit in the window
+    const int64_t end=fBase+(int64_t)fCapacity;
+    typename std::map<int64_t, Q>::iterator it;
+
+    for(it=fOverflow.begin(); it!=fOverflow.end() && it->first<end; ++it) {
+      fQty[it->first-fBase]=it->second;
+      ++fWinCount;
+    }
+    fOverflow.erase(fOverflow.begin(),it);
+
+    //Rebuild the occupancy bitmap
+    memset(fBits.data(),0,fBits.size()*sizeof(uint64_t));
+
+    for(size_t idx=0; idx<fCapacity; ++idx) if(fQty[idx]) fBits[idx>>6]|=((uint64_t)1<<(idx&63));
+    fBestIdx=NextIdx(0);
+
+    if(fTreeStep) TreeRebuild();
+  }
+
+  std::vector<Q> fQty;
+  std::vector<uint64_t> fBits;
+  std::vector<Q> fQtyTree;
+  std::vector<Q> fAmountTree;
+  std::map<int64_t, Q> fOverflow;
+  int64_t fBase;
+  size_t fCapacity;
+  size_t fMargin;
+  size_t fTreeStep; //Highest power of two not above fCapacity, 0 if not indexed
+  int64_t fBestIdx;
+  size_t fWinCount;
+  private:
+};
+
+#endif
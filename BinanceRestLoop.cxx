@@ -0,0 +1,308 @@
+#include "BinanceRestLoop.h"
+
+#include <future>
+
+BinanceRestLoop::BinanceRestLoop(WebSocketManager* manager): fIO(manager->GetIOService()), fTimer(fIO), fMulti(NULL), fJSTok(NULL), fSockets(), fActive(), fQueue(std::make_shared<restqueue>(this)), fFree(), fRunning(0)
+{
+  Init();
+}
+
+BinanceRestLoop::BinanceRestLoop(websocketpp::lib::asio::io_service& io): fIO(io), fTimer(fIO), fMulti(NULL), fJSTok(NULL), fSockets(), fActive(), fQueue(std::make_shared<restqueue>(this)), fFree(), fRunning(0)
+{
+  Init();
+}
+
+void BinanceRestLoop::Init()
+{
+  //Initialises curl before the multi handle is created
+  BinanceRestTransport::Instance();
+  fMulti=curl_multi_init();
+  fJSTok=json_tokener_new();
+
+  if(!fMulti || !fJSTok) {
+    fprintf(stderr,"%s: Error: Could not create the curl multi handle!\n",__func__);
+    throw 0;
+  }
+  curl_multi_setopt(fMulti, CURLMOPT_SOCKETFUNCTION, SocketCB);
+  curl_multi_setopt(fMulti, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(fMulti, CURLMOPT_TIMERFUNCTION, TimerCB);
+  curl_multi_setopt(fMulti, CURLMOPT_TIMERDATA, this);
+  curl_multi_setopt(fMulti, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+}
+
+BinanceRestLoop::~BinanceRestLoop()
+{
+  //The loop is only modified from the io_service thread, unless the
+  //io_service has stopped. It must be destroyed while the io_service runs
+  //or once it has stopped.
+  if(fIO.stopped() || fIO.get_executor().running_in_this_thread()) Shutdown();
+
+  else {
+    std::promise<void> done;
+    std::future<void> future=done.get_future();
+    fIO.post([this, &done]{Shutdown(); done.set_value();});
+    future.wait();
+  }
+  curl_multi_cleanup(fMulti);
+
+  for(int i=0; i<BIN_EP_NTYPES; ++i) for(size_t j=0; j<fFree[i].size(); ++j) curl_easy_cleanup(fFree[i][j]);
+  json_tokener_free(fJSTok);
+}
+
+void BinanceRestLoop::Submit(restrequest* request)
+{
+  std::shared_ptr<restqueue> queue=fQueue;
+  pthread_mutex_lock(&queue->mutex);
+
+  if(!queue->loop) {
+    pthread_mutex_unlock(&queue->mutex);
+    Complete(request, false, 0);
+    return;
+  }
+  queue->requests.push_back(request);
+  pthread_mutex_unlock(&queue->mutex);
+  //The handler only holds the queue, and finds it drained once the loop
+  //has shut down
+  fIO.post([queue]{StartQueued(queue);});
+}
+
+void BinanceRestLoop::StartQueued(const std::shared_ptr<restqueue>& queue)
+{
+  pthread_mutex_lock(&queue->mutex);
+
+  if(!queue->loop || queue->requests.empty()) {
+    pthread_mutex_unlock(&queue->mutex);
+    return;
+  }
+  BinanceRestLoop* loop=queue->loop;
+  restrequest* request=queue->requests.front();
+  queue->requests.pop_front();
+  pthread_mutex_unlock(&queue->mutex);
+  loop->Start(request);
+}
+
+void BinanceRestLoop::Start(restrequest* request)
+{
+  std::vector<CURL*>& handles=fFree[request->type];
+  CURL* handle;
+
+  //A recycled handle keeps the options of its verb, its connections and
+  //its caches
+  if(handles.empty()) {
+    handle=curl_easy_init();
+
+    if(!handle) {
+      fprintf(stderr,"%s: Error: Could not create a curl handle!\n",__func__);
+      Complete(request, false, 0);
+      return;
+    }
+    BinanceRestTransport::Instance().Setup(handle);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, 10L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCB);
+
+    switch(request->type) {
+      case bieneptype_get:
+	break;
+
+      case bieneptype_post:
+	curl_easy_setopt(handle, CURLOPT_POST, 1L);
+	break;
+
+      case bieneptype_put:
+	curl_easy_setopt(handle, CURLOPT_UPLOAD, 1L);
+	curl_easy_setopt(handle, CURLOPT_INFILESIZE, 0L);
+	break;
+
+      case bieneptype_delete:
+	curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "DELETE");
+    }
+
+  } else {
+    handle=handles.back();
+    handles.pop_back();
+  }
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, request);
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request->headers);
+  curl_easy_setopt(handle, CURLOPT_URL, request->url.c_str());
+
+  if(request->type==bieneptype_post) {
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request->fields.c_str());
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)request->fields.size());
+  }
+
+  if(curl_multi_add_handle(fMulti, handle)!=CURLM_OK) {
+    fprintf(stderr,"%s: Error: Could not add the request to the multi handle!\n",__func__);
+    handles.push_back(handle);
+    Complete(request, false, 0);
+    return;
+  }
+  fActive[handle]=request;
+}
+
+int BinanceRestLoop::SocketCB(CURL* handle, curl_socket_t fd, int what, void* userp, void* socketp)
+{
+  BinanceRestLoop& brl=*(BinanceRestLoop*)userp;
+  std::map<curl_socket_t, std::shared_ptr<restsocket> >::iterator it=brl.fSockets.find(fd);
+
+  if(what==CURL_POLL_REMOVE) {
+
+    if(it!=brl.fSockets.end()) {
+      //The descriptor is closed by curl, not by asio
+      boost::system::error_code ec;
+      it->second->removed=true;
+      it->second->descriptor.cancel(ec);
+      it->second->descriptor.release();
+      brl.fSockets.erase(it);
+    }
+    return 0;
+  }
+
+  if(it==brl.fSockets.end()) {
+    boost::system::error_code ec;
+    std::shared_ptr<restsocket> socket=std::make_shared<restsocket>(brl.fIO);
+    socket->descriptor.assign(fd, ec);
+
+    if(ec) {
+      fprintf(stderr,"%s: Error: Could not watch socket %i: %s\n",__func__,(int)fd,ec.message().c_str());
+      return -1;
+    }
+    it=brl.fSockets.insert(std::make_pair(fd, socket)).first;
+  }
+  it->second->what=what;
+  brl.Watch(it->second, fd);
+  return 0;
+}
+
+void BinanceRestLoop::Watch(const std::shared_ptr<restsocket>& socket, const curl_socket_t& fd)
+{
+  //A wait stays armed until its event occurs, and is rearmed as long as
+  //curl asks for the event
+  if((socket->what&CURL_POLL_IN) && !socket->reading) {
+    socket->reading=true;
+    socket->descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_read, [this, socket, fd](const boost::system::error_code& ec){
+	socket->reading=false;
+
+	if(ec || socket->removed) return;
+	Action(fd, CURL_CSELECT_IN);
+
+	if(!socket->removed) Watch(socket, fd);
+	});
+  }
+
+  if((socket->what&CURL_POLL_OUT) && !socket->writing) {
+    socket->writing=true;
+    socket->descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_write, [this, socket, fd](const boost::system::error_code& ec){
+	socket->writing=false;
+
+	if(ec || socket->removed) return;
+	Action(fd, CURL_CSELECT_OUT);
+
+	if(!socket->removed) Watch(socket, fd);
+	});
+  }
+}
+
+int BinanceRestLoop::TimerCB(CURLM* multi, long timeout, void* userp)
+{
+  BinanceRestLoop& brl=*(BinanceRestLoop*)userp;
+  brl.fTimer.cancel();
+
+  //-1 deletes the timer. A timeout of 0 is still handled from the loop,
+  //since curl_multi_socket_action cannot be called from this callback.
+  if(timeout>=0) {
+    brl.fTimer.expires_after(std::chrono::milliseconds(timeout));
+    brl.fTimer.async_wait([&brl](const boost::system::error_code& ec){
+
+	if(!ec) brl.Action(CURL_SOCKET_TIMEOUT, 0);
+	});
+  }
+  return 0;
+}
+
+void BinanceRestLoop::Action(const curl_socket_t& fd, const int& events)
+{
+  curl_multi_socket_action(fMulti, fd, events, &fRunning);
+  CheckDone();
+
+  if(fRunning<=0) fTimer.cancel();
+}
+
+void BinanceRestLoop::CheckDone()
+{
+  CURLMsg* msg;
+  int nmsgs;
+
+  while((msg=curl_multi_info_read(fMulti, &nmsgs))) {
+
+    if(msg->msg!=CURLMSG_DONE) continue;
+    CURL* handle=msg->easy_handle;
+    const CURLcode res=msg->data.result;
+    std::map<CURL*, restrequest*>::iterator it=fActive.find(handle);
+    long code=0;
+
+    if(res==CURLE_OK) curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
+    curl_multi_remove_handle(fMulti, handle);
+
+    if(it==fActive.end()) {
+      curl_easy_cleanup(handle);
+      continue;
+    }
+    restrequest* request=it->second;
+    fActive.erase(it);
+    fFree[request->type].push_back(handle);
+
+    if(res!=CURLE_OK) fprintf(stderr,"%s: Error: Request to %s failed: %s\n",__func__,request->url.c_str(),curl_easy_strerror(res));
+    Complete(request, res==CURLE_OK, code);
+  }
+}
+
+void BinanceRestLoop::Complete(restrequest* request, const bool& ok, const long& httpcode)
+{
+  binresponse response={-1, httpcode, NULL};
+
+  if(ok) {
+    json_tokener_reset(fJSTok);
+    response.jobj=json_tokener_parse_ex(fJSTok, request->reply.data(), request->reply.size());
+    response.status=(response.jobj && json_tokener_get_error(fJSTok)==json_tokener_success?0:-2);
+  }
+
+  if(request->callback) request->callback(response, request->userdata);
+
+  if(response.jobj) json_object_put(response.jobj);
+  delete request;
+}
+
+size_t BinanceRestLoop::WriteCB(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+  ((restrequest*)userdata)->reply.append(ptr, size*nmemb);
+  return size*nmemb;
+}
+
+void BinanceRestLoop::Shutdown()
+{
+  boost::system::error_code ec;
+  std::deque<restrequest*> queued;
+  pthread_mutex_lock(&fQueue->mutex);
+  fQueue->loop=NULL;
+  queued.swap(fQueue->requests);
+  pthread_mutex_unlock(&fQueue->mutex);
+  fTimer.cancel();
+
+  for(std::map<curl_socket_t, std::shared_ptr<restsocket> >::iterator it=fSockets.begin(); it!=fSockets.end(); ++it) {
+    it->second->removed=true;
+    it->second->descriptor.cancel(ec);
+    it->second->descriptor.release();
+  }
+  fSockets.clear();
+  std::map<CURL*, restrequest*> active;
+  active.swap(fActive);
+
+  for(std::map<CURL*, restrequest*>::iterator it=active.begin(); it!=active.end(); ++it) {
+    curl_multi_remove_handle(fMulti, it->first);
+    fFree[it->second->type].push_back(it->first);
+    Complete(it->second, false, 0);
+  }
+
+  for(size_t i=0; i<queued.size(); ++i) Complete(queued[i], false, 0);
+}
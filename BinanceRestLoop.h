@@ -0,0 +1,125 @@
+#ifndef _BINANCERESTLOOP_
+#define _BINANCERESTLOOP_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+
+#include <pthread.h>
+
+#include <curl/curl.h>
+#include <json-c/json.h>
+
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "binance_base.h"
+#include "BinanceRestTransport.h"
+#include "WebSocketManager.h"
+
+//Result of an asynchronous request. status is 0 if a JSON reply was
+//received (whatever its HTTP code, Binance errors being JSON objects with
+//a code and a msg), -1 if the request failed or was cancelled and -2 if
+//the reply is not valid JSON.
+struct binresponse
+{
+  int status;
+  long httpcode;
+  json_object* jobj;
+};
+
+//jobj is released once the callback returns, unless the callback takes a
+//reference with json_object_get
+typedef void (*binrestcallback)(const binresponse& response, void* userdata);
+
+//Request fully built by the calling thread (URL, body and signature), and
+//performed by the loop
+struct restrequest
+{
+  std::string url;
+  std::string fields; //Body of POST requests
+  bineptype type;
+  curl_slist* headers;
+  binrestcallback callback;
+  void* userdata;
+  std::string reply;
+};
+
+//Performs requests concurrently through a curl multi handle driven by an
+//asio io_service, normally the one running WebSocketManager's sockets, so
+//no thread is added. The easy handles are recycled per HTTP verb and
+//attached to BinanceRestTransport, so the requests reuse the connections of
+//the multi handle and the shared DNS entries and TLS sessions, and are
+//multiplexed over a single connection per host when HTTP/2 is enabled on
+//the transport. Callbacks run on the io_service thread, which they must
+//not block.
+class BinanceRestLoop
+{
+  public:
+  BinanceRestLoop(WebSocketManager* manager);
+  BinanceRestLoop(websocketpp::lib::asio::io_service& io);
+  //Pending requests complete with a status of -1, including those
+  //submitted while the io_service was stopped
+  ~BinanceRestLoop();
+
+  //Takes ownership of the request. Can be called from any thread. The
+  //request completes with a status of -1 if the loop has shut down.
+  void Submit(restrequest* request);
+
+  protected:
+  //Submitted requests waiting for the io_service thread. Shared with the
+  //posted handlers, which may run after the loop is destroyed if the
+  //io_service is restarted.
+  struct restqueue
+  {
+    restqueue(BinanceRestLoop* l): mutex(), requests(), loop(l) {pthread_mutex_init(&mutex,NULL);}
+    ~restqueue(){pthread_mutex_destroy(&mutex);}
+    pthread_mutex_t mutex;
+    std::deque<restrequest*> requests;
+    BinanceRestLoop* loop; //NULL once the loop has shut down
+  };
+
+  struct restsocket
+  {
+    restsocket(websocketpp::lib::asio::io_service& io): descriptor(io), what(0), reading(false), writing(false), removed(false) {}
+    boost::asio::posix::stream_descriptor descriptor;
+    int what; //CURL_POLL_* events curl waits for
+    bool reading;
+    bool writing;
+    bool removed;
+  };
+
+  void Init();
+
+  //These functions are only called from the io_service thread
+  void Start(restrequest* request);
+  void Watch(const std::shared_ptr<restsocket>& socket, const curl_socket_t& fd);
+  void Action(const curl_socket_t& fd, const int& events);
+  void CheckDone();
+  void Complete(restrequest* request, const bool& ok, const long& httpcode);
+  void Shutdown();
+
+  static void StartQueued(const std::shared_ptr<restqueue>& queue);
+  static int SocketCB(CURL* handle, curl_socket_t fd, int what, void* userp, void* socketp);
+  static int TimerCB(CURLM* multi, long timeout, void* userp);
+  static size_t WriteCB(char* ptr, size_t size, size_t nmemb, void* userdata);
+
+  websocketpp::lib::asio::io_service& fIO;
+  boost::asio::steady_timer fTimer;
+  CURLM* fMulti;
+  json_tokener* fJSTok;
+  std::map<curl_socket_t, std::shared_ptr<restsocket> > fSockets;
+  std::map<CURL*, restrequest*> fActive;
+  std::shared_ptr<restqueue> fQueue;
+  std::vector<CURL*> fFree[BIN_EP_NTYPES]; //Recycled easy handles, configured for each HTTP verb
+  int fRunning;
+  private:
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "BinanceRestTransport.h"
+
+BinanceRestTransport& BinanceRestTransport::Instance()
+{
+  //Constructed on first use, which is thread-safe
+  static BinanceRestTransport transport;
+  return transport;
+}
+
+BinanceRestTransport::BinanceRestTransport(): fShare(NULL), fLocks(), fPingURIs(), fPingHandles(), fPinging(), fMutex(), fCond(), fPingCond(), fThread(), fInterval(0), fThreadRunning(false), fHTTP2(false)
+{
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  pthread_mutex_init(&fMutex,NULL);
+  pthread_cond_init(&fCond,NULL);
+  pthread_cond_init(&fPingCond,NULL);
+
+  for(int i=0; i<CURL_LOCK_DATA_LAST; ++i) pthread_mutex_init(fLocks+i,NULL);
+  fShare=curl_share_init();
+
+  if(!fShare) {
+    fprintf(stderr,"%s: Error: Could not create the curl share handle!\n",__func__);
+    throw 0;
+  }
+  curl_share_setopt(fShare, CURLSHOPT_LOCKFUNC, LockCB);
+  curl_share_setopt(fShare, CURLSHOPT_UNLOCKFUNC, UnlockCB);
+  curl_share_setopt(fShare, CURLSHOPT_USERDATA, this);
+  curl_share_setopt(fShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  //The connection cache is not shared, as curl does not support using it
+  //from several threads at once
+  curl_share_setopt(fShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+BinanceRestTransport::~BinanceRestTransport()
+{
+  KeepWarm(0);
+
+  for(size_t i=0; i<fPingHandles.size(); ++i) curl_easy_cleanup(fPingHandles[i]);
+
+  //Handles still attached at exit keep the share handle and its locks
+  if(curl_share_cleanup(fShare)!=CURLSHE_OK) return;
+
+  for(int i=0; i<CURL_LOCK_DATA_LAST; ++i) pthread_mutex_destroy(fLocks+i);
+  pthread_cond_destroy(&fCond);
+  pthread_cond_destroy(&fPingCond);
+  pthread_mutex_destroy(&fMutex);
+}
+
+void BinanceRestTransport::LockCB(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+  pthread_mutex_lock(((BinanceRestTransport*)userptr)->fLocks+data);
+}
+
+void BinanceRestTransport::UnlockCB(CURL* handle, curl_lock_data data, void* userptr)
+{
+  pthread_mutex_unlock(((BinanceRestTransport*)userptr)->fLocks+data);
+}
+
+void BinanceRestTransport::Setup(CURL* handle)
+{
+  pthread_mutex_lock(&fMutex);
+  const bool http2=fHTTP2;
+  pthread_mutex_unlock(&fMutex);
+  curl_easy_setopt(handle, CURLOPT_SHARE, fShare);
+  curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, BIN_REST_DNS_TIMEOUT);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(handle, CURLOPT_TCP_NODELAY, 1L);
+
+  if(http2) {
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    //Waits for a connection able to multiplex rather than opening another
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+
+  } else curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+}
+
+int BinanceRestTransport::Prewarm(const bintype& btype)
+{
+  //The alternative spot API has no ping endpoint, but the same host
+  const std::string uri=(btype==bin_spot_alt?bin_spot.ep:btype.ep)+"ping";
+  size_t host;
+  int ret;
+  pthread_mutex_lock(&fMutex);
+
+  for(host=0; host<fPingURIs.size(); ++host) if(fPingURIs[host]==uri) break;
+
+  if(host==fPingURIs.size()) {
+    pthread_mutex_unlock(&fMutex);
+    CURL* handle=curl_easy_init();
+
+    if(!handle) {
+      fprintf(stderr,"%s: Error: Could not create a curl handle!\n",__func__);
+      return -1;
+    }
+    Setup(handle);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, 10L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, DiscardCB);
+    curl_easy_setopt(handle, CURLOPT_URL, uri.c_str());
+    pthread_mutex_lock(&fMutex);
+
+    //Another thread may have added the host in the meantime
+    for(host=0; host<fPingURIs.size(); ++host) if(fPingURIs[host]==uri) break;
+
+    if(host==fPingURIs.size()) {
+      fPingURIs.push_back(uri);
+      fPingHandles.push_back(handle);
+      fPinging.push_back(false);
+
+    } else curl_easy_cleanup(handle);
+  }
+  ret=Ping(host);
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+int BinanceRestTransport::PrewarmAll()
+{
+  return (Prewarm(bin_spot)!=0)+(Prewarm(bin_usdm_future)!=0)+(Prewarm(bin_coinm_future)!=0);
+}
+
+int BinanceRestTransport::Ping(const size_t& host)
+{
+  //fMutex must be locked before calling this function! It is released
+  //during the request, so that a slow host does not hold up Setup and the
+  //other hosts. A handle is only used by one thread at a time.
+  long code=0;
+
+  while(fPinging[host]) pthread_cond_wait(&fPingCond, &fMutex);
+  fPinging[host]=true;
+  CURL* handle=fPingHandles[host];
+  const std::string uri=fPingURIs[host];
+  pthread_mutex_unlock(&fMutex);
+  const CURLcode res=curl_easy_perform(handle);
+
+  if(res==CURLE_OK) curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
+  pthread_mutex_lock(&fMutex);
+  fPinging[host]=false;
+  pthread_cond_broadcast(&fPingCond);
+
+  if(res!=CURLE_OK || code!=200) {
+    fprintf(stderr,"%s: Error: Could not reach %s (%s, HTTP code %li)!\n",__func__,uri.c_str(),curl_easy_strerror(res),code);
+    return -1;
+  }
+  return 0;
+}
+
+int BinanceRestTransport::KeepWarm(const int& interval)
+{
+  pthread_mutex_lock(&fMutex);
+  fInterval=(interval>0?interval:0);
+
+  if(fThreadRunning) {
+    pthread_cond_broadcast(&fCond);
+
+    if(fInterval) {
+      pthread_mutex_unlock(&fMutex);
+      return 0;
+    }
+    //Cleared before joining, so that concurrent calls do not join the
+    //thread twice
+    const pthread_t thread=fThread;
+    fThreadRunning=false;
+    pthread_mutex_unlock(&fMutex);
+    pthread_join(thread, NULL);
+    return 0;
+  }
+
+  if(fInterval) {
+
+    if(pthread_create(&fThread, NULL, KeepWarmThread, this)) {
+      fprintf(stderr,"%s: Error: Could not start the keep-warm thread!\n",__func__);
+      fInterval=0;
+      pthread_mutex_unlock(&fMutex);
+      return -1;
+    }
+    fThreadRunning=true;
+  }
+  pthread_mutex_unlock(&fMutex);
+  return 0;
+}
+
+void* BinanceRestTransport::KeepWarmThread(void* instance)
+{
+  BinanceRestTransport& brt=*(BinanceRestTransport*)instance;
+  struct timespec timeout;
+  pthread_mutex_lock(&brt.fMutex);
+
+  //A thread being joined exits even if a later call has started another
+  while(brt.fInterval && brt.fThreadRunning && pthread_equal(brt.fThread, pthread_self())) {
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_sec+=brt.fInterval;
+
+    //Woken up early when the interval is changed
+    if(pthread_cond_timedwait(&brt.fCond, &brt.fMutex, &timeout)!=ETIMEDOUT) continue;
+
+    for(size_t i=0; i<brt.fPingURIs.size(); ++i) brt.Ping(i);
+  }
+  pthread_mutex_unlock(&brt.fMutex);
+  return NULL;
+}
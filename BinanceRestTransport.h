@@ -0,0 +1,90 @@
+#ifndef _BINANCERESTTRANSPORT_
+#define _BINANCERESTTRANSPORT_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <time.h>
+
+#include <curl/curl.h>
+
+#include "binance_base.h"
+
+//Lifetime of the shared DNS entries, in seconds
+#ifndef BIN_REST_DNS_TIMEOUT
+#define BIN_REST_DNS_TIMEOUT 300L
+#endif
+
+//Process-wide REST transport. The curl handles of all the endpoints and
+//books are attached to a single share handle, so they reuse each other's
+//DNS entries and TLS sessions instead of each paying its own lookup and
+//full handshake to the same hosts. Connections are not shared, as curl's
+//shared connection cache is not safe to use from several threads: each
+//handle keeps its own. The hosts of the base URIs can be resolved and
+//handshaken with ahead of the first request, and kept fresh by a
+//background thread.
+class BinanceRestTransport
+{
+  public:
+  static BinanceRestTransport& Instance();
+
+  //Attaches a new easy handle to the shared caches and applies the
+  //transport options. Called by BinanceEndpoint and BinanceOrderBook.
+  void Setup(CURL* handle);
+
+  //Negotiates HTTP/2 over TLS for the handles set up afterwards, falling
+  //back to HTTP/1.1 if the server does not offer it. Requests are only
+  //multiplexed over a single connection when performed concurrently
+  //through a multi handle.
+  inline void SetHTTP2(const bool& http2){pthread_mutex_lock(&fMutex); fHTTP2=http2; pthread_mutex_unlock(&fMutex);}
+
+  //Pings the host of btype's REST base URI, so the next requests to that
+  //host find its DNS entry and resume its TLS session. Returns 0 on
+  //success.
+  int Prewarm(const bintype& btype);
+
+  //Same for the spot, USD-M and COIN-M hosts. Returns the number of hosts
+  //that could not be reached.
+  int PrewarmAll();
+
+  //Pings the prewarmed hosts every interval seconds, so their shared DNS
+  //entries and TLS sessions are renewed before they expire. An interval
+  //<=0 stops the thread.
+  int KeepWarm(const int& interval);
+
+  protected:
+  BinanceRestTransport();
+  ~BinanceRestTransport();
+
+  static void LockCB(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+  static void UnlockCB(CURL* handle, curl_lock_data data, void* userptr);
+  static size_t DiscardCB(char* ptr, size_t size, size_t nmemb, void* userdata){return size*nmemb;}
+  static void* KeepWarmThread(void* instance);
+  //fMutex must be locked before calling this function! It is released
+  //during the request.
+  int Ping(const size_t& host);
+
+  CURLSH* fShare;
+  pthread_mutex_t fLocks[CURL_LOCK_DATA_LAST];
+  std::vector<std::string> fPingURIs; //Ping endpoints of the prewarmed hosts
+  std::vector<CURL*> fPingHandles;
+  std::vector<char> fPinging; //Whether a request is in progress on the ping handle
+  pthread_mutex_t fMutex;
+  pthread_cond_t fCond;
+  pthread_cond_t fPingCond; //Signalled when a ping completes
+  pthread_t fThread;
+  int fInterval;
+  bool fThreadRunning;
+  bool fHTTP2;
+  private:
+  BinanceRestTransport(const BinanceRestTransport&);
+  BinanceRestTransport& operator=(const BinanceRestTransport&);
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "BinanceSharedBook.h"
+
+#include "BinanceOrderBook.h"
+
+BinanceSharedBookPublisher::BinanceSharedBookPublisher(const char* name, const uint32_t& capacity): fData(NULL), fSize(SHAREDBOOK_HEADER_SIZE+(size_t)capacity*SHAREDBOOK_SLOT_SIZE), fHeader(NULL), fBooks(capacity), fName(name[0]=='/'?"":"/"), fMutex()
+{
+  fName+=name;
+  //A previous segment may still be mapped by readers, which keep it alive
+  //and see it closed, while this one gets a new inode
+  shm_unlink(fName.c_str());
+  const int fd=shm_open(fName.c_str(), O_CREAT|O_EXCL|O_RDWR, 0644);
+
+  if(fd<0 || ftruncate(fd, fSize)) {
+    fprintf(stderr,"%s: Error: Could not create shared memory segment %s!\n",__func__,fName.c_str());
+
+    if(fd>=0) {
+      close(fd);
+      shm_unlink(fName.c_str());
+    }
+    throw 0;
+  }
+  void* data=mmap(NULL, fSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(data==MAP_FAILED) {
+    fprintf(stderr,"%s: Error: Could not map %s!\n",__func__,fName.c_str());
+    shm_unlink(fName.c_str());
+    throw 0;
+  }
+  pthread_mutex_init(&fMutex,NULL);
+  fData=(char*)data;
+  //The pages are zero-filled, so the slots are already empty seqlocks
+  fHeader=(sharedbookheader*)fData;
+  fHeader->version=SHAREDBOOK_VERSION;
+  fHeader->capacity=capacity;
+  fHeader->slotsize=SHAREDBOOK_SLOT_SIZE;
+  fHeader->levels=BOOKVIEW_LEVELS;
+  fHeader->pid=getpid();
+  //Readers validate the magic last
+  std::atomic_thread_fence(std::memory_order_release);
+  fHeader->magic=SHAREDBOOK_MAGIC;
+}
+
+BinanceSharedBookPublisher::~BinanceSharedBookPublisher()
+{
+  for(size_t i=0; i<fBooks.size(); ++i) if(fBooks[i]) RemoveBook(i);
+  fHeader->closed.store(1, std::memory_order_release);
+  //In-process readers may have loaded a slot before its book was removed,
+  //and must have returned by now (see BinanceSharedBook.h)
+  munmap(fData, fSize);
+  shm_unlink(fName.c_str());
+  pthread_mutex_destroy(&fMutex);
+}
+
+int BinanceSharedBookPublisher::AddBook(BinanceOrderBook* book, const char* name)
+{
+  pthread_mutex_lock(&fMutex);
+  const uint32_t n=fHeader->nslots.load(std::memory_order_relaxed);
+  uint32_t id;
+
+  for(id=0; id<n; ++id) if(!fBooks[id] && !strncmp(Slot(id).name, name, SHAREDBOOK_NAME_LENGTH)) break;
+
+  if(id==n) {
+
+    if(n==fHeader->capacity) {
+      fprintf(stderr,"%s: Error: Shared memory segment %s is full!\n",__func__,fName.c_str());
+      pthread_mutex_unlock(&fMutex);
+      return -1;
+    }
+    strncpy(Slot(id).name, name, SHAREDBOOK_NAME_LENGTH-1);
+  }
+  sharedbookslot& slot=Slot(id);
+  fBooks[id]=book;
+  pthread_mutex_lock(&book->fOBMutex);
+  slot.type=book->fType;
+  book->fViewSlot.store(&slot.view, std::memory_order_release);
+  book->PublishView();
+  pthread_mutex_unlock(&book->fOBMutex);
+  slot.active.store(1, std::memory_order_release);
+
+  if(id==n) fHeader->nslots.store(n+1, std::memory_order_release);
+  pthread_mutex_unlock(&fMutex);
+  return id;
+}
+
+int BinanceSharedBookPublisher::RemoveBook(const int& id)
+{
+  pthread_mutex_lock(&fMutex);
+
+  if(id<0 || (size_t)id>=fBooks.size() || !fBooks[id]) {
+    pthread_mutex_unlock(&fMutex);
+    return -1;
+  }
+  sharedbookslot& slot=Slot(id);
+  BinanceOrderBook& book=*fBooks[id];
+  pthread_mutex_lock(&book.fOBMutex);
+  book.fViewSlot.store(&book.fView, std::memory_order_release);
+  book.PublishView();
+  slot.active.store(0, std::memory_order_release);
+  slot.view.BeginWrite().updateid=0;
+  slot.view.EndWrite();
+  pthread_mutex_unlock(&book.fOBMutex);
+  fBooks[id]=NULL;
+  pthread_mutex_unlock(&fMutex);
+  return 0;
+}
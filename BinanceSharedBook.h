@@ -0,0 +1,197 @@
+#ifndef _BINANCESHAREDBOOK_
+#define _BINANCESHAREDBOOK_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "seqlock_utils.h"
+
+//Maximum number of levels per side in the published top-of-book view
+#ifndef BOOKVIEW_LEVELS
+#define BOOKVIEW_LEVELS 20
+#endif
+
+struct bookviewlevel
+{
+  double price;
+  double quantity;
+  double sum;
+};
+
+//Versioned top-of-book view, published after each applied update and
+//readable without locks through GetView
+struct bookview
+{
+  uint64_t updateid; //0 if the book is not valid
+  uint64_t eventtime;
+  uint32_t depth; //Sides with fewer levels than depth are complete
+  uint32_t nbids;
+  uint32_t nasks;
+  uint32_t stale; //Non-zero while the book is being resynchronised
+  bookviewlevel bids[BOOKVIEW_LEVELS];
+  bookviewlevel asks[BOOKVIEW_LEVELS];
+};
+
+//POSIX shared-memory segment holding the views of several books: a
+//sharedbookheader padded to a cache line, followed by capacity slots
+//aligned on cache lines. Each slot embeds the seqlock<bookview> the book
+//publishes into, so the feed process writes the view once and any number
+//of processes read it without locks or syscalls.
+#define SHAREDBOOK_MAGIC 0x4b4f4f4244524853ULL //"SHRDBOOK"
+#define SHAREDBOOK_VERSION 1
+#define SHAREDBOOK_NAME_LENGTH 48
+
+struct sharedbookheader
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t capacity; //Number of slots
+  uint32_t slotsize; //Stride between slots, checked by the readers
+  uint32_t levels; //BOOKVIEW_LEVELS of the publisher, checked by the readers
+  int32_t pid; //Publisher process
+  uint32_t reserved;
+  std::atomic<uint32_t> nslots; //Slots handed out so far
+  std::atomic<uint32_t> closed; //Set when the publisher is destroyed
+};
+
+struct sharedbookslot
+{
+  char name[SHAREDBOOK_NAME_LENGTH]; //Stream name, e.g. btcusdt@depth
+  int32_t type; //binance type of the book
+  std::atomic<uint32_t> active; //0 once the book has been removed
+  uint64_t reserved;
+  seqlock<bookview> view;
+};
+
+#define SHAREDBOOK_HEADER_SIZE ((sizeof(sharedbookheader)+63)&~(size_t)63)
+#define SHAREDBOOK_SLOT_SIZE ((sizeof(sharedbookslot)+63)&~(size_t)63)
+
+class BinanceOrderBook;
+
+//Feed side: creates the segment (replacing any previous one with the same
+//name) and redirects the view of the added books into it. Books must be
+//removed before being destroyed, and outlive the publisher otherwise.
+//In-process readers (GetView, GetViewBookAtSum, GetViewSides) may still be
+//copying from a slot when its book is removed, which is harmless while the
+//segment stays mapped, but the destructor unmaps it: no such reader may
+//be running when the publisher is destroyed, e.g. by joining the reader
+//threads first, or by replacing the publisher of the books and waiting for
+//the calls in progress to return before destroying it.
+class BinanceSharedBookPublisher
+{
+  public:
+  BinanceSharedBookPublisher(const char* name, const uint32_t& capacity);
+  //Removes the remaining books and unmaps the segment, see above
+  ~BinanceSharedBookPublisher();
+
+  //Returns the slot id, or -1 if the segment is full. A book added under
+  //the name of a removed one takes its slot back, so that the readers
+  //keep their ids.
+  int AddBook(BinanceOrderBook* book, const char* name);
+  int RemoveBook(const int& id);
+
+  inline const char* GetName() const {return fName.c_str();}
+
+  protected:
+  inline sharedbookslot& Slot(const uint32_t& id){return *(sharedbookslot*)(fData+SHAREDBOOK_HEADER_SIZE+id*SHAREDBOOK_SLOT_SIZE);}
+
+  char* fData;
+  size_t fSize;
+  sharedbookheader* fHeader;
+  std::vector<BinanceOrderBook*> fBooks;
+  std::string fName;
+  pthread_mutex_t fMutex;
+  private:
+};
+
+//Consumer side, header-only so that consumers only need this header and
+//-lrt. Attaches read-only to a segment created by a
+//BinanceSharedBookPublisher. A reader of a segment whose publisher is gone
+//(IsClosed) keeps the last views and should attach again.
+class BinanceSharedBookReader
+{
+  public:
+  BinanceSharedBookReader(const char* name): fData(NULL), fSize(0), fHeader(NULL)
+  {
+    std::string shmname(name[0]=='/'?"":"/");
+    shmname+=name;
+    struct stat st;
+    const int fd=shm_open(shmname.c_str(), O_RDONLY, 0);
+
+    if(fd<0 || fstat(fd, &st)) {
+      fprintf(stderr,"%s: Error: Could not open shared memory segment %s!\n",__func__,shmname.c_str());
+
+      if(fd>=0) close(fd);
+      throw 0;
+    }
+    fSize=st.st_size;
+
+    if(fSize<SHAREDBOOK_HEADER_SIZE) {
+      fprintf(stderr,"%s: Error: %s is not a shared book segment!\n",__func__,shmname.c_str());
+      close(fd);
+      throw 0;
+    }
+    void* data=mmap(NULL, fSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(data==MAP_FAILED) {
+      fprintf(stderr,"%s: Error: Could not map %s!\n",__func__,shmname.c_str());
+      throw 0;
+    }
+    fData=(const char*)data;
+    fHeader=(const sharedbookheader*)fData;
+
+    if(fHeader->magic!=SHAREDBOOK_MAGIC || fHeader->version!=SHAREDBOOK_VERSION || fHeader->slotsize!=SHAREDBOOK_SLOT_SIZE || fHeader->levels!=BOOKVIEW_LEVELS || fSize<SHAREDBOOK_HEADER_SIZE+(size_t)fHeader->capacity*SHAREDBOOK_SLOT_SIZE) {
+      fprintf(stderr,"%s: Error: %s has an unsupported layout!\n",__func__,shmname.c_str());
+      munmap((void*)fData, fSize);
+      throw 0;
+    }
+  }
+
+  ~BinanceSharedBookReader(){munmap((void*)fData, fSize);}
+
+  inline uint32_t GetNBooks() const {return fHeader->nslots.load(std::memory_order_acquire);}
+
+  //Returns the slot id of a published book, or -1
+  inline int Find(const char* name) const
+  {
+    const uint32_t n=GetNBooks();
+
+    for(uint32_t i=0; i<n; ++i) if(!strncmp(Slot(i).name, name, SHAREDBOOK_NAME_LENGTH)) return i;
+    return -1;
+  }
+
+  inline const char* GetName(const int& id) const {return Slot(id).name;}
+  inline bool IsActive(const int& id) const {return Slot(id).active.load(std::memory_order_acquire);}
+  inline bool IsClosed() const {return fHeader->closed.load(std::memory_order_acquire);}
+
+  //Same semantics as BinanceOrderBook::GetView
+  inline bool GetView(const int& id, bookview* view) const {Slot(id).view.Read(view); return (view->updateid!=0);}
+
+  //Non-blocking variant returning false if the view is being written
+  inline bool TryGetView(const int& id, bookview* view, uint64_t* version=NULL) const {return Slot(id).view.TryRead(view, version);}
+
+  //Changes with every publication, to poll for new views without copying
+  inline uint64_t GetVersion(const int& id) const {return Slot(id).view.Version();}
+
+  protected:
+  inline const sharedbookslot& Slot(const uint32_t& id) const {return *(const sharedbookslot*)(fData+SHAREDBOOK_HEADER_SIZE+id*SHAREDBOOK_SLOT_SIZE);}
+
+  const char* fData;
+  size_t fSize;
+  const sharedbookheader* fHeader;
+  private:
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "BinanceTradeStream.h"
+
+BinanceTradeStream::BinanceTradeStream(WebSocketManager* manager, const int& btype, const char* symbol, const bool& aggregate, const size_t& ringsize): fManager(manager), fRing(NULL), fMask(0), fHead(0), fWindows(), fTails(), fDropped(), fNWindows(0), fStats(), fMutex(), fLastID(0), fLastTime(0), fLastPrice(0), fType(btype), fSymbol(NULL), fId(-1), fAggregate(aggregate)
+{
+  size_t size=2;
+
+  while(size<ringsize) size<<=1;
+
+  if(posix_memalign((void**)&fRing, 64, size*sizeof(tradeslot))) {
+    fprintf(stderr,"%s: Error: Could not allocate the ring!\n",__func__);
+    throw 0;
+  }
+  //Zeroed slots hold no record
+  memset((void*)fRing, 0, size*sizeof(tradeslot));
+  fMask=size-1;
+  fSymbol=strdup(symbol);
+  pthread_mutex_init(&fMutex,NULL);
+}
+
+int BinanceTradeStream::AddWindow(const uint64_t& duration)
+{
+  pthread_mutex_lock(&fMutex);
+
+  if(fNWindows==TRADE_MAX_WINDOWS || !duration) {
+    pthread_mutex_unlock(&fMutex);
+    fprintf(stderr,"%s: Error: Invalid window!\n",__func__);
+    return -1;
+  }
+  const int id=fNWindows++;
+  memset(fWindows+id, 0, sizeof(tradewindow));
+  fWindows[id].duration=duration;
+  //The window starts empty and only sees the trades received from now on
+  fTails[id]=fHead.load(std::memory_order_relaxed);
+  fDropped[id]=0;
+  PublishStats();
+  pthread_mutex_unlock(&fMutex);
+  return id;
+}
+
+int8_t BinanceTradeStream::OnPayload(const char* payload, const size_t& len)
+{
+  traderecord tr;
+
+  if(trade_scan(payload, len, &tr)) {
+
+    //Subscription replies and other frames are not trades
+    if(len && payload[0]=='{' && !memmem(payload, len, "\"e\":", 4)) return 0;
+    fprintf(stderr,"%s: Error parsing trade: %.*s\n",__func__,(int)len,payload);
+    return -1;
+  }
+  pthread_mutex_lock(&fMutex);
+
+  //Ids only increase within a stream, so this only drops duplicates,
+  //e.g. replayed around a reconnection
+  if(tr.id<=fLastID) {
+    pthread_mutex_unlock(&fMutex);
+    return 0;
+  }
+  const uint64_t n=fHead.load(std::memory_order_relaxed);
+  tradeslot& slot=fRing[n&fMask];
+  uint32_t i;
+
+  //The record about to be overwritten leaves the windows still holding it
+  for(i=0; i<fNWindows; ++i) if(fTails[i]+fMask+1<=n) {
+    const traderecord& old=slot.record;
+    tradewindow& w=fWindows[i];
+    w.count-=old.ntrades;
+    w.volume-=old.quantity;
+    w.notional-=old.price*old.quantity;
+
+    if(!old.buyermaker) w.buyvolume-=old.quantity;
+    fDropped[i]=old.tradetime;
+    ++fTails[i];
+  }
+  slot.seq.store(2*n+1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&slot.record, &tr, sizeof(traderecord));
+  slot.seq.store(2*n+2, std::memory_order_release);
+  fHead.store(n+1, std::memory_order_release);
+
+  for(i=0; i<fNWindows; ++i) {
+    tradewindow& w=fWindows[i];
+    w.count+=tr.ntrades;
+    w.volume+=tr.quantity;
+    w.notional+=tr.price*tr.quantity;
+
+    if(!tr.buyermaker) w.buyvolume+=tr.quantity;
+  }
+  fLastID=tr.id;
+  fLastPrice=tr.price;
+
+  if(tr.tradetime>fLastTime) fLastTime=tr.tradetime;
+  Evict(fLastTime);
+  PublishStats();
+  pthread_mutex_unlock(&fMutex);
+  return 1;
+}
+
+void BinanceTradeStream::Advance(const uint64_t& now)
+{
+  pthread_mutex_lock(&fMutex);
+
+  if(now>fLastTime) {
+    fLastTime=now;
+    Evict(now);
+    PublishStats();
+  }
+  pthread_mutex_unlock(&fMutex);
+}
+
+void BinanceTradeStream::Evict(const uint64_t& now)
+{
+  //fMutex must be locked before calling this function!
+  const uint64_t head=fHead.load(std::memory_order_relaxed);
+
+  for(uint32_t i=0; i<fNWindows; ++i) {
+    tradewindow& w=fWindows[i];
+    const uint64_t start=(now>w.duration?now-w.duration:0);
+
+    for(; fTails[i]<head; ++fTails[i]) {
+      const traderecord& old=fRing[fTails[i]&fMask].record;
+
+      if(old.tradetime>start) break;
+      w.count-=old.ntrades;
+      w.volume-=old.quantity;
+      w.notional-=old.price*old.quantity;
+
+      if(!old.buyermaker) w.buyvolume-=old.quantity;
+    }
+
+    //Restarts the sums from exact zeros so that rounding errors do not
+    //accumulate over the life of the stream
+    if(fTails[i]==head) w.count=w.volume=w.notional=w.buyvolume=0;
+    w.vwap=(w.volume>0?w.notional/w.volume:NAN);
+    w.truncated=(fDropped[i]>start);
+  }
+}
+
+void BinanceTradeStream::PublishStats()
+{
+  //fMutex must be locked before calling this function!
+  tradestats& stats=fStats.BeginWrite();
+  stats.lastid=fLastID;
+  stats.lasttime=fLastTime;
+  stats.lastprice=fLastPrice;
+  stats.nwindows=fNWindows;
+  memcpy(stats.windows, fWindows, fNWindows*sizeof(tradewindow));
+  fStats.EndWrite();
+}
+
+void BinanceTradeStream::StartSocket()
+{
+  char wsuri[1024];
+  const char* conf=(fAggregate?WS_AGGTRADE_CONF:WS_TRADE_CONF);
+
+  switch(fType) {
+    case binance_spot:
+      sprintf(wsuri,"%s%s%s",BINANCE_SPOT_WS_URI,fSymbol,conf);
+      break;
+
+    case binance_usdm_future:
+      sprintf(wsuri,"%s%s%s",BINANCE_USDM_FUTURE_WS_URI,fSymbol,conf);
+      break;
+
+    case binance_coinm_future:
+      sprintf(wsuri,"%s%s%s",BINANCE_COINM_FUTURE_WS_URI,fSymbol,conf);
+      break;
+
+    default:
+      fprintf(stderr,"%s: Error: Invalid binance type\n",__func__);
+      throw 0;
+  }
+
+  printf("Socket URI is %s\n",wsuri);
+  fId=fManager->Connect(wsuri, websocketpp::lib::bind(&BinanceTradeStream::OnMessage, this, websocketpp::lib::placeholders::_1, websocketpp::lib::placeholders::_2));
+}
@@ -0,0 +1,170 @@
+#ifndef _BINANCETRADESTREAM_
+#define _BINANCETRADESTREAM_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <string>
+#include <atomic>
+
+#include <pthread.h>
+
+#include "binance_base.h"
+
+#include "WebSocketManager.h"
+#include "BinanceOrderBook.h"
+#include "trade_parser.h"
+#include "seqlock_utils.h"
+
+#define WS_TRADE_CONF "@trade"
+#define WS_AGGTRADE_CONF "@aggTrade"
+
+//Maximum number of rolling windows per stream
+#define TRADE_MAX_WINDOWS 4
+
+//Ring slot, one cache line. seq is 2*(n+1) once record n is stored in the
+//slot and odd while it is being written.
+struct tradeslot
+{
+  std::atomic<uint64_t> seq;
+  traderecord record;
+};
+
+//Flow over the trades of the last duration milliseconds (by trade time)
+struct tradewindow
+{
+  uint64_t duration;
+  uint64_t count; //Number of trades (aggregate trades count as their ntrades)
+  double volume; //Base volume
+  double notional; //Quote volume
+  double buyvolume; //Base volume bought by takers
+  double vwap; //NAN if the window is empty
+  uint32_t truncated; //Non-zero if the ring is too short to hold the window
+  uint32_t reserved;
+};
+
+//Published after each trade and readable without locks through GetStats
+struct tradestats
+{
+  uint64_t lastid; //0 until the first trade
+  uint64_t lasttime; //Trade time of the last trade, the windows end there
+  double lastprice;
+  uint32_t nwindows;
+  uint32_t reserved;
+  tradewindow windows[TRADE_MAX_WINDOWS];
+};
+
+//Trade or aggTrade stream of a symbol. Frames are parsed into traderecord
+//without allocation and stored in a fixed ring that any number of
+//consumers read concurrently with their own cursor (single producer,
+//multiple consumers, each consumer seeing every record). A consumer
+//that falls more than the ring size behind is moved forward and told so.
+//
+//The rolling windows are maintained incrementally by the producer: each
+//trade is added to every window and the trades that left a window are
+//subtracted, walking the ring from the window's tail, so GetStats is O(1).
+class BinanceTradeStream
+{
+  public:
+  //ringsize is rounded up to a power of 2 and bounds the windows: a window
+  //longer than the trades held by the ring is flagged as truncated
+  BinanceTradeStream(WebSocketManager* manager, const int& btype, const char* symbol, const bool& aggregate=false, const size_t& ringsize=65536);
+  ~BinanceTradeStream(){StopSocket(); pthread_mutex_destroy(&fMutex); free(fSymbol); free(fRing);}
+
+  //Rolling window durations in milliseconds, to be set before Launch.
+  //Returns the window index, or -1 if there are too many windows.
+  int AddWindow(const uint64_t& duration);
+
+  int Launch(){StartSocket(); return 0;}
+
+  inline void OnMessage(websocketpp::connection_hdl, client::message_ptr msg){const std::string& payload=msg->get_payload(); OnPayload(payload.data(), payload.size());}
+
+  //Parses and stores a frame. Returns 1 if a trade was stored, 0 if it was
+  //a duplicate and -1 on error.
+  int8_t OnPayload(const char* payload, const size_t& len);
+
+  //Evicts the trades older than now (in ms) from the windows when no trade
+  //has been received for a while, e.g. from a timer
+  void Advance(const uint64_t& now);
+
+  inline bool GetStats(tradestats* stats) const {fStats.Read(stats); return (stats->lastid!=0);}
+
+  //Sequence of the next record, i.e. the number of records stored so far
+  inline uint64_t GetHead() const {return fHead.load(std::memory_order_acquire);}
+
+  //Reads record cursor and advances cursor. Returns 1 on success, 0 if the
+  //record has not been stored yet, and -1 if it was overwritten, in which
+  //case cursor is moved to the oldest record still available.
+  inline int Read(uint64_t& cursor, traderecord* record) const
+  {
+    const tradeslot& slot=fRing[cursor&fMask];
+    const uint64_t expected=2*(cursor+1);
+    const uint64_t s0=slot.seq.load(std::memory_order_acquire);
+
+    if(s0==expected) {
+      memcpy(record, &slot.record, sizeof(traderecord));
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if(slot.seq.load(std::memory_order_relaxed)==expected) {
+	++cursor;
+	return 1;
+      }
+
+    } else if(s0<expected) return 0; //Not stored yet, or being stored
+    //Overwritten. The oldest record is skipped as well, since its slot is
+    //the next one to be written.
+    const uint64_t head=GetHead();
+    cursor=(head>fMask?head-fMask:0);
+    return -1;
+  }
+
+  //Reads up to max records. Returns the number of records read, and stores
+  //whether records were lost in lost if not NULL.
+  inline size_t ReadBatch(uint64_t& cursor, traderecord* records, const size_t& max, bool* lost=NULL) const
+  {
+    size_t n=0;
+    int ret;
+
+    if(lost) *lost=false;
+
+    while(n<max && (ret=Read(cursor, records+n))) {
+
+      if(ret>0) ++n;
+
+      else if(lost) *lost=true;
+    }
+    return n;
+  }
+
+  inline size_t GetRingSize() const {return fMask+1;}
+  inline const char* GetSymbol() const {return fSymbol;}
+
+  protected:
+  void StartSocket();
+  void StopSocket(){if(fId!=-1) fManager->Close(fId, websocketpp::close::status::normal, "");}
+  //fMutex must be locked before calling these functions!
+  void Evict(const uint64_t& now);
+  void PublishStats();
+
+  WebSocketManager* fManager;
+  tradeslot* fRing; //Aligned on cache lines
+  uint64_t fMask;
+  std::atomic<uint64_t> fHead;
+  tradewindow fWindows[TRADE_MAX_WINDOWS];
+  uint64_t fTails[TRADE_MAX_WINDOWS]; //Sequence of the oldest record in each window
+  uint64_t fDropped[TRADE_MAX_WINDOWS]; //Time of the last trade overwritten while in the window
+  uint32_t fNWindows;
+  seqlock<tradestats> fStats;
+  pthread_mutex_t fMutex;
+  uint64_t fLastID;
+  uint64_t fLastTime;
+  double fLastPrice;
+  int fType;
+  char* fSymbol;
+  int fId;
+  bool fAggregate;
+  private:
+};
+
+#endif
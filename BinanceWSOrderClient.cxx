@@ -0,0 +1,335 @@
+#include "BinanceWSOrderClient.h"
+
+//Parameters sent as JSON numbers. The other values are sent as strings.
+static const binstr wsnumericparams[]={BIN_STR("orderId"), BIN_STR("cancelOrderId"), BIN_STR("recvWindow"), BIN_STR("timestamp")};
+
+inline static bool wsisnumeric(const char* name, const size_t& namelen)
+{
+  for(size_t i=0; i<sizeof(wsnumericparams)/sizeof(wsnumericparams[0]); ++i) if(wsnumericparams[i].len==namelen && !memcmp(wsnumericparams[i].str, name, namelen)) return true;
+  return false;
+}
+
+BinanceWSOrderClient::BinanceWSOrderClient(WebSocketManager* manager, const char* configfile, const bintype& btype): fEP(configfile), fManager(manager), fBType(btype), fJSTok(json_tokener_new()), fMutex(), fCond(), fTimer(manager->GetIOService()), fURI(), fPending(), fQuery(), fSigned(), fFrame(), fNextId(1), fId(-1), fAttempts(0), fState(wsstate_closed), fReconnecting(false), fStopping(false)
+{
+  if(!fJSTok) {
+    fprintf(stderr,"%s: Error: Could not create the JSON tokener!\n",__func__);
+    throw 0;
+  }
+  pthread_mutex_init(&fMutex,NULL);
+  pthread_cond_init(&fCond,NULL);
+}
+
+BinanceWSOrderClient::~BinanceWSOrderClient()
+{
+  struct timespec timeout;
+  Stop();
+  pthread_mutex_lock(&fMutex);
+  clock_gettime(CLOCK_REALTIME, &timeout);
+  timeout.tv_sec+=5;
+
+  //The handlers of the session and of the timer must have run before the
+  //client goes away
+  while(fState!=wsstate_closed || fReconnecting) if(pthread_cond_timedwait(&fCond, &fMutex, &timeout)==ETIMEDOUT) {
+    fprintf(stderr,"%s: Warning: Timed out waiting for the session to close\n",__func__);
+    break;
+  }
+  pthread_mutex_unlock(&fMutex);
+  FailPending();
+  json_tokener_free(fJSTok);
+  pthread_mutex_destroy(&fMutex);
+  pthread_cond_destroy(&fCond);
+}
+
+int BinanceWSOrderClient::Launch(const char* uri)
+{
+  if(!uri) {
+
+    if(fBType==bin_spot || fBType==bin_spot_alt) uri=BINANCE_SPOT_WS_API_URI;
+
+    else if(fBType==bin_usdm_future) uri=BINANCE_USDM_FUTURE_WS_API_URI;
+
+    else {
+      fprintf(stderr,"%s: Error: No WebSocket API for this market type\n",__func__);
+      return -1;
+    }
+  }
+  pthread_mutex_lock(&fMutex);
+
+  //A reconnection cancelled by Stop finds the session connecting
+  if(fState!=wsstate_closed || (fReconnecting && !fStopping)) {
+    pthread_mutex_unlock(&fMutex);
+    fprintf(stderr,"%s: Error: The session is already launched\n",__func__);
+    return -1;
+  }
+  fURI=uri;
+  fAttempts=0;
+  fStopping=false;
+  const int ret=Connect();
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+void BinanceWSOrderClient::Stop()
+{
+  pthread_mutex_lock(&fMutex);
+  fStopping=true;
+  fTimer.cancel();
+  StopSocket();
+  pthread_mutex_unlock(&fMutex);
+}
+
+int BinanceWSOrderClient::Connect()
+{
+  //fMutex must be locked before calling this function! The handlers only
+  //run once it is released.
+  fState=wsstate_connecting;
+  fId=fManager->Connect(fURI.c_str(), websocketpp::lib::bind(&BinanceWSOrderClient::OnMessage, this, websocketpp::lib::placeholders::_1, websocketpp::lib::placeholders::_2), websocketpp::lib::bind(&BinanceWSOrderClient::OnOpen, this, websocketpp::lib::placeholders::_1), websocketpp::lib::bind(&BinanceWSOrderClient::OnClose, this, websocketpp::lib::placeholders::_1));
+
+  if(fId<0) {
+    fState=wsstate_closed;
+    return -1;
+  }
+  return 0;
+}
+
+void BinanceWSOrderClient::ScheduleReconnect()
+{
+  //fMutex must be locked before calling this function!
+  if(fReconnecting) return;
+  const int delay=binreconnectdelay(fAttempts++);
+  fprintf(stderr,"%s: Warning: The session is closed, reconnecting in %i ms\n",__func__,delay);
+  fReconnecting=true;
+  fTimer.expires_from_now(std::chrono::milliseconds(delay));
+  fTimer.async_wait([this](const boost::system::error_code& ec){Reconnect(!ec);});
+}
+
+void BinanceWSOrderClient::Reconnect(const bool& expired)
+{
+  pthread_mutex_lock(&fMutex);
+  fReconnecting=false;
+  pthread_cond_broadcast(&fCond);
+
+  if(expired && !fStopping && fState==wsstate_closed && Connect()) ScheduleReconnect();
+  pthread_mutex_unlock(&fMutex);
+}
+
+int BinanceWSOrderClient::WaitOpen(const int& timeout)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec+=timeout/1000;
+  ts.tv_nsec+=(timeout%1000)*1000000;
+
+  if(ts.tv_nsec>=1000000000) {
+    ++ts.tv_sec;
+    ts.tv_nsec-=1000000000;
+  }
+  pthread_mutex_lock(&fMutex);
+
+  while(fState==wsstate_connecting || fState==wsstate_closing || (fReconnecting && !fStopping)) if(pthread_cond_timedwait(&fCond, &fMutex, &ts)==ETIMEDOUT) break;
+  const int ret=(fState==wsstate_open?0:-1);
+  pthread_mutex_unlock(&fMutex);
+  return ret;
+}
+
+int BinanceWSOrderClient::SendRequest(const char* method, char* query, const size_t& querylen, const int& sign, binrestcallback callback, void* userdata)
+{
+  //fMutex must be locked before calling this function!
+  if(fState!=wsstate_open) {
+    fprintf(stderr,"%s: Error: The session is not open\n",__func__);
+    return -1;
+  }
+  wspending& pending=fPending[fNextId&(BIN_WS_MAXPENDING-1)];
+
+  if(pending.id) {
+    fprintf(stderr,"%s: Error: Too many pending requests\n",__func__);
+    return -1;
+  }
+  wsparam params[BIN_WS_MAXPARAMS];
+  int nparams=0;
+  const char* p=query;
+  const char* end=query+querylen;
+
+  //Splits the query into its name=value pairs
+  while(p<end) {
+
+    if(nparams==BIN_WS_MAXPARAMS-2) {
+      fprintf(stderr,"%s: Error: Too many parameters\n",__func__);
+      return -1;
+    }
+    const char* amp=(const char*)memchr(p, '&', end-p);
+
+    if(!amp) amp=end;
+    const char* eq=(const char*)memchr(p, '=', amp-p);
+
+    if(!eq) params[nparams++]={p, (size_t)(amp-p), amp, 0};
+
+    else params[nparams++]={p, (size_t)(eq-p), eq+1, (size_t)(amp-eq-1)};
+    p=amp+1;
+  }
+  const char* apikey=fEP.GetAPIKey();
+  char timestamp[20];
+
+  if(sign!=binepsign_false) params[nparams++]={"apiKey", 6, apikey, strlen(apikey)};
+
+  if(sign==binepsign_true) params[nparams++]={"timestamp", 9, timestamp, (size_t)uint64toascii(getmstime(), timestamp)};
+
+  //The signed payload lists the parameters sorted by name
+  for(int i=1; i<nparams; ++i) {
+    const wsparam param=params[i];
+    int j=i;
+
+    for(; j>0; --j) {
+      const int cmp=memcmp(params[j-1].name, param.name, (params[j-1].namelen<param.namelen?params[j-1].namelen:param.namelen));
+
+      if(cmp<0 || (cmp==0 && params[j-1].namelen<=param.namelen)) break;
+      params[j]=params[j-1];
+    }
+    params[j]=param;
+  }
+  size_t signedlen=querylen+64;
+
+  for(int i=0; i<nparams; ++i) signedlen+=params[i].namelen+params[i].valuelen;
+
+  if(fSigned.size()<signedlen) fSigned.resize(signedlen);
+  const size_t framelen=2*signedlen+6*BIN_WS_MAXPARAMS+strlen(method)+128;
+
+  if(fFrame.size()<framelen) fFrame.resize(framelen);
+  char* s=&fSigned[0];
+  char* f=&fFrame[0];
+  f=binputlit(f, "{\"id\":");
+  f=binputint(f, fNextId);
+  f=binputlit(f, ",\"method\":\"");
+  f=binputcstr(f, method);
+  f=binputlit(f, "\",\"params\":{");
+
+  for(int i=0; i<nparams; ++i) {
+
+    if(i) {
+      *s++='&';
+      *f++=',';
+    }
+    s=binputraw(s, params[i].name, params[i].namelen);
+    *s++='=';
+    s=binputraw(s, params[i].value, params[i].valuelen);
+    *f++='"';
+    f=binputraw(f, params[i].name, params[i].namelen);
+    f=binputlit(f, "\":");
+
+    if(wsisnumeric(params[i].name, params[i].namelen)) f=binputraw(f, params[i].value, params[i].valuelen);
+
+    else {
+      *f++='"';
+      f=binputraw(f, params[i].value, params[i].valuelen);
+      *f++='"';
+    }
+  }
+
+  if(sign==binepsign_true) {
+    f=binputlit(f, ",\"signature\":\"");
+    fEP.GetSigner().SignHex(&fSigned[0], s-&fSigned[0], f);
+    f+=HMAC_SHA256_HEXLENGTH;
+    *f++='"';
+  }
+  f=binputlit(f, "}}");
+
+  //The response can only be handled once fMutex is released
+  pending.id=fNextId;
+  pending.callback=callback;
+  pending.userdata=userdata;
+
+  if(fManager->Send(fId, &fFrame[0], f-&fFrame[0])) {
+    pending.id=0;
+    return -1;
+  }
+  ++fNextId;
+  return 0;
+}
+
+void BinanceWSOrderClient::OnOpen(websocketpp::connection_hdl)
+{
+  pthread_mutex_lock(&fMutex);
+  fState=wsstate_open;
+  fAttempts=0;
+  pthread_cond_broadcast(&fCond);
+  pthread_mutex_unlock(&fMutex);
+}
+
+void BinanceWSOrderClient::OnMessage(websocketpp::connection_hdl, client::message_ptr msg)
+{
+  const std::string& payload=msg->get_payload();
+  json_tokener_reset(fJSTok);
+  json_object* jobj=json_tokener_parse_ex(fJSTok, payload.data(), payload.size());
+
+  if(!jobj || json_tokener_get_error(fJSTok)!=json_tokener_success) {
+    fprintf(stderr,"%s: Error: Could not parse message '%s'\n",__func__,payload.c_str());
+
+    if(jobj) json_object_put(jobj);
+    return;
+  }
+  json_object* val;
+
+  //Responses to requests sent by other means are ignored
+  if(!json_object_object_get_ex(jobj, "id", &val) || json_object_get_type(val)!=json_type_int) {
+    json_object_put(jobj);
+    return;
+  }
+  const uint64_t id=json_object_get_int64(val);
+  binresponse response={0, 0, NULL};
+
+  if(json_object_object_get_ex(jobj, "status", &val)) response.httpcode=json_object_get_int64(val);
+
+  if(!json_object_object_get_ex(jobj, "result", &response.jobj) && !json_object_object_get_ex(jobj, "error", &response.jobj)) response.jobj=jobj;
+  pthread_mutex_lock(&fMutex);
+  wspending& pending=fPending[id&(BIN_WS_MAXPENDING-1)];
+
+  if(!id || pending.id!=id) {
+    pthread_mutex_unlock(&fMutex);
+    fprintf(stderr,"%s: Warning: Response to unknown request %" PRIu64 "\n",__func__,id);
+    json_object_put(jobj);
+    return;
+  }
+  const wspending completed=pending;
+  pending.id=0;
+  pthread_mutex_unlock(&fMutex);
+
+  if(completed.callback) completed.callback(response, completed.userdata);
+  json_object_put(jobj);
+}
+
+void BinanceWSOrderClient::OnClose(websocketpp::connection_hdl)
+{
+  pthread_mutex_lock(&fMutex);
+  fState=wsstate_closing;
+  fId=-1;
+  pthread_mutex_unlock(&fMutex);
+  FailPending();
+
+  //The client may only go away once the pending requests are completed
+  pthread_mutex_lock(&fMutex);
+  fState=wsstate_closed;
+  pthread_cond_broadcast(&fCond);
+
+  //Binance closes the sessions every 24 hours, besides network failures
+  if(!fStopping) ScheduleReconnect();
+  pthread_mutex_unlock(&fMutex);
+}
+
+void BinanceWSOrderClient::FailPending()
+{
+  const binresponse response={-1, 0, NULL};
+
+  for(int i=0; i<BIN_WS_MAXPENDING; ++i) {
+    pthread_mutex_lock(&fMutex);
+
+    if(!fPending[i].id) {
+      pthread_mutex_unlock(&fMutex);
+      continue;
+    }
+    const wspending completed=fPending[i];
+    fPending[i].id=0;
+    pthread_mutex_unlock(&fMutex);
+
+    if(completed.callback) completed.callback(response, completed.userdata);
+  }
+}
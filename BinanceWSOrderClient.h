@@ -0,0 +1,160 @@
+#ifndef _BINANCEWSORDERCLIENT_
+#define _BINANCEWSORDERCLIENT_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <pthread.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <future>
+
+#include <json-c/json.h>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include "binance_base.h"
+#include "binance_orders.h"
+
+#include "BinanceEndpoint.h"
+#include "BinanceRestLoop.h"
+#include "WebSocketManager.h"
+
+//Largest number of requests awaiting their response. Must be a power of 2.
+#ifndef BIN_WS_MAXPENDING
+#define BIN_WS_MAXPENDING 1024
+#endif
+
+//Largest number of parameters of a request, including apiKey and timestamp
+#define BIN_WS_MAXPARAMS 32
+
+//Order entry over Binance's WebSocket API. Orders, cancels and queries are
+//sent as JSON-RPC frames on a single session kept open through
+//WebSocketManager, instead of as REST requests, so each of them saves the
+//HTTP request and response headers and their parsing on both ends, and
+//never waits for a connection. The typed requests of binance_orders.h are
+//sent as is: their query is split into parameters, which are signed in
+//alphabetical order with the endpoint's HMAC key together with apiKey and
+//timestamp, as the WebSocket API requires. session.logon only accepts
+//Ed25519 keys, so every request carries its apiKey and signature.
+//Responses are matched with their request by id, and complete it from the
+//socket thread as BinanceRestLoop does, with the "result" (or "error")
+//object of the response and its "status" as HTTP code. Callbacks must not
+//block the socket thread. Requests still pending when the session closes
+//complete with a status of -1. Binance closes the sessions periodically,
+//so a session that closes or fails to open is reopened with an exponential
+//backoff (see binreconnectdelay) until Stop is called.
+class BinanceWSOrderClient
+{
+  public:
+  BinanceWSOrderClient(WebSocketManager* manager, const char* configfile, const bintype& btype);
+  ~BinanceWSOrderClient();
+
+  //Opens the session to uri if not NULL (e.g. a local test server), or to
+  //the WebSocket API of btype (spot or USD-M futures). Returns 0 once the
+  //connection has been initiated.
+  int Launch(const char* uri=NULL);
+
+  //Closes the session without reopening it. Launch opens it again.
+  void Stop();
+
+  //Waits at most timeout ms for the session to open, through the scheduled
+  //reconnections. Returns 0 if it is open, -1 if it timed out or the
+  //session was stopped.
+  int WaitOpen(const int& timeout);
+
+  inline bool IsOpen(){pthread_mutex_lock(&fMutex); const bool ret=(fState==wsstate_open); pthread_mutex_unlock(&fMutex); return ret;}
+
+  //Sends a typed request (binneworder, bincancelorder, bincancelreplace or
+  //binqueryorder). Returns 0 once the request has been sent, and -1 without
+  //invoking the callback if the session is not open or too many requests
+  //are pending. Can be called from any thread.
+  template<typename T> int Submit(const T& req, binrestcallback callback, void* userdata=NULL)
+  {
+    constexpr binepdesc ep=T::Endpoint();
+    pthread_mutex_lock(&fMutex);
+
+    if(fQuery.size()<req.MaxLength()) fQuery.resize(req.MaxLength());
+    const int ret=SendRequest(ep.wsmethod, &fQuery[0], req.Serialize(&fQuery[0]), ep.sign, callback, userdata);
+    pthread_mutex_unlock(&fMutex);
+    return ret;
+  }
+
+  //Same, completing a future. The caller owns the jobj of the response and
+  //must release it with json_object_put.
+  template<typename T> std::future<binresponse> Submit(const T& req)
+  {
+    std::promise<binresponse>* promise=new std::promise<binresponse>;
+    std::future<binresponse> future=promise->get_future();
+
+    if(Submit(req, BinanceEndpoint::SetPromise, promise)) {
+      promise->set_value({-1, 0, NULL});
+      delete promise;
+    }
+    return future;
+  }
+
+  inline BinanceEndpoint& GetEndpoint(){return fEP;}
+
+  protected:
+  enum wsstate {wsstate_closed, wsstate_connecting, wsstate_open, wsstate_closing};
+
+  struct wspending
+  {
+    uint64_t id; //0 if the slot is free
+    binrestcallback callback;
+    void* userdata;
+  };
+
+  struct wsparam
+  {
+    const char* name;
+    size_t namelen;
+    const char* value;
+    size_t valuelen;
+  };
+
+  //fMutex must be locked before calling this function!
+  int SendRequest(const char* method, char* query, const size_t& querylen, const int& sign, binrestcallback callback, void* userdata);
+
+  //fMutex must be locked before calling these functions!
+  int Connect();
+  void ScheduleReconnect();
+
+  void Reconnect(const bool& expired);
+
+  void OnOpen(websocketpp::connection_hdl);
+  void OnMessage(websocketpp::connection_hdl, client::message_ptr msg);
+  void OnClose(websocketpp::connection_hdl);
+  void FailPending();
+  //fMutex must be locked before calling this function!
+  void StopSocket(){if(fId!=-1) fManager->Close(fId, websocketpp::close::status::normal, "");}
+
+  BinanceEndpoint fEP;
+  WebSocketManager* fManager;
+  const bintype& fBType;
+  json_tokener* fJSTok; //Only used from the socket thread
+  pthread_mutex_t fMutex;
+  pthread_cond_t fCond;
+  boost::asio::steady_timer fTimer; //Reconnection delay
+  std::string fURI;
+  wspending fPending[BIN_WS_MAXPENDING]; //Indexed by id modulo BIN_WS_MAXPENDING
+  std::vector<char> fQuery;
+  std::vector<char> fSigned; //Sorted parameters, as signed
+  std::vector<char> fFrame;
+  uint64_t fNextId;
+  int fId;
+  int fAttempts; //Connection attempts since the session was last open
+  wsstate fState;
+  bool fReconnecting; //A reconnection is scheduled on fTimer
+  bool fStopping; //Stop has been called
+  private:
+  BinanceWSOrderClient(const BinanceWSOrderClient&);
+  BinanceWSOrderClient& operator=(const BinanceWSOrderClient&);
+};
+
+#endif
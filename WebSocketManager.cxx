@@ -86,7 +86,14 @@ WebSocketManager::~WebSocketManager()
 {
   m_endpoint.stop_perpetual();
 
-  for (con_list::const_iterator it = m_connection_list.begin(); it != m_connection_list.end(); ++it) {
+  // The list is copied, as the handlers may still open connections
+  con_list connections;
+  {
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(m_lock);
+    connections = m_connection_list;
+  }
+
+  for (con_list::const_iterator it = connections.begin(); it != connections.end(); ++it) {
     if (it->second->get_status() != "Open") {
       // Only close open connections
       continue;
@@ -105,7 +112,7 @@ WebSocketManager::~WebSocketManager()
   m_thread->join();
 }
 
-int WebSocketManager::Connect(const char* uri, client::connection_type::message_handler mh)
+int WebSocketManager::Connect(const char* uri, client::connection_type::message_handler mh, websocketpp::open_handler oh, websocketpp::close_handler ch)
 {
   websocketpp::lib::error_code ec;
 
@@ -116,52 +123,86 @@ int WebSocketManager::Connect(const char* uri, client::connection_type::message_
     return -1;
   }
 
-  int new_id = m_next_id++;
-  connection_metadata::ptr metadata_ptr = websocketpp::lib::make_shared<connection_metadata>(new_id, con->get_handle(), uri);
-  m_connection_list[new_id] = metadata_ptr;
+  int new_id;
+  connection_metadata::ptr metadata_ptr;
+  {
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(m_lock);
+    new_id = m_next_id++;
+    metadata_ptr = websocketpp::lib::make_shared<connection_metadata>(new_id, con->get_handle(), uri);
+    m_connection_list[new_id] = metadata_ptr;
+  }
 
-  con->set_open_handler(websocketpp::lib::bind(
+  if(!oh) con->set_open_handler(websocketpp::lib::bind(
 	&connection_metadata::on_open,
 	metadata_ptr,
 	&m_endpoint,
 	websocketpp::lib::placeholders::_1
 	));
-  con->set_fail_handler(websocketpp::lib::bind(
+  else con->set_open_handler([this, metadata_ptr, oh](websocketpp::connection_hdl hdl){
+      metadata_ptr->on_open(&m_endpoint, hdl);
+      oh(hdl);
+      });
+  if(!ch) con->set_fail_handler(websocketpp::lib::bind(
 	&connection_metadata::on_fail,
 	metadata_ptr,
 	&m_endpoint,
 	websocketpp::lib::placeholders::_1
 	));
-  con->set_close_handler(websocketpp::lib::bind(
+  else con->set_fail_handler([this, metadata_ptr, ch, new_id](websocketpp::connection_hdl hdl){
+      metadata_ptr->on_fail(&m_endpoint, hdl);
+      Forget(new_id);
+      ch(hdl);
+      });
+  if(!ch) con->set_close_handler(websocketpp::lib::bind(
 	&connection_metadata::on_close,
 	metadata_ptr,
 	&m_endpoint,
 	websocketpp::lib::placeholders::_1
 	));
+  else con->set_close_handler([this, metadata_ptr, ch, new_id](websocketpp::connection_hdl hdl){
+      metadata_ptr->on_close(&m_endpoint, hdl);
+      Forget(new_id);
+      ch(hdl);
+      });
   if(!mh) con->set_message_handler(websocketpp::lib::bind(
 	&connection_metadata::on_message,
 	metadata_ptr,
 	websocketpp::lib::placeholders::_1,
 	websocketpp::lib::placeholders::_2
 	));
+#ifdef BIN_LATENCY_STATS
+  //Frames are timestamped as they are handed over by websocketpp, for the
+  //handler to measure its latency from reception
+  else con->set_message_handler([mh](websocketpp::connection_hdl hdl, client::message_ptr msg){
+      lat_stamp_receive();
+      mh(hdl, msg);
+      });
+#else
   else con->set_message_handler(mh);
+#endif
 
   m_endpoint.connect(con);
 
   return new_id;
 }
 
+void WebSocketManager::Forget(int id)
+{
+  websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(m_lock);
+  m_connection_list.erase(id);
+}
+
 void WebSocketManager::Close(int id, websocketpp::close::status::value code, std::string reason)
 {
   websocketpp::lib::error_code ec;
 
-  con_list::iterator metadata_it = m_connection_list.find(id);
-  if (metadata_it == m_connection_list.end()) {
+  connection_metadata::ptr metadata = GetMetaData(id);
+  if (!metadata) {
     std::cout << "> No connection found with id " << id << std::endl;
     return;
   }
 
-  m_endpoint.close(metadata_it->second->get_hdl(), code, reason, ec);
+  m_endpoint.close(metadata->get_hdl(), code, reason, ec);
   if (ec) {
     std::cout << "> Error initiating close: " << ec.message() << std::endl;
   }
@@ -171,17 +212,36 @@ void WebSocketManager::Send(int id, std::string message)
 {
   websocketpp::lib::error_code ec;
 
-  con_list::iterator metadata_it = m_connection_list.find(id);
-  if (metadata_it == m_connection_list.end()) {
+  connection_metadata::ptr metadata = GetMetaData(id);
+  if (!metadata) {
     std::cout << "> No connection found with id " << id << std::endl;
     return;
   }
 
-  m_endpoint.send(metadata_it->second->get_hdl(), message, websocketpp::frame::opcode::text, ec);
+  m_endpoint.send(metadata->get_hdl(), message, websocketpp::frame::opcode::text, ec);
   if (ec) {
     std::cout << "> Error sending message: " << ec.message() << std::endl;
     return;
   }
 
-  metadata_it->second->record_sent_message(message);
+  metadata->record_sent_message(message);
+}
+
+int WebSocketManager::Send(int id, const void* payload, size_t len)
+{
+  websocketpp::lib::error_code ec;
+
+  // The connection's metadata is kept alive by the copied pointer
+  connection_metadata::ptr metadata = GetMetaData(id);
+  if (!metadata) {
+    std::cout << "> No connection found with id " << id << std::endl;
+    return -1;
+  }
+
+  m_endpoint.send(metadata->get_hdl(), payload, len, websocketpp::frame::opcode::text, ec);
+  if (ec) {
+    std::cout << "> Error sending message: " << ec.message() << std::endl;
+    return -1;
+  }
+  return 0;
 }
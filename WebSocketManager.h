@@ -44,6 +44,8 @@
 #include <string>
 #include <sstream>
 
+#include "latency_utils.h"
+
 typedef websocketpp::client<websocketpp::config::asio_tls_client> client;
 typedef websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context> context_ptr;
 
@@ -168,11 +170,26 @@ public:
 
     ~WebSocketManager();
 
-    int Connect(const char* uri, client::connection_type::message_handler mh=NULL);
+    //ch is called once the connection has closed or has failed to open.
+    //The connection is then forgotten, so clients that reconnect (with a
+    //new id) do not pile up closed connections.
+    int Connect(const char* uri, client::connection_type::message_handler mh=NULL, websocketpp::open_handler oh=NULL, websocketpp::close_handler ch=NULL);
     void Close(int id, websocketpp::close::status::value code, std::string reason);
     void Send(int id, std::string message);
+    //Sends len bytes of payload as a text frame, without recording them in
+    //the connection's messages. The payload is copied into the outgoing
+    //frame before the function returns. Returns 0 on success. Like the
+    //other functions, can be called from any thread.
+    int Send(int id, const void* payload, size_t len);
+
+    //Event loop of the sockets, which other clients (e.g. BinanceRestLoop)
+    //can share
+    websocketpp::lib::asio::io_service& GetIOService() {
+        return m_endpoint.get_io_service();
+    }
 
     connection_metadata::ptr GetMetaData(int id) const {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(m_lock);
         con_list::const_iterator metadata_it = m_connection_list.find(id);
         if (metadata_it == m_connection_list.end()) {
             return connection_metadata::ptr();
@@ -183,10 +200,16 @@ public:
 private:
     typedef std::map<int,connection_metadata::ptr> con_list;
 
+    //Removes a closed connection from m_connection_list
+    void Forget(int id);
+
     client m_endpoint;
     websocketpp::lib::shared_ptr<websocketpp::lib::thread> m_thread;
 
     con_list m_connection_list;
     int m_next_id;
+    //Guards m_connection_list and m_next_id, as connections are opened
+    //and used from several threads
+    mutable websocketpp::lib::mutex m_lock;
 };
 #endif
@@ -0,0 +1,141 @@
+#ifndef _BENCH_FEED_
+#define _BENCH_FEED_
+
+#include <cstdio>
+#include <cstdint>
+#include <cinttypes>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <random>
+
+//Shape of a synthetic book. Prices are integer numbers of ticks, written
+//with pricedecimals decimals.
+struct benchprofile
+{
+  const char* name;
+  const char* symbol;
+  const char* ticksize; //For the binfxspec of the ladder books
+  const char* stepsize;
+  int64_t mid; //Initial mid price in ticks
+  int pricedecimals;
+  int qtydecimals;
+  int64_t maxquantity; //In steps
+  int snapshotlevels; //Per side
+  int difflevels; //Mean number of levels changed per side and per diff
+  double distance; //Mean distance of the changed levels to the mid, in ticks
+};
+
+//BTCUSDT perpetual: 0.1 tick and 0.001 step, about 25 levels per side in
+//a 100ms diff
+static const benchprofile bench_btcusdt={"btcusdt", "BTCUSDT", "0.1", "0.001", 430000, 1, 3, 5000, 1000, 24, 40};
+//Small altcoin (DOGEUSDT-like): 0.00001 tick, integer quantities and
+//sparser diffs
+static const benchprofile bench_altcoin={"altcoin", "DOGEUSDT", "0.00001", "1", 8000, 5, 0, 2000000, 1000, 6, 15};
+
+//Generates a USD-M depth snapshot and the diffs chaining from it, with a
+//mid price random walking within 50 ticks of its start. The top of book
+//is kept uncrossed, and a quarter of the changes delete their level.
+class benchfeed
+{
+  public:
+  benchfeed(const benchprofile& profile, const uint64_t& seed=1): fProfile(profile), fRNG(seed), fMid(profile.mid), fLastUpdateID(1000000), fEventTime(1700000000000ULL) {}
+
+  //Snapshot chaining with the next diff
+  std::string Snapshot()
+  {
+    std::string s;
+    char buf[128];
+    s.reserve(fProfile.snapshotlevels*64);
+    snprintf(buf,sizeof(buf),"{\"lastUpdateId\":%" PRIu64 ",\"E\":%" PRIu64 ",\"T\":%" PRIu64 ",\"bids\":[",fLastUpdateID+1,fEventTime,fEventTime);
+    s+=buf;
+
+    for(int i=0; i<fProfile.snapshotlevels; ++i) AppendLevel(s, i, fMid-1-i, Quantity());
+    s+="],\"asks\":[";
+
+    for(int i=0; i<fProfile.snapshotlevels; ++i) AppendLevel(s, i, fMid+i, Quantity());
+    s+="]}";
+    return s;
+  }
+
+  std::string Diff()
+  {
+    std::string s;
+    char buf[256];
+    const uint64_t U=fLastUpdateID+1, u=fLastUpdateID+1+fRNG()%20;
+    fEventTime+=100;
+    snprintf(buf,sizeof(buf),"{\"e\":\"depthUpdate\",\"E\":%" PRIu64 ",\"T\":%" PRIu64 ",\"s\":\"%s\",\"U\":%" PRIu64 ",\"u\":%" PRIu64 ",\"pu\":%" PRIu64 ",\"b\":[",fEventTime,fEventTime-2,fProfile.symbol,U,u,fLastUpdateID);
+    s.reserve(fProfile.difflevels*2*40+256);
+    s+=buf;
+    fLastUpdateID=u;
+    //The level left by the moving mid is emptied on one side and filled
+    //on the other
+    const int move=(int)(fRNG()%3)-1;
+    const int64_t mid=(move<0?(fMid>fProfile.mid-50?fMid-1:fMid):(move>0?(fMid<fProfile.mid+50?fMid+1:fMid):fMid));
+    int n=0;
+
+    if(mid<fMid) AppendLevel(s, n++, mid, 0);
+
+    else if(mid>fMid) AppendLevel(s, n++, fMid, Quantity());
+    const int nbids=Count();
+
+    for(int i=0; i<nbids; ++i) AppendLevel(s, n++, mid-1-Distance(), (fRNG()%4?Quantity():0));
+    s+="],\"a\":[";
+    n=0;
+
+    if(mid<fMid) AppendLevel(s, n++, mid, Quantity());
+
+    else if(mid>fMid) AppendLevel(s, n++, fMid, 0);
+    const int nasks=Count();
+
+    for(int i=0; i<nasks; ++i) AppendLevel(s, n++, mid+Distance(), (fRNG()%4?Quantity():0));
+    s+="]}";
+    fMid=mid;
+    return s;
+  }
+
+  void Diffs(const size_t& n, std::vector<std::string>* diffs){diffs->resize(n); for(size_t i=0; i<n; ++i) (*diffs)[i]=Diff();}
+
+  inline const benchprofile& GetProfile() const {return fProfile;}
+
+  protected:
+  inline int64_t Quantity(){return 1+fRNG()%fProfile.maxquantity;}
+  inline int Count(){return fProfile.difflevels/2+fRNG()%(fProfile.difflevels+1);}
+
+  inline int64_t Distance()
+  {
+    const int64_t d=(int64_t)(-log((fRNG()%1000000+1)/1000001.)*fProfile.distance);
+    return (d<fProfile.snapshotlevels-51?d:fProfile.snapshotlevels-51);
+  }
+
+  void AppendLevel(std::string& s, const int& index, const int64_t& price, const int64_t& quantity)
+  {
+    char buf[96];
+    int len=snprintf(buf,sizeof(buf),"%s[\"",(index?",":""));
+    len+=WriteDecimal(buf+len, price, fProfile.pricedecimals);
+    len+=snprintf(buf+len,sizeof(buf)-len,"\",\"");
+    len+=WriteDecimal(buf+len, quantity, fProfile.qtydecimals);
+    len+=snprintf(buf+len,sizeof(buf)-len,"\"]");
+    s.append(buf, len);
+  }
+
+  static int WriteDecimal(char* buf, const int64_t& value, const int& decimals)
+  {
+    int64_t scale=1;
+
+    for(int i=0; i<decimals; ++i) scale*=10;
+
+    if(!decimals) return sprintf(buf,"%" PRId64,value);
+    return sprintf(buf,"%" PRId64 ".%0*" PRId64,value/scale,decimals,value%scale);
+  }
+
+  const benchprofile& fProfile;
+  std::mt19937_64 fRNG;
+  int64_t fMid;
+  uint64_t fLastUpdateID;
+  uint64_t fEventTime;
+  private:
+};
+
+#endif
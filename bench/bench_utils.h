@@ -0,0 +1,107 @@
+#ifndef _BENCH_UTILS_
+#define _BENCH_UTILS_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cinttypes>
+
+#include <atomic>
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+//Microbenchmark harness: each benchmark runs an operation a fixed number
+//of times and reports the time, the heap allocations and the hardware
+//cache misses (if perf events are available) per operation.
+//This header must only be included by a single translation unit, since it
+//interposes malloc to count the allocations.
+
+static std::atomic<uint64_t> bench_nallocs(0);
+
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t n, size_t size);
+  void* __libc_realloc(void* ptr, size_t size);
+
+  //operator new also ends up here
+  void* malloc(size_t size){bench_nallocs.fetch_add(1, std::memory_order_relaxed); return __libc_malloc(size);}
+  void* calloc(size_t n, size_t size){bench_nallocs.fetch_add(1, std::memory_order_relaxed); return __libc_calloc(n, size);}
+  void* realloc(void* ptr, size_t size){bench_nallocs.fetch_add(1, std::memory_order_relaxed); return __libc_realloc(ptr, size);}
+}
+
+inline static uint64_t bench_now(){struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;}
+
+//Keeps the compiler from optimising a result away
+template<typename T> inline static void bench_keep(const T& value){asm volatile("" : : "r,m"(value) : "memory");}
+
+class benchrunner
+{
+  public:
+  //Results are printed to out. Only the benchmarks whose name contains
+  //filter are run (all if NULL).
+  benchrunner(FILE* out, const char* filter=NULL): fOut(out), fFilter(filter), fPerfFD(-1), fNRun(0)
+  {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type=PERF_TYPE_HARDWARE;
+    attr.size=sizeof(attr);
+    attr.config=PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled=1;
+    attr.exclude_kernel=1;
+    attr.exclude_hv=1;
+    fPerfFD=syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    fprintf(fOut,"%-44s %12s %12s %10s %12s\n","benchmark","ops","ns/op","allocs/op","misses/op");
+  }
+  ~benchrunner(){if(fPerfFD>=0) close(fPerfFD);}
+
+  inline bool Selected(const char* name) const {return (!fFilter || strstr(name, fFilter));}
+
+  //Runs op(i) for i in [0,nops), after nwarmup untimed calls
+  template<typename F> void Run(const char* name, const uint64_t& nops, F op, const uint64_t& nwarmup=0)
+  {
+    if(!Selected(name) || !nops) return;
+    uint64_t i, misses=0;
+
+    for(i=0; i<nwarmup; ++i) op(i);
+
+    if(fPerfFD>=0) {
+      ioctl(fPerfFD, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fPerfFD, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    const uint64_t nallocs=bench_nallocs.load(std::memory_order_relaxed);
+    const uint64_t start=bench_now();
+
+    for(i=0; i<nops; ++i) op(i);
+    const uint64_t elapsed=bench_now()-start;
+    const uint64_t allocs=bench_nallocs.load(std::memory_order_relaxed)-nallocs;
+
+    if(fPerfFD>=0) {
+      ioctl(fPerfFD, PERF_EVENT_IOC_DISABLE, 0);
+
+      if(read(fPerfFD, &misses, sizeof(misses))!=sizeof(misses)) misses=0;
+    }
+    fprintf(fOut,"%-44s %12" PRIu64 " %12.1f %10.2f ",name,nops,(double)elapsed/nops,(double)allocs/nops);
+
+    if(fPerfFD>=0) fprintf(fOut,"%12.2f\n",(double)misses/nops);
+
+    else fprintf(fOut,"%12s\n","n/a");
+    fflush(fOut);
+    ++fNRun;
+  }
+
+  inline int GetNRun() const {return fNRun;}
+
+  protected:
+  FILE* fOut;
+  const char* fFilter;
+  int fPerfFD;
+  int fNRun;
+  private:
+};
+
+#endif
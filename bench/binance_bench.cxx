@@ -0,0 +1,489 @@
+#include <string>
+
+#include <fcntl.h>
+
+#include <json-c/json.h>
+
+#include "depth_parser.h"
+#include "fxdec_utils.h"
+
+#include "BinanceOrderBook.h"
+#include "BinanceEndpoint.h"
+#include "BinanceFeedRecorder.h"
+#include "BinanceWSOrderClient.h"
+
+#include "bench_utils.h"
+#include "bench_feed.h"
+
+//Usage: binance_bench [filter [feedlog|- [config [wsuri [resturi]]]]]
+//Runs the benchmarks whose name contains filter. The library's own
+//messages are discarded, and the results are printed as one line per
+//benchmark. The Parse benchmarks also run on the frames recorded in
+//feedlog (a BinanceFeedRecorder log) if given. The parser's regression
+//cases are checked first, and the exit status is non-zero if any fails.
+//With a config file holding API keys, the RTT benchmarks also time the
+//same signed order.status query, answered by the exchange, over the
+//WebSocket API at wsuri and over REST at resturi (the spot production or
+//testnet servers by default, depending on BINANCE_TESTNET). make bench-rtt
+//runs them against the local stand-in server of ws_standin.py.
+
+#define BENCH_NDIFFS 200000
+#define BENCH_NSNAPSHOTS 200
+#define BENCH_NQUERIES 100000
+#define BENCH_NREQUESTS 20000
+#define BENCH_NBATCH 8
+#define BENCH_NRTT 200
+
+static const char* const bench_booktypes[]={"map", "ladder", "ladder_indexed", "capped"};
+
+//Cumulative quantities of the GetBookAtSum queries, of about 20 levels
+static double bench_sum(const benchprofile& profile){return 20*0.5*profile.maxquantity*pow(10,-profile.qtydecimals);}
+
+//Discards stderr while the library reports the expected errors
+class benchmute
+{
+  public:
+  benchmute(): fSaved(dup(STDERR_FILENO)) {int fd=open("/dev/null", O_WRONLY); fflush(stderr); dup2(fd, STDERR_FILENO); close(fd);}
+  ~benchmute(){fflush(stderr); dup2(fSaved, STDERR_FILENO); close(fSaved);}
+
+  protected:
+  int fSaved;
+  private:
+};
+
+static void bench_books(benchrunner& runner, const benchprofile& profile)
+{
+  benchfeed feed(profile);
+  const std::string snapshot=feed.Snapshot();
+  const std::string first=feed.Diff();
+  std::vector<std::string> diffs;
+  feed.Diffs(BENCH_NDIFFS, &diffs);
+  const double sum=bench_sum(profile);
+  char name[128];
+  //Books have no offline entry point other than a replayed feed log: the
+  //first diff is buffered, then the snapshot applies it
+  char path[64];
+  snprintf(path,sizeof(path),"/tmp/binance_bench.%d.log",(int)getpid());
+  {
+    BinanceFeedRecorder recorder(path);
+    recorder.Record(feed_frame, 0, 0, first.data(), first.size());
+    recorder.Record(feed_snapshot, 0, 0, snapshot.data(), snapshot.size());
+  }
+
+  for(int type=binance_book_map; type<=binance_book_capped; ++type) {
+    BinanceOrderBook book(NULL, binance_usdm_future, profile.symbol, 0, type, binfxspec(profile.ticksize, profile.stepsize));
+    BinanceFeedReplay replay(path);
+    replay.AddBook(0, &book);
+
+    snprintf(name,sizeof(name),"LoadSnapshot/%s/%s",profile.name,bench_booktypes[type]);
+    runner.Run(name, BENCH_NSNAPSHOTS, [&](const uint64_t&){book.Init(); replay.Run();});
+
+    book.Init();
+    replay.Run();
+
+    if(book.IsStale()) {
+      fprintf(stderr,"%s: Error: The %s book could not be loaded!\n",__func__,name);
+      continue;
+    }
+
+    snprintf(name,sizeof(name),"OnPayload/%s/%s",profile.name,bench_booktypes[type]);
+    runner.Run(name, diffs.size(), [&](const uint64_t& i){book.OnPayload(diffs[i].data(), diffs[i].size());});
+
+    //A diff that moved a level out of a capped window would leave the book
+    //waiting for a snapshot, and the remaining diffs would only be buffered
+    if(book.IsStale()) fprintf(stderr,"%s: Error: The %s book got out of sync, its results are invalid!\n",__func__,name);
+    bookvec bids, asks;
+    //GetBookAtSum waits for an update when the sums are not larger than the
+    //previous ones, so they are increased slightly at each call
+    snprintf(name,sizeof(name),"GetBookAtSum/%s/%s",profile.name,bench_booktypes[type]);
+    runner.Run(name, BENCH_NQUERIES, [&](const uint64_t& i){bench_keep(book.GetBookAtSum(sum*(1+i*1e-12), sum*(1+i*1e-12), {1,0}, &bids, &asks));});
+
+    snprintf(name,sizeof(name),"GetViewBookAtSum/%s/%s",profile.name,bench_booktypes[type]);
+    runner.Run(name, BENCH_NQUERIES, [&](const uint64_t&){bench_keep(book.GetViewBookAtSum(sum*0.25, sum*0.25, &bids, &asks));});
+
+    if(type!=binance_book_map) continue;
+    //The GetAverage* helpers are only book-type independent
+    book.GetBookAtSum(sum*2, sum*2, {1,0}, &bids, &asks);
+    const double amount=sum*profile.mid*pow(10,-profile.pricedecimals);
+
+    snprintf(name,sizeof(name),"GetAverageAskPriceAtQuantity/%s",profile.name);
+    runner.Run(name, BENCH_NQUERIES, [&](const uint64_t&){bench_keep(BinanceOrderBook::GetAverageAskPriceAtQuantity(asks, sum));});
+
+    snprintf(name,sizeof(name),"GetAverageBidPriceAtQuantity/%s",profile.name);
+    runner.Run(name, BENCH_NQUERIES, [&](const uint64_t&){bench_keep(BinanceOrderBook::GetAverageBidPriceAtQuantity(bids, sum));});
+
+    snprintf(name,sizeof(name),"GetAverageAskPriceAtOrderQuantity/%s",profile.name);
+    runner.Run(name, BENCH_NQUERIES, [&](const uint64_t&){bench_keep(BinanceOrderBook::GetAverageAskPriceAtOrderQuantity(asks, amount));});
+
+    snprintf(name,sizeof(name),"GetAverageBidPriceAtOrderQuantity/%s",profile.name);
+    runner.Run(name, BENCH_NQUERIES, [&](const uint64_t&){bench_keep(BinanceOrderBook::GetAverageBidPriceAtOrderQuantity(bids, amount));});
+  }
+  unlink(path);
+}
+
+//Decimals of the fixed-point values parsed by the Parse benchmarks, as
+//carried by the exchange's strings
+#define BENCH_PARSE_DECIMALS 8
+
+//Digit by digit fxparse, against which its 8-digit path is checked
+static fxint bench_fxparse(const char* str, const size_t& len, const int& decimals)
+{
+  const char* const end=str+len;
+  const fxint sign=(len && *str=='-'?-1:1);
+  fxint value=0;
+  int nd=-1;
+  str+=(sign<0);
+
+  for(; str<end && nd<decimals; ++str) {
+
+    if(*str=='.' && nd<0) nd=0;
+
+    else if((uint8_t)(*str-'0')<10) {
+      value=value*10+(*str-'0');
+
+      if(nd>=0) ++nd;
+
+    } else break;
+  }
+  return sign*value*_fx_pow10[decimals-(nd<0?0:nd)];
+}
+
+//Levels of a depthUpdate as parsed by json-c, the reference of depth_scan
+struct benchdepth
+{
+  uint64_t U, u;
+  std::vector<std::string> levels[2]; //Bids then asks, as price and quantity pairs
+};
+
+static int bench_jsondepth(json_tokener* tok, const std::string& msg, benchdepth* bd)
+{
+  json_tokener_reset(tok);
+  json_object* jobj=json_tokener_parse_ex(tok, msg.data(), msg.size());
+  json_object* val;
+  const char* const sides[2]={"b", "a"};
+
+  if(!jobj || json_tokener_get_error(tok)!=json_tokener_success) {
+
+    if(jobj) json_object_put(jobj);
+    return -1;
+  }
+  bd->U=(json_object_object_get_ex(jobj, "U", &val)?json_object_get_int64(val):0);
+  bd->u=(json_object_object_get_ex(jobj, "u", &val)?json_object_get_int64(val):0);
+
+  for(int s=0; s<2; ++s) {
+    bd->levels[s].clear();
+
+    if(!json_object_object_get_ex(jobj, sides[s], &val)) continue;
+
+    for(size_t i=0; i<json_object_array_length(val); ++i) {
+      json_object* level=json_object_array_get_idx(val, i);
+
+      for(size_t j=0; j<2; ++j) {
+	json_object* str=json_object_array_get_idx(level, j);
+	bd->levels[s].push_back(std::string(json_object_get_string(str), json_object_get_string_len(str)));
+      }
+    }
+  }
+  json_object_put(jobj);
+  return 0;
+}
+
+//Regression cases of depth_scan and fxparse. Each payload is checked with
+//0 to 31 spaces inserted after its opening brace, so that its numbers and
+//keys straddle the 16-byte chunks of scan_find2 and the 8-byte loads of
+//fxparse, and each of its truncations must be rejected.
+static const char* const bench_validdiffs[]={
+  //8 decimals, parsed 8 digits at a time
+  "{\"e\":\"depthUpdate\",\"E\":1700000000000,\"T\":1700000000000,\"s\":\"BTCUSDT\",\"U\":100,\"u\":105,\"pu\":99,\"b\":[[\"43000.10000000\",\"1.23400000\"],[\"42999.90000000\",\"0.00000001\"]],\"a\":[[\"43000.20000000\",\"12.50000000\"]]}",
+  //Fewer and more than 8 decimals, and integers
+  "{\"e\":\"depthUpdate\",\"E\":1,\"s\":\"DOGEUSDT\",\"U\":7,\"u\":7,\"b\":[[\"0.1\",\"2\"],[\"7\",\"0.1234567\"],[\"0.12345678\",\"-1.5\"]],\"a\":[[\"123456789.123456789\",\"0.000000019\"],[\"1.2345678x\",\"10.\"]]}",
+  //Empty level arrays
+  "{\"e\":\"depthUpdate\",\"U\":1,\"u\":2,\"b\":[],\"a\":[]}",
+  "{\"e\":\"depthUpdate\",\"U\":1,\"u\":2,\"b\":[ ],\"a\":[\n]}",
+  "{\"e\":\"depthUpdate\",\"U\":1,\"u\":2,\"a\":[[\"1.0\",\"0.0\"]],\"b\":[]}",
+  //Escaped keys and values, which must not be taken for the fields
+  "{\"e\":\"depthUpdate\",\"s\\\"b\":\"x\\\"],\",\"\\\\\":[1,{\"b\":[]}],\"\\\":\":\"U\",\"U\":1,\"u\":2,\"b\":[[\"1.5\",\"2.5\"]],\"a\":[]}",
+  //Whitespace between all tokens
+  "{ \"U\" : 3 , \"u\" : 4 , \"b\" : [ [ \"1.0\" , \"2.0\" ] , [\"0.5\",\"1\"] ] , \"a\" : [ ] }"
+};
+
+//Malformed levels, which must be rejected before any of them is applied
+static const char* const bench_invaliddiffs[]={
+  "{\"U\":1,\"u\":2,\"b\":[[\"1.0\",\"2.0\"],[\"1.1\"]],\"a\":[]}",
+  "{\"U\":1,\"u\":2,\"b\":[[\"1.0\",\"2.0\"]x],\"a\":[]}",
+  "{\"U\":1,\"u\":2,\"b\":[[\"1.0\",2.0]],\"a\":[]}",
+  "{\"U\":1,\"u\":2,\"b\":[],\"a\":[[\"1\\\"0\",\"2.0\"]]}",
+  "{\"U\":1,\"u\":2,\"b\":[[\"1.0\",\"2.0\"],],\"a\":[]}",
+  "{\"U\":1,\"u\":2,\"b\":[[]],\"a\":[]}",
+  "{\"U\":1,\"u\":2,\"b\":[[\"1.0\",\"2.0\",\"3.0\"]],\"a\":[]}",
+  "{\"U\":1,\"u\":2,\"b\":[[\"1.0\",\"2.0\"]],\"a\":[[\"1.0\",\"2.0\"]]"
+};
+
+//Returns the number of failed cases
+static int bench_parser_checks()
+{
+  json_tokener* tok=json_tokener_new();
+  benchdepth bd;
+  depthupdate du;
+  int nfailed=0;
+
+  for(size_t c=0; c<sizeof(bench_validdiffs)/sizeof(bench_validdiffs[0]); ++c) {
+
+    for(int pad=0; pad<32; ++pad) {
+      const std::string msg=std::string("{")+std::string(pad, ' ')+(bench_validdiffs[c]+1);
+      const char* const end=msg.data()+msg.size();
+      std::vector<std::string> levels[2];
+      bool failed=(bench_jsondepth(tok, msg, &bd) || depth_scan(msg.data(), msg.size(), &du) || du.U!=bd.U || du.u!=bd.u);
+
+      for(int s=0; s<2 && !failed; ++s) {
+	const char* const array=(s?du.asks:du.bids);
+
+	if(array && depth_levels(array, end, [&](const char* price, const size_t& plen, const char* quantity, const size_t& qlen){levels[s].push_back(std::string(price, plen)); levels[s].push_back(std::string(quantity, qlen));})<0) failed=true;
+
+	if(levels[s]!=bd.levels[s]) failed=true;
+
+	for(size_t i=0; i<levels[s].size() && !failed; ++i) for(int d=0; d<=BENCH_PARSE_DECIMALS; ++d) if(fxparse(levels[s][i].data(), levels[s][i].size(), d)!=bench_fxparse(levels[s][i].data(), levels[s][i].size(), d)) {
+	  fprintf(stderr,"%s: Error: fxparse(\"%s\", %i) returned %" PRId64 " instead of %" PRId64 "\n",__func__,levels[s][i].c_str(),d,fxparse(levels[s][i].data(), levels[s][i].size(), d),bench_fxparse(levels[s][i].data(), levels[s][i].size(), d));
+	  failed=true;
+	  break;
+	}
+      }
+
+      for(size_t len=0; len<msg.size() && !failed; ++len) if(!depth_scan(msg.data(), len, &du)) {
+	fprintf(stderr,"%s: Error: Accepted the first %zu bytes of '%s'\n",__func__,len,msg.c_str());
+	failed=true;
+      }
+
+      if(failed) {
+	fprintf(stderr,"%s: Error: Failed on '%s'\n",__func__,msg.c_str());
+	++nfailed;
+      }
+    }
+  }
+
+  for(size_t c=0; c<sizeof(bench_invaliddiffs)/sizeof(bench_invaliddiffs[0]); ++c) {
+
+    for(int pad=0; pad<32; ++pad) {
+      const std::string msg=std::string("{")+std::string(pad, ' ')+(bench_invaliddiffs[c]+1);
+
+      if(!depth_scan(msg.data(), msg.size(), &du)) {
+	fprintf(stderr,"%s: Error: Accepted '%s'\n",__func__,msg.c_str());
+	++nfailed;
+      }
+    }
+  }
+  json_tokener_free(tok);
+  return nfailed;
+}
+
+//Parses the diffs with json-c, as _OnMessage used to, and with depth_scan.
+//Both read the update IDs and parse every level into fixed-point values.
+static void bench_parser(benchrunner& runner, const char* source, const std::vector<std::string>& diffs)
+{
+  json_tokener* tok=json_tokener_new();
+  const char* const sides[2]={"b", "a"};
+  fxint sums[2]={0, 0};
+  char jsonname[128], scanname[128];
+  snprintf(jsonname,sizeof(jsonname),"Parse/json-c/%s",source);
+  snprintf(scanname,sizeof(scanname),"Parse/depth_scan/%s",source);
+
+  runner.Run(jsonname, diffs.size(), [&](const uint64_t& i){
+      json_object* jobj=json_tokener_parse_ex(tok, diffs[i].data(), diffs[i].size());
+      json_object *val, *level, *pobj, *qobj;
+
+      if(jobj && json_object_object_get_ex(jobj, "u", &val)) {
+	sums[0]+=json_object_get_int64(val);
+
+	for(int s=0; s<2; ++s) if(json_object_object_get_ex(jobj, sides[s], &val)) {
+
+	  for(size_t j=0; j<json_object_array_length(val); ++j) {
+	    level=json_object_array_get_idx(val, j);
+	    pobj=json_object_array_get_idx(level, 0);
+	    qobj=json_object_array_get_idx(level, 1);
+	    sums[0]+=fxparse(json_object_get_string(pobj), json_object_get_string_len(pobj), BENCH_PARSE_DECIMALS);
+	    sums[0]+=fxparse(json_object_get_string(qobj), json_object_get_string_len(qobj), BENCH_PARSE_DECIMALS);
+	  }
+	}
+      }
+
+      if(jobj) json_object_put(jobj);
+      json_tokener_reset(tok);
+      });
+
+  runner.Run(scanname, diffs.size(), [&](const uint64_t& i){
+      depthupdate du;
+      const char* const end=diffs[i].data()+diffs[i].size();
+
+      if(!depth_scan(diffs[i].data(), diffs[i].size(), &du) && du.hasu) {
+	sums[1]+=du.u;
+
+	for(int s=0; s<2; ++s) {
+	  const char* const array=(s?du.asks:du.bids);
+
+	  if(array) depth_levels(array, end, [&](const char* price, const size_t& plen, const char* quantity, const size_t& qlen){
+	      sums[1]+=fxparse(price, plen, BENCH_PARSE_DECIMALS);
+	      sums[1]+=fxparse(quantity, qlen, BENCH_PARSE_DECIMALS);
+	      });
+	}
+      }
+      });
+
+  if(runner.Selected(jsonname) && runner.Selected(scanname) && sums[0]!=sums[1]) fprintf(stderr,"%s: Error: json-c and depth_scan disagree on %s!\n",__func__,source);
+  json_tokener_free(tok);
+}
+
+//Collects the frames of a feed log
+static int bench_collectframes(const feedrecord& record, const char* data, void* userdata)
+{
+  if(record.type==feed_frame) ((std::vector<std::string>*)userdata)->push_back(std::string(data, record.length));
+  return 0;
+}
+
+static void bench_endpoint(benchrunner& runner)
+{
+  const char* const key="vmPUZE6mv9SD5VNHk4HlWFsOr6aKE2zvsw0MuIgwCIPy6utIco14y7Ju91duEh8A";
+  const char* const secret="NhqPtmdSJYdKjVHjA7PZj4Mge3R5YNiP1e3UZjInClVN65XAbvqqM6A7H5fATj0j";
+  char path[64];
+  snprintf(path,sizeof(path),"/tmp/binance_bench.%d.json",(int)getpid());
+  FILE* fconf=fopen(path, "w");
+
+  if(!fconf) {
+    perror(__func__);
+    return;
+  }
+  fprintf(fconf,"{\"apiKey\":\"%s\",\"secretKey\":\"%s\"}\n",key,secret);
+  fclose(fconf);
+  BinanceEndpoint endpoint(path);
+  unlink(path);
+  //The request is built and signed, and curl rejects the unsupported
+  //scheme before any network access
+  const bintype local(255, "bench://127.0.0.1/fapi/v1/", "");
+  const std::string query="symbol=BTCUSDT&limit=500";
+  const std::string order="symbol=BTCUSDT&side=BUY&type=LIMIT&timeInForce=GTC&quantity=0.010&price=43000.10&newClientOrderId=bench1234567890";
+  {
+    benchmute mute;
+    runner.Run("Request/GET", BENCH_NREQUESTS, [&](const uint64_t&){endpoint.Request(local, binping);}, 100);
+    runner.Run("Request/GET signed", BENCH_NREQUESTS, [&](const uint64_t&){endpoint.Request(local, binopenorders, query, binepsign_true);}, 100);
+    runner.Run("Request/POST signed", BENCH_NREQUESTS, [&](const uint64_t&){endpoint.Request(local, binorder, order, binepsign_true);}, 100);
+  }
+  //Same order, built from its fields by hand or by binneworder
+  const binfxspec fx(0.10, 0.001);
+  binneworder neworder("BTCUSDT", binside_buy, binordertype_limit, bintif_gtc, 10, 430001, fx);
+  neworder.clientorderid="bench1234567890";
+  char orderbuf[BIN_ORDER_MAXFIXED+64];
+  runner.Run("Order/string concatenation", BENCH_NQUERIES, [&](const uint64_t&){
+      char num[32];
+      std::string args="symbol=";
+      args+=neworder.symbol;
+      args+="&side=BUY&type=LIMIT&timeInForce=GTC&quantity=";
+      snprintf(num,sizeof(num),"%.*f",fx.qtydecimals,fx.QuantityToDouble(neworder.quantity));
+      args+=num;
+      args+="&price=";
+      snprintf(num,sizeof(num),"%.*f",fx.pricedecimals,fx.PriceToDouble(neworder.price));
+      args+=num;
+      args+="&newClientOrderId=";
+      args+=neworder.clientorderid;
+      bench_keep(args.data()[0]);
+      });
+  runner.Run("Order/binneworder", BENCH_NQUERIES, [&](const uint64_t&){bench_keep(neworder.Serialize(orderbuf));});
+  {
+    benchmute mute;
+    runner.Run("Request/POST signed binneworder", BENCH_NREQUESTS, [&](const uint64_t&){endpoint.Request(local, neworder);}, 100);
+  }
+  const std::string signedquery=order+"&timestamp=1700000000000";
+  unsigned char sig[EVP_MAX_MD_SIZE];
+  unsigned int siglen;
+  runner.Run("HMAC-SHA256/order", BENCH_NQUERIES, [&](const uint64_t&){siglen=EVP_MAX_MD_SIZE; bench_keep(mx_hmac_sha256((const unsigned char*)secret, strlen(secret), signedquery.data(), signedquery.size(), sig, &siglen));}, 1000);
+
+  const hmacsigner signer(secret, strlen(secret));
+  char hex[BENCH_NBATCH*HMAC_SHA256_HEXLENGTH];
+  runner.Run("HMAC-SHA256/order pre-keyed", BENCH_NQUERIES, [&](const uint64_t&){signer.Sign(signedquery.data(), signedquery.size(), sig); bench_keep(sig[0]);}, 1000);
+  runner.Run("HMAC-SHA256/order pre-keyed hex", BENCH_NQUERIES, [&](const uint64_t&){signer.SignHex(signedquery.data(), signedquery.size(), hex); bench_keep(hex[0]);}, 1000);
+
+  //Batch of orders differing by their client id, timed per order
+  std::string orders[BENCH_NBATCH];
+  const void* data[BENCH_NBATCH];
+  size_t lens[BENCH_NBATCH];
+
+  for(int i=0; i<BENCH_NBATCH; ++i) {
+    orders[i]=signedquery+std::to_string(i);
+    data[i]=orders[i].data();
+    lens[i]=orders[i].size();
+  }
+  runner.Run("HMAC-SHA256/order pre-keyed batch", BENCH_NQUERIES, [&](const uint64_t& i){
+
+      if(i%BENCH_NBATCH==0) {
+	signer.SignHexBatch(BENCH_NBATCH, data, lens, hex);
+	bench_keep(hex[0]);
+      }
+      }, 1000);
+
+  //Encoding of a signature
+  runner.Run("Hex/nibble table", BENCH_NQUERIES, [&](const uint64_t&){
+
+      for(int i=0; i<HMAC_SHA256_LENGTH; ++i) {
+	hex[2*i]=uint4toasciihex(sig[i]>>4);
+	hex[2*i+1]=uint4toasciihex(sig[i] & 0xF);
+      }
+      bench_keep(hex[0]);
+      });
+  runner.Run("Hex/bytestoasciihex", BENCH_NQUERIES, [&](const uint64_t&){bytestoasciihex(sig, HMAC_SHA256_LENGTH, hex); bench_keep(hex[0]);});
+}
+
+//Sequential round trips of the same query over each path. The order does
+//not exist, so each of them is answered with the same error.
+static void bench_rtt(benchrunner& runner, const char* config, const char* wsuri, const char* resturi)
+{
+  if(!runner.Selected("RTT/")) return;
+  WebSocketManager manager;
+  BinanceWSOrderClient client(&manager, config, bin_spot);
+
+  if(client.Launch(wsuri) || client.WaitOpen(10000)) {
+    fprintf(stderr,"%s: Error: Could not open the WebSocket API session!\n",__func__);
+    return;
+  }
+  const bintype rest(bin_spot.id, (resturi?resturi:bin_spot.ep.c_str()), bin_spot.ws.c_str());
+  const binqueryorder query("BTCUSDT", (int64_t)1);
+  runner.Run("RTT/ws order.status", BENCH_NRTT, [&](const uint64_t&){binresponse response=client.Submit(query).get(); json_object_put(response.jobj);}, 10);
+  runner.Run("RTT/rest order.status", BENCH_NRTT, [&](const uint64_t&){client.GetEndpoint().Request(rest, query);}, 10);
+  client.Stop();
+}
+
+int main(int argc, char** argv)
+{
+  //The results go to the original stdout, and the library's messages to
+  ///dev/null
+  FILE* out=fdopen(dup(STDOUT_FILENO), "w");
+
+  if(!out || !freopen("/dev/null", "w", stdout)) {
+    perror(__func__);
+    return 1;
+  }
+  benchrunner runner(out, (argc>1?argv[1]:NULL));
+  const int nfailed=bench_parser_checks();
+
+  if(nfailed) fprintf(stderr,"%s: Error: %i parser regression cases failed!\n",__func__,nfailed);
+  const benchprofile* const profiles[2]={&bench_btcusdt, &bench_altcoin};
+  std::vector<std::string> diffs;
+
+  for(int i=0; i<2; ++i) {
+    benchfeed feed(*profiles[i]);
+    feed.Diffs(BENCH_NQUERIES, &diffs);
+    bench_parser(runner, profiles[i]->name, diffs);
+  }
+
+  if(argc>2 && strcmp(argv[2], "-")) {
+    diffs.clear();
+    BinanceFeedReplay replay(argv[2]);
+
+    if(replay.Run(0, bench_collectframes, &diffs)<0) fprintf(stderr,"%s: Error: %s is corrupted!\n",__func__,argv[2]);
+    bench_parser(runner, "feedlog", diffs);
+  }
+  bench_books(runner, bench_btcusdt);
+  bench_books(runner, bench_altcoin);
+  bench_endpoint(runner);
+
+  if(argc>3) bench_rtt(runner, argv[3], (argc>4?argv[4]:NULL), (argc>5?argv[5]:NULL));
+  fclose(out);
+  return (!nfailed && runner.GetNRun()?0:1);
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+#Usage: ws_standin.py config [port [--plain]]
+#Local stand-in for the order endpoints of Binance's WebSocket API and REST
+#API, against which BinanceWSOrderClient and BinanceEndpoint can be tested
+#and their round trips compared (see the RTT benchmarks of binance_bench).
+#The WebSocket API is served on port (18090 by default) and REST on port+1.
+#WebSocketManager only has a TLS transport, so the WebSocket API is served
+#over TLS with a throwaway self-signed certificate, unless --plain is given.
+#curl verifies certificates, so REST is served over plain HTTP: the REST
+#round trips are thus spared the encryption the WebSocket ones pay.
+#The API keys are read from config (created with test keys if missing),
+#and the signature of every request is checked as Binance does. Orders are
+#accepted and given increasing ids; queries and cancels of any other order
+#fail with Binance's -2013 error.
+import asyncio, base64, hashlib, hmac, json, os, ssl, struct, subprocess, sys, tempfile, time
+
+TESTKEY='vmPUZE6mv9SD5VNHk4HlWFsOr6aKE2zvsw0MuIgwCIPy6utIco14y7Ju91duEh8A'
+TESTSECRET='NhqPtmdSJYdKjVHjA7PZj4Mge3R5YNiP1e3UZjInClVN65XAbvqqM6A7H5fATj0j'
+WSGUID='258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+class Exchange:
+    def __init__(self, key, secret):
+        self.key=key
+        self.secret=secret.encode()
+        self.orders={}
+        self.nextid=1
+
+    #Returns the HTTP status and the result (or error) of a request, whose
+    #signature is that of base
+    def Handle(self, method, params, key, base, signature):
+        if key!=self.key:
+            return 401, {'code': -2015, 'msg': 'Invalid API-key, IP, or permissions for action.'}
+
+        if hmac.new(self.secret, base.encode(), hashlib.sha256).hexdigest()!=signature:
+            return 400, {'code': -1022, 'msg': 'Signature for this request is not valid.'}
+
+        if method=='order.place':
+            order={'symbol': params.get('symbol'), 'orderId': self.nextid, 'clientOrderId': params.get('newClientOrderId', 'standin%i'%self.nextid), 'transactTime': int(time.time()*1000), 'status': 'NEW'}
+            self.orders[self.nextid]=order
+            self.nextid+=1
+            return 200, order
+        order=self.orders.get(int(params.get('orderId', params.get('cancelOrderId', 0))))
+
+        if not order:
+            return 400, {'code': -2013, 'msg': 'Order does not exist.'}
+
+        if method in ('order.cancel', 'order.cancelReplace'):
+            del self.orders[order['orderId']]
+            order=dict(order, status='CANCELED')
+        return 200, order
+
+#REST paths of the WebSocket API methods
+RESTMETHODS={('POST', 'order'): 'order.place', ('DELETE', 'order'): 'order.cancel', ('GET', 'order'): 'order.status', ('POST', 'order/cancelReplace'): 'order.cancelReplace'}
+
+async def WSSession(exchange, reader, writer):
+    head=(await reader.readuntil(b'\r\n\r\n')).decode()
+    key=[l.split(':', 1)[1].strip() for l in head.split('\r\n') if l.lower().startswith('sec-websocket-key:')]
+
+    if not key:
+        writer.close()
+        return
+    accept=base64.b64encode(hashlib.sha1((key[0]+WSGUID).encode()).digest()).decode()
+    writer.write(('HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n'%accept).encode())
+
+    while True:
+        try:
+            h=await reader.readexactly(2)
+            n=h[1]&0x7f
+
+            if n==126: n=struct.unpack('>H', await reader.readexactly(2))[0]
+
+            elif n==127: n=struct.unpack('>Q', await reader.readexactly(8))[0]
+            mask=await reader.readexactly(4) if h[1]&0x80 else b'\0\0\0\0'
+            data=bytes(b^mask[i%4] for i, b in enumerate(await reader.readexactly(n)))
+
+        except (asyncio.IncompleteReadError, ConnectionError):
+            return
+        opcode=h[0]&0xf
+
+        if opcode==8:
+            WSFrame(writer, 8, data[:2])
+            writer.close()
+            return
+
+        if opcode==9:
+            WSFrame(writer, 10, data)
+            continue
+
+        if opcode!=1: continue
+        req=json.loads(data)
+        params=dict(req.get('params', {}))
+        signature=params.pop('signature', None)
+        #The parameters are signed in alphabetical order
+        base='&'.join('%s=%s'%(k, params[k]) for k in sorted(params))
+        status, result=exchange.Handle(req.get('method'), params, params.get('apiKey'), base, signature)
+        WSFrame(writer, 1, json.dumps({'id': req.get('id'), 'status': status, ('result' if status==200 else 'error'): result}).encode())
+        await writer.drain()
+
+def WSFrame(writer, opcode, payload):
+    n=len(payload)
+    header=bytes([0x80|opcode])+(bytes([n]) if n<126 else bytes([126])+struct.pack('>H', n) if n<65536 else bytes([127])+struct.pack('>Q', n))
+    writer.write(header+payload)
+
+async def RESTSession(exchange, reader, writer):
+    while True:
+        try:
+            head=(await reader.readuntil(b'\r\n\r\n')).decode()
+
+        except (asyncio.IncompleteReadError, ConnectionError):
+            return
+        lines=head.split('\r\n')
+        verb, target, _=lines[0].split(' ')
+        headers={l.split(':', 1)[0].lower(): l.split(':', 1)[1].strip() for l in lines[1:] if ':' in l}
+        body=(await reader.readexactly(int(headers['content-length']))).decode() if 'content-length' in headers else ''
+        path, _, query=target.partition('?')
+        query='&'.join(q for q in (query, body) if q)
+        base, _, signature=query.rpartition('&signature=')
+        params=dict(p.split('=', 1) for p in base.split('&') if p)
+        method=RESTMETHODS.get((verb, path.rsplit('/api/v3/', 1)[-1]))
+
+        if method: status, result=exchange.Handle(method, params, headers.get('x-mbx-apikey'), base, signature)
+
+        else: status, result=404, {'code': -1, 'msg': 'Unknown path %s'%path}
+        out=json.dumps(result).encode()
+        writer.write(b'HTTP/1.1 %d %s\r\nContent-Type: application/json;charset=UTF-8\r\nContent-Length: %d\r\n\r\n'%(status, b'OK' if status==200 else b'ERROR', len(out))+out)
+        await writer.drain()
+
+async def Main():
+    args=[a for a in sys.argv[1:] if a!='--plain']
+
+    if not args:
+        sys.exit('Usage: %s config [port [--plain]]'%sys.argv[0])
+    config=args[0]
+    port=int(args[1]) if len(args)>1 else 18090
+
+    if not os.path.exists(config):
+        with open(config, 'w') as f: json.dump({'apiKey': TESTKEY, 'secretKey': TESTSECRET}, f)
+
+    with open(config) as f: keys=json.load(f)
+    exchange=Exchange(keys['apiKey'], keys['secretKey'])
+    context=None
+
+    if '--plain' not in sys.argv:
+        certdir=tempfile.mkdtemp()
+        cert=os.path.join(certdir, 'standin.pem')
+        subprocess.run(['openssl', 'req', '-x509', '-newkey', 'rsa:2048', '-nodes', '-subj', '/CN=127.0.0.1', '-days', '1', '-keyout', cert, '-out', cert], check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        context=ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(cert)
+        os.unlink(cert)
+        os.rmdir(certdir)
+    await asyncio.start_server(lambda r, w: WSSession(exchange, r, w), '127.0.0.1', port, ssl=context)
+    await asyncio.start_server(lambda r, w: RESTSession(exchange, r, w), '127.0.0.1', port+1)
+    print('Serving the WebSocket API on %s://127.0.0.1:%i/ws-api/v3 and REST on http://127.0.0.1:%i/api/v3/'%('ws' if context is None else 'wss', port, port+1), flush=True)
+    await asyncio.Future()
+
+asyncio.run(Main())
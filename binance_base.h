@@ -15,6 +15,13 @@
 #define BINANCE_USDM_FUTURE_WS_BASEURI "wss://fstream.binance.com/ws/"
 #define BINANCE_COINM_FUTURE_WS_BASEURI "wss://dstream.binance.com/ws/"
 
+#define BINANCE_SPOT_WS_STREAM_BASEURI "wss://stream.binance.com:9443/stream?streams="
+#define BINANCE_USDM_FUTURE_WS_STREAM_BASEURI "wss://fstream.binance.com/stream?streams="
+#define BINANCE_COINM_FUTURE_WS_STREAM_BASEURI "wss://dstream.binance.com/stream?streams="
+
+#define BINANCE_SPOT_WS_API_URI "wss://ws-api.binance.com:443/ws-api/v3"
+#define BINANCE_USDM_FUTURE_WS_API_URI "wss://ws-fapi.binance.com/ws-fapi/v1"
+
 #else
 #define BINANCE_SPOT_BASEURI "https://testnet.binance.vision/api/v3/"
 #define BINANCE_SPOT_ALT_BASEURI "https://testnet.binance.vision/sapi/v1/"
@@ -24,8 +31,26 @@
 #define BINANCE_SPOT_WS_BASEURI "wss:///testnet.binance.vision/ws/"
 #define BINANCE_USDM_FUTURE_WS_BASEURI "wss://stream.binancefuture.com/ws/"
 #define BINANCE_COINM_FUTURE_WS_BASEURI "wss://dstream.binancefuture.com/ws/"
+
+#define BINANCE_SPOT_WS_STREAM_BASEURI "wss://testnet.binance.vision/stream?streams="
+#define BINANCE_USDM_FUTURE_WS_STREAM_BASEURI "wss://stream.binancefuture.com/stream?streams="
+#define BINANCE_COINM_FUTURE_WS_STREAM_BASEURI "wss://dstream.binancefuture.com/stream?streams="
+
+#define BINANCE_SPOT_WS_API_URI "wss://ws-api.testnet.binance.vision/ws-api/v3"
+#define BINANCE_USDM_FUTURE_WS_API_URI "wss://testnet.binancefuture.com/ws-fapi/v1"
 #endif
 
+//Maximum number of streams on a single combined stream connection
+#define BINANCE_SPOT_MAX_STREAMS 1024
+#define BINANCE_FUTURE_MAX_STREAMS 200
+
+//Delays before reconnecting a closed or failed WebSocket connection, in ms.
+//The delay doubles with each failed attempt, up to the maximum.
+#define BINANCE_WS_RECONNECT_MINDELAY 250
+#define BINANCE_WS_RECONNECT_MAXDELAY 30000
+
+inline static int binreconnectdelay(const int& attempts){return (attempts<8 && (BINANCE_WS_RECONNECT_MINDELAY<<attempts)<BINANCE_WS_RECONNECT_MAXDELAY?BINANCE_WS_RECONNECT_MINDELAY<<attempts:BINANCE_WS_RECONNECT_MAXDELAY);}
+
 inline static uint64_t getmstime() {
   struct timeval tv;
   gettimeofday(&tv, NULL);
@@ -58,6 +83,7 @@ inline static bool operator==(const bintype& lhs, const bintype& rhs){return (lh
 enum binepsign {binepsign_false=false, binepsign_true=true, binepsign_apikey};
 
 enum bineptype {bieneptype_get, bieneptype_post, bieneptype_put, bieneptype_delete};
+#define BIN_EP_NTYPES (bieneptype_delete+1)
 
 struct binep
 {
@@ -0,0 +1,233 @@
+#ifndef _BINANCEORDERS_
+#define _BINANCEORDERS_
+
+#include <cstring>
+#include <cstdint>
+
+#include <string>
+
+#include "binance_base.h"
+#include "conv_utils.h"
+#include "fxdec_utils.h"
+
+//Typed order-entry requests. Each request type carries its endpoint, HTTP
+//verb and signing mode as a constexpr descriptor, so BinanceEndpoint's
+//Request template resolves them at compile time, and serializes its
+//fields straight into the request buffer. Prices and quantities are
+//fixed-point values written with the decimals of the symbol's binfxspec,
+//so they are never rounded through a double. Optional fields are left out
+//when zero or NULL. The strings are not copied and must outlive the
+//Request call. The same types are sent by BinanceWSOrderClient.
+
+//Constant endpoint descriptor. cmd is relative to the bintype's base URI,
+//and wsmethod is the equivalent WebSocket API method.
+struct binepdesc
+{
+  const char* cmd;
+  size_t cmdlen;
+  bineptype type;
+  binepsign sign;
+  const char* wsmethod;
+};
+
+#define BIN_EPDESC(cmd, type, sign, wsmethod) binepdesc{cmd, sizeof(cmd)-1, type, sign, wsmethod}
+
+//Room taken by the fixed parts of an order query: names, enum values and
+//formatted numbers, with some margin
+#define BIN_ORDER_MAXFIXED 512
+
+//String constant with its length
+struct binstr
+{
+  const char* str;
+  size_t len;
+};
+
+#define BIN_STR(str) binstr{str, sizeof(str)-1}
+
+enum binside {binside_buy, binside_sell};
+const binstr binside_names[]={BIN_STR("BUY"), BIN_STR("SELL")};
+
+//Spot and futures order types, each market rejecting the other's
+enum binordertype {binordertype_limit, binordertype_market, binordertype_stop_loss, binordertype_stop_loss_limit, binordertype_take_profit, binordertype_take_profit_limit, binordertype_limit_maker, binordertype_stop, binordertype_stop_market, binordertype_take_profit_market, binordertype_trailing_stop_market};
+const binstr binordertype_names[]={BIN_STR("LIMIT"), BIN_STR("MARKET"), BIN_STR("STOP_LOSS"), BIN_STR("STOP_LOSS_LIMIT"), BIN_STR("TAKE_PROFIT"), BIN_STR("TAKE_PROFIT_LIMIT"), BIN_STR("LIMIT_MAKER"), BIN_STR("STOP"), BIN_STR("STOP_MARKET"), BIN_STR("TAKE_PROFIT_MARKET"), BIN_STR("TRAILING_STOP_MARKET")};
+
+//bintif_none leaves timeInForce out, as required for market orders
+enum bintif {bintif_none, bintif_gtc, bintif_ioc, bintif_fok, bintif_gtx};
+const binstr bintif_names[]={BIN_STR(""), BIN_STR("GTC"), BIN_STR("IOC"), BIN_STR("FOK"), BIN_STR("GTX")};
+
+enum bincancelreplacemode {bincancelreplace_stop_on_failure, bincancelreplace_allow_failure};
+const binstr bincancelreplacemode_names[]={BIN_STR("STOP_ON_FAILURE"), BIN_STR("ALLOW_FAILURE")};
+
+//Each function writes a value at p and returns its end. The symbol is
+//always the first field, the next ones start with "&".
+inline static char* binputraw(char* p, const char* str, const size_t& len){memcpy(p, str, len); return p+len;}
+#define binputlit(p, lit) binputraw(p, lit, sizeof(lit)-1)
+inline static char* binputstr(char* p, const binstr& value){return binputraw(p, value.str, value.len);}
+inline static char* binputcstr(char* p, const char* value){return binputraw(p, value, strlen(value));}
+inline static char* binputint(char* p, const uint64_t& value){return p+uint64toascii(value, p);}
+inline static char* binputfx(char* p, const fxint& value, const int& decimals){return p+fxformat(value, decimals, p);}
+
+//POST order: places an order
+struct binneworder
+{
+  static constexpr binepdesc Endpoint(){return BIN_EPDESC("order?", bieneptype_post, binepsign_true, "order.place");}
+
+  binneworder(const char* symbol, const binside& side, const binordertype& type, const bintif& timeinforce, const fxint& quantity, const fxint& price, const binfxspec& fx): symbol(symbol), clientorderid(NULL), side(side), type(type), timeinforce(timeinforce), quantity(quantity), price(price), stopprice(0), fx(fx), recvwindow(0), reduceonly(false) {}
+
+  inline size_t MaxLength() const {return BIN_ORDER_MAXFIXED+strlen(symbol)+(clientorderid?strlen(clientorderid):0);}
+
+  //Writes the query to buf, which must hold MaxLength() characters, and
+  //returns its length
+  size_t Serialize(char* buf) const
+  {
+    char* p=buf;
+    p=binputlit(p, "symbol=");
+    p=binputcstr(p, symbol);
+    p=binputlit(p, "&side=");
+    p=binputstr(p, binside_names[side]);
+    p=binputlit(p, "&type=");
+    p=binputstr(p, binordertype_names[type]);
+
+    if(timeinforce!=bintif_none) {
+      p=binputlit(p, "&timeInForce=");
+      p=binputstr(p, bintif_names[timeinforce]);
+    }
+
+    if(quantity) {
+      p=binputlit(p, "&quantity=");
+      p=binputfx(p, quantity, fx.qtydecimals);
+    }
+
+    if(price) {
+      p=binputlit(p, "&price=");
+      p=binputfx(p, price, fx.pricedecimals);
+    }
+
+    if(stopprice) {
+      p=binputlit(p, "&stopPrice=");
+      p=binputfx(p, stopprice, fx.pricedecimals);
+    }
+
+    if(clientorderid) {
+      p=binputlit(p, "&newClientOrderId=");
+      p=binputcstr(p, clientorderid);
+    }
+
+    //Futures only
+    if(reduceonly) {
+      p=binputlit(p, "&reduceOnly=");
+      p=binputlit(p, "true");
+    }
+
+    if(recvwindow) {
+      p=binputlit(p, "&recvWindow=");
+      p=binputint(p, recvwindow);
+    }
+    return p-buf;
+  }
+
+  const char* symbol;
+  const char* clientorderid; //newClientOrderId
+  binside side;
+  binordertype type;
+  bintif timeinforce;
+  fxint quantity; //Scaled by fx.qtydecimals
+  fxint price; //Scaled by fx.pricedecimals
+  fxint stopprice; //Scaled by fx.pricedecimals
+  binfxspec fx;
+  uint32_t recvwindow; //In ms
+  bool reduceonly;
+};
+
+//Fields identifying an existing order, by exchange id or client id
+struct binorderref
+{
+  binorderref(const char* symbol, const int64_t& orderid): symbol(symbol), origclientorderid(NULL), orderid(orderid), recvwindow(0) {}
+  binorderref(const char* symbol, const char* origclientorderid): symbol(symbol), origclientorderid(origclientorderid), orderid(0), recvwindow(0) {}
+
+  inline size_t MaxLength() const {return BIN_ORDER_MAXFIXED+strlen(symbol)+(origclientorderid?strlen(origclientorderid):0);}
+
+  size_t Serialize(char* buf) const
+  {
+    char* p=buf;
+    p=binputlit(p, "symbol=");
+    p=binputcstr(p, symbol);
+
+    if(orderid) {
+      p=binputlit(p, "&orderId=");
+      p=binputint(p, orderid);
+    }
+
+    if(origclientorderid) {
+      p=binputlit(p, "&origClientOrderId=");
+      p=binputcstr(p, origclientorderid);
+    }
+
+    if(recvwindow) {
+      p=binputlit(p, "&recvWindow=");
+      p=binputint(p, recvwindow);
+    }
+    return p-buf;
+  }
+
+  const char* symbol;
+  const char* origclientorderid;
+  int64_t orderid;
+  uint32_t recvwindow; //In ms
+};
+
+//DELETE order: cancels an open order
+struct bincancelorder: public binorderref
+{
+  static constexpr binepdesc Endpoint(){return BIN_EPDESC("order?", bieneptype_delete, binepsign_true, "order.cancel");}
+
+  bincancelorder(const char* symbol, const int64_t& orderid): binorderref(symbol, orderid) {}
+  bincancelorder(const char* symbol, const char* origclientorderid): binorderref(symbol, origclientorderid) {}
+};
+
+//GET order: queries the status of an order
+struct binqueryorder: public binorderref
+{
+  static constexpr binepdesc Endpoint(){return BIN_EPDESC("order?", bieneptype_get, binepsign_true, "order.status");}
+
+  binqueryorder(const char* symbol, const int64_t& orderid): binorderref(symbol, orderid) {}
+  binqueryorder(const char* symbol, const char* origclientorderid): binorderref(symbol, origclientorderid) {}
+};
+
+//POST order/cancelReplace (spot only): cancels an order and places
+//neworder in a single request
+struct bincancelreplace
+{
+  static constexpr binepdesc Endpoint(){return BIN_EPDESC("order/cancelReplace?", bieneptype_post, binepsign_true, "order.cancelReplace");}
+
+  bincancelreplace(const binneworder& neworder, const int64_t& cancelorderid, const bincancelreplacemode& mode=bincancelreplace_stop_on_failure): neworder(neworder), cancelorigclientorderid(NULL), cancelorderid(cancelorderid), mode(mode) {}
+  bincancelreplace(const binneworder& neworder, const char* cancelorigclientorderid, const bincancelreplacemode& mode=bincancelreplace_stop_on_failure): neworder(neworder), cancelorigclientorderid(cancelorigclientorderid), cancelorderid(0), mode(mode) {}
+
+  inline size_t MaxLength() const {return neworder.MaxLength()+BIN_ORDER_MAXFIXED+(cancelorigclientorderid?strlen(cancelorigclientorderid):0);}
+
+  size_t Serialize(char* buf) const
+  {
+    char* p=buf+neworder.Serialize(buf);
+    p=binputlit(p, "&cancelReplaceMode=");
+    p=binputstr(p, bincancelreplacemode_names[mode]);
+
+    if(cancelorderid) {
+      p=binputlit(p, "&cancelOrderId=");
+      p=binputint(p, cancelorderid);
+    }
+
+    if(cancelorigclientorderid) {
+      p=binputlit(p, "&cancelOrigClientOrderId=");
+      p=binputcstr(p, cancelorigclientorderid);
+    }
+    return p-buf;
+  }
+
+  binneworder neworder;
+  const char* cancelorigclientorderid;
+  int64_t cancelorderid;
+  bincancelreplacemode mode;
+};
+
+#endif
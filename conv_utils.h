@@ -1,6 +1,13 @@
 #ifndef _CONV_UTILS_
 #define _CONV_UTILS_
 
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // mapping of ASCII characters to hex values
 const static uint8_t _cu_hashmap_ascii_hex_keys[] = {
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ........
@@ -43,4 +50,75 @@ const static char* _cu_hashmap_4bit_keys="0123456789abcdef";
 
 #define asciihextouint4(c) _cu_hashmap_ascii_hex_keys[(uint8_t)(c)]
 
+// hex representations of 0x00 to 0xff, two characters per byte
+const static char _cu_hashmap_8bit_keys[]=
+  "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+  "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+  "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+  "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+  "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+  "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+  "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+  "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+//Writes the lowercase hex representation of the n bytes of in to out (2*n
+//characters, without a terminating null character). 16 bytes are encoded
+//at once with SSE2, which every x86-64 CPU has, and the remaining ones
+//through a 16-bit table.
+inline static void bytestoasciihex(const unsigned char* in, size_t n, char* out)
+{
+#ifdef __SSE2__
+  const __m128i mask=_mm_set1_epi8(0x0F);
+  const __m128i nine=_mm_set1_epi8(9);
+  const __m128i zero=_mm_set1_epi8('0');
+  const __m128i atof=_mm_set1_epi8('a'-'0'-10);
+
+  for(; n>=16; n-=16, in+=16, out+=32) {
+    const __m128i bytes=_mm_loadu_si128((const __m128i*)in);
+    const __m128i hi=_mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    const __m128i lo=_mm_and_si128(bytes, mask);
+    //High nibble first
+    __m128i first=_mm_unpacklo_epi8(hi, lo);
+    __m128i second=_mm_unpackhi_epi8(hi, lo);
+    first=_mm_add_epi8(_mm_add_epi8(first, zero), _mm_and_si128(_mm_cmpgt_epi8(first, nine), atof));
+    second=_mm_add_epi8(_mm_add_epi8(second, zero), _mm_and_si128(_mm_cmpgt_epi8(second, nine), atof));
+    _mm_storeu_si128((__m128i*)out, first);
+    _mm_storeu_si128((__m128i*)(out+16), second);
+  }
+#endif
+
+  for(size_t i=0; i<n; ++i) memcpy(out+2*i, _cu_hashmap_8bit_keys+2*in[i], 2);
+}
+
+// decimal representations of 00 to 99
+const static char _cu_hashmap_2digit_keys[]=
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+//Writes the decimal representation of u to str, without a terminating null
+//character, and returns its length. str must hold 20 characters.
+inline static int uint64toascii(uint64_t u, char* str)
+{
+  char buf[20];
+  char* p=buf+20;
+
+  //Two digits per division
+  while(u>=100) {
+    const unsigned int r=u%100;
+    u/=100;
+    p-=2;
+    memcpy(p, _cu_hashmap_2digit_keys+2*r, 2);
+  }
+
+  if(u>=10) {
+    p-=2;
+    memcpy(p, _cu_hashmap_2digit_keys+2*u, 2);
+
+  } else *--p='0'+u;
+  const int len=buf+20-p;
+  memcpy(str, p, len);
+  return len;
+}
+
 #endif
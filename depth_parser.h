@@ -0,0 +1,369 @@
+#ifndef _DEPTH_PARSER_
+#define _DEPTH_PARSER_
+
+#include <cstring>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Single-pass scanner for depthUpdate payloads, e.g.
+//{"e":"depthUpdate","E":1,"T":1,"s":"BTCUSDT","U":1,"u":2,"pu":0,"b":[["1.0","2.0"]],"a":[]}
+//Nothing is allocated: level arrays are validated, returned as pointers
+//into the payload and walked with depth_levels.
+
+struct depthupdate
+{
+  uint64_t E;
+  uint64_t U;
+  uint64_t u;
+  uint64_t pu;
+  const char* bids; //Opening bracket of the "b" array, or NULL
+  const char* asks; //Opening bracket of the "a" array, or NULL
+  bool hasU;
+  bool hasu;
+  bool haspu;
+};
+
+//REST depth snapshot, e.g.
+//{"lastUpdateId":1,"E":1,"T":1,"bids":[["1.0","2.0"]],"asks":[]}
+struct depthsnapshot
+{
+  uint64_t lastupdateid;
+  const char* bids; //Opening bracket of the "bids" array
+  const char* asks; //Opening bracket of the "asks" array
+};
+
+//Returns a pointer to the first occurrence of c1 or c2 in [p,end), or end
+inline static const char* scan_find2(const char* p, const char* end, const char c1, const char c2)
+{
+#ifdef __SSE2__
+  const __m128i v1=_mm_set1_epi8(c1);
+  const __m128i v2=_mm_set1_epi8(c2);
+
+  for(; end-p>=16; p+=16) {
+    const __m128i chunk=_mm_loadu_si128((const __m128i*)p);
+    const int mask=_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk,v1),_mm_cmpeq_epi8(chunk,v2)));
+
+    if(mask) return p+__builtin_ctz(mask);
+  }
+#endif
+
+  for(; p<end; ++p) if(*p==c1 || *p==c2) return p;
+  return end;
+}
+
+#define scan_find(p,end,c) scan_find2((p),(end),(c),(c))
+
+inline static const char* scan_skipws(const char* p, const char* end)
+{
+  while(p<end && (*p==' ' || *p=='\t' || *p=='\n' || *p=='\r')) ++p;
+  return p;
+}
+
+inline static const char* scan_uint(const char* p, const char* end, uint64_t* value)
+{
+  uint64_t v=0;
+  const char* start=p;
+
+  while(p<end && (uint8_t)(*p-'0')<10) v=v*10+(*p++-'0');
+  *value=v;
+  return (p>start?p:NULL);
+}
+
+//Skips a string starting at its opening quote. Returns the position past
+//the closing quote or NULL.
+inline static const char* scan_skipstring(const char* p, const char* end)
+{
+  for(++p;;) {
+    p=scan_find2(p,end,'"','\\');
+
+    if(p==end) return NULL;
+
+    if(*p=='"') return p+1;
+    p+=2;
+  }
+}
+
+//Skips any JSON value. Returns the position past the value or NULL.
+inline static const char* scan_skipvalue(const char* p, const char* end)
+{
+  if(p>=end) return NULL;
+
+  if(*p=='"') return scan_skipstring(p,end);
+
+  if(*p!='[' && *p!='{') {
+    p=scan_find2(p,end,',','}');
+    return (p<end?p:NULL);
+  }
+  int depth=0;
+
+  for(; p<end; ++p) {
+
+    if(*p=='"') {
+
+      if(!(p=scan_skipstring(p,end))) return NULL;
+      --p;
+
+    } else if(*p=='[' || *p=='{') ++depth;
+
+    else if((*p==']' || *p=='}') && !--depth) return p+1;
+  }
+  return NULL;
+}
+
+//Skips a price or quantity string starting at its opening quote. They are
+//plain decimals, so escapes are rejected. Returns the position past the
+//closing quote or NULL.
+inline static const char* scan_skiplevelstring(const char* p, const char* end)
+{
+  p=scan_find2(p+1,end,'"','\\');
+  return (p<end && *p=='"'?p+1:NULL);
+}
+
+//Skips an array of ["price","quantity"] levels starting at its opening
+//bracket. The whole array is validated, so that depth_levels cannot fail
+//once levels have started to be applied. Returns the position past the
+//array or NULL if it is malformed.
+inline static const char* scan_skiplevels(const char* p, const char* end)
+{
+  p=scan_skipws(p+1,end);
+
+  if(p<end && *p==']') return p+1;
+
+  for(;;) {
+
+    if(p==end || *p!='[') return NULL;
+    p=scan_skipws(p+1,end);
+
+    if(p==end || *p!='"' || !(p=scan_skiplevelstring(p,end))) return NULL;
+    p=scan_skipws(p,end);
+
+    if(p==end || *p!=',') return NULL;
+    p=scan_skipws(p+1,end);
+
+    if(p==end || *p!='"' || !(p=scan_skiplevelstring(p,end))) return NULL;
+    p=scan_skipws(p,end);
+
+    if(p==end || *p!=']') return NULL;
+    p=scan_skipws(p+1,end);
+
+    if(p==end) return NULL;
+
+    if(*p==']') return p+1;
+
+    if(*p!=',') return NULL;
+    p=scan_skipws(p+1,end);
+  }
+}
+
+//Scans the top-level fields of a depthUpdate payload. Returns 0 on success
+//and -1 if the payload is malformed, including any of its levels.
+inline static int depth_scan(const char* msg, const size_t& len, depthupdate* du)
+{
+  const char* p=scan_skipws(msg,msg+len);
+  const char* const end=msg+len;
+  const char* key;
+  size_t keylen;
+  memset(du,0,sizeof(depthupdate));
+
+  if(p==end || *p!='{') return -1;
+  ++p;
+
+  for(;;) {
+    p=scan_find2(p,end,'"','}');
+
+    if(p==end) return -1;
+
+    if(*p=='}') return 0;
+    key=p+1;
+
+    if(!(p=scan_skipstring(p,end))) return -1;
+    keylen=p-1-key;
+    p=scan_find(p,end,':');
+
+    if(p==end) return -1;
+    p=scan_skipws(p+1,end);
+
+    if(p==end) return -1;
+
+    if(keylen==1) {
+
+      switch(*key) {
+	case 'E':
+	  p=scan_uint(p,end,&du->E);
+	  break;
+
+	case 'U':
+	  p=scan_uint(p,end,&du->U);
+	  du->hasU=true;
+	  break;
+
+	case 'u':
+	  p=scan_uint(p,end,&du->u);
+	  du->hasu=true;
+	  break;
+
+	case 'b':
+
+	  if(*p!='[') return -1;
+	  du->bids=p;
+	  p=scan_skiplevels(p,end);
+	  break;
+
+	case 'a':
+
+	  if(*p!='[') return -1;
+	  du->asks=p;
+	  p=scan_skiplevels(p,end);
+	  break;
+
+	default:
+	  p=scan_skipvalue(p,end);
+      }
+
+    } else if(keylen==2 && key[0]=='p' && key[1]=='u') {
+      p=scan_uint(p,end,&du->pu);
+      du->haspu=true;
+
+    } else p=scan_skipvalue(p,end);
+
+    if(!p) return -1;
+  }
+}
+
+//Scans a REST depth snapshot. Returns 0 on success and -1 if the payload
+//is malformed or lacks lastUpdateId, bids or asks.
+inline static int snapshot_scan(const char* msg, const size_t& len, depthsnapshot* ds)
+{
+  const char* p=scan_skipws(msg,msg+len);
+  const char* const end=msg+len;
+  const char* key;
+  size_t keylen;
+  bool hasid=false;
+  memset(ds,0,sizeof(depthsnapshot));
+
+  if(p==end || *p!='{') return -1;
+  ++p;
+
+  for(;;) {
+    p=scan_find2(p,end,'"','}');
+
+    if(p==end) return -1;
+
+    if(*p=='}') return (hasid && ds->bids && ds->asks?0:-1);
+    key=p+1;
+
+    if(!(p=scan_skipstring(p,end))) return -1;
+    keylen=p-1-key;
+    p=scan_find(p,end,':');
+
+    if(p==end) return -1;
+    p=scan_skipws(p+1,end);
+
+    if(p==end) return -1;
+
+    if(keylen==12 && !memcmp(key,"lastUpdateId",12)) {
+      p=scan_uint(p,end,&ds->lastupdateid);
+      hasid=true;
+
+    } else if(keylen==4 && !memcmp(key,"bids",4)) {
+
+      if(*p!='[') return -1;
+      ds->bids=p;
+      p=scan_skiplevels(p,end);
+
+    } else if(keylen==4 && !memcmp(key,"asks",4)) {
+
+      if(*p!='[') return -1;
+      ds->asks=p;
+      p=scan_skiplevels(p,end);
+
+    } else p=scan_skipvalue(p,end);
+
+    if(!p) return -1;
+  }
+}
+
+//Only extracts the first and last update IDs of a depthUpdate payload,
+//stopping as soon as both have been read (they precede the levels in the
+//exchange's payloads). Returns 0 on success and -1 otherwise.
+inline static int depth_scan_ids(const char* msg, const size_t& len, uint64_t* U, uint64_t* u)
+{
+  const char* p=scan_skipws(msg,msg+len);
+  const char* const end=msg+len;
+  const char* key;
+  int found=0;
+
+  if(p==end || *p!='{') return -1;
+  ++p;
+
+  for(;;) {
+    p=scan_find2(p,end,'"','}');
+
+    if(p==end || *p=='}') return -1;
+    key=p+1;
+
+    if(!(p=scan_skipstring(p,end))) return -1;
+
+    if(p-key==2 && (*key=='U' || *key=='u')) {
+      p=scan_find(p,end,':');
+
+      if(p==end) return -1;
+      p=scan_uint(scan_skipws(p+1,end),end,(*key=='U'?U:u));
+      found|=(*key=='U'?1:2);
+
+      if(found==3) return 0;
+
+    } else {
+      p=scan_find(p,end,':');
+
+      if(p==end) return -1;
+      p=scan_skipws(p+1,end);
+      p=(p<end && *p=='['?scan_skiplevels(p,end):scan_skipvalue(p,end));
+    }
+
+    if(!p) return -1;
+  }
+}
+
+//Calls f(price, plen, quantity, qlen) for each level of the array starting
+//at levels (as returned by depth_scan). Returns the number of levels or -1
+//if the array is malformed.
+template<typename F> inline static int depth_levels(const char* levels, const char* end, F f)
+{
+  const char* p=levels+1;
+  const char *price, *quantity;
+  size_t plen;
+  int n=0;
+
+  for(;;) {
+    //Either the price of the next level or the end of the array
+    p=scan_find2(p,end,'"',']');
+
+    if(p==end) return -1;
+
+    if(*p==']') return n;
+    price=++p;
+    p=scan_find(p,end,'"');
+
+    if(p==end) return -1;
+    plen=p-price;
+    p=scan_find(p+1,end,'"');
+
+    if(p==end) return -1;
+    quantity=++p;
+    p=scan_find(p,end,'"');
+
+    if(p==end) return -1;
+    f(price,plen,quantity,(size_t)(p-quantity));
+    ++n;
+    p=scan_find(p+1,end,']');
+
+    if(p==end) return -1;
+    ++p;
+  }
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef _FXDEC_UTILS_
+#define _FXDEC_UTILS_
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+//Fixed-point decimal values are stored as int64_t integers scaled by
+//10^decimals, where the number of decimals comes from the symbol's
+//tickSize (prices) or stepSize (quantities)
+typedef int64_t fxint;
+
+#define FXDEC_MAX_DECIMALS 18
+
+const static int64_t _fx_pow10[FXDEC_MAX_DECIMALS+1] = {
+  1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+  100000000LL, 1000000000LL, 10000000000LL, 100000000000LL, 1000000000000LL,
+  10000000000000LL, 100000000000000LL, 1000000000000000LL,
+  10000000000000000LL, 100000000000000000LL, 1000000000000000000LL
+};
+
+//True if the 8 bytes in chunk are all ASCII digits
+#define fx_is8digits(chunk) ((((chunk) & 0xF0F0F0F0F0F0F0F0ULL) | ((((chunk) + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL)
+
+//Converts 8 ASCII digits loaded little-endian into their integer value
+inline static uint64_t fx_parse8(uint64_t chunk)
+{
+  chunk-=0x3030303030303030ULL;
+  chunk=(chunk*10+(chunk>>8)) & 0x00FF00FF00FF00FFULL;
+  chunk=(chunk*100+(chunk>>16)) & 0x0000FFFF0000FFFFULL;
+  return (chunk*10000+(chunk>>32)) & 0xFFFFFFFFULL;
+}
+
+//Parses an ASCII decimal string ("27123.45000000") into an integer scaled
+//by 10^decimals. Digits beyond the requested precision are truncated.
+inline static fxint fxparse(const char* str, const size_t& len, const int& decimals)
+{
+  const char* const end=str+len;
+  const fxint sign=(len && *str=='-'?-1:1);
+  str+=(sign<0);
+  fxint ip=0;
+
+  while(str<end && (uint8_t)(*str-'0')<10) ip=ip*10+(*str++-'0');
+
+  if(str>=end || *str!='.') return sign*ip*_fx_pow10[decimals];
+  ++str;
+  fxint fp=0;
+  int nd;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  //Exchange strings normally carry exactly 8 decimals
+  if(end-str>=8 && decimals<=8) {
+    uint64_t chunk;
+    memcpy(&chunk,str,8);
+
+    if(fx_is8digits(chunk)) return sign*(ip*_fx_pow10[decimals]+(fxint)fx_parse8(chunk)/_fx_pow10[8-decimals]);
+  }
+#endif
+
+  for(nd=0; nd<decimals && str<end && (uint8_t)(*str-'0')<10; ++nd) fp=fp*10+(*str++-'0');
+  return sign*(ip*_fx_pow10[decimals]+fp*_fx_pow10[decimals-nd]);
+}
+
+inline static fxint fxparse(const char* str, const int& decimals){return fxparse(str,strlen(str),decimals);}
+
+//Number of significant decimals in a decimal string ("0.01000000" -> 2)
+inline static int fxdecimals(const char* str, const size_t& len)
+{
+  const char* dot=(const char*)memchr(str,'.',len);
+
+  if(!dot) return 0;
+  const char* last=str+len-1;
+
+  while(last>dot && *last=='0') --last;
+  return (int)(last-dot);
+}
+
+//Smallest number of decimals representing value exactly (0.01 -> 2)
+inline static int fxdecimals(const double& value)
+{
+  for(int d=0; d<FXDEC_MAX_DECIMALS; ++d) {
+    const double scaled=value*_fx_pow10[d];
+
+    if(fabs(scaled-nearbyint(scaled))<=1e-9*scaled) return d;
+  }
+  return FXDEC_MAX_DECIMALS;
+}
+
+//Largest length of a value written by fxformat
+#define FXDEC_MAX_LENGTH 21
+
+//Writes value, scaled by 10^decimals, as a decimal string with exactly
+//decimals digits after the point ("43000.10" for 4300010 with 2
+//decimals), without a terminating null character. Returns its length.
+inline static int fxformat(const fxint& value, const int& decimals, char* str)
+{
+  char buf[FXDEC_MAX_LENGTH+3];
+  char* p=buf+sizeof(buf);
+  uint64_t u=(value<0?-(uint64_t)value:(uint64_t)value);
+
+  for(int d=0; d<decimals; ++d) {
+    *--p='0'+u%10;
+    u/=10;
+  }
+
+  if(decimals) *--p='.';
+
+  do {
+    *--p='0'+u%10;
+    u/=10;
+  } while(u);
+
+  if(value<0) *--p='-';
+  const int len=buf+sizeof(buf)-p;
+  memcpy(str, p, len);
+  return len;
+}
+
+inline static double fxtodouble(const fxint& value, const int& decimals){return (double)value/_fx_pow10[decimals];}
+
+inline static fxint fxfromdouble(const double& value, const int& decimals){return llround(value*_fx_pow10[decimals]);}
+
+//Fixed-point scales of a symbol, taken from its tickSize and stepSize
+struct binfxspec
+{
+  binfxspec(): pricedecimals(-1), qtydecimals(-1), tick(0), step(0) {}
+  binfxspec(const char* ticksize, const char* stepsize): pricedecimals(fxdecimals(ticksize,strlen(ticksize))), qtydecimals(fxdecimals(stepsize,strlen(stepsize))), tick(fxparse(ticksize,pricedecimals)), step(fxparse(stepsize,qtydecimals)) {}
+  binfxspec(const double& ticksize, const double& stepsize): pricedecimals(fxdecimals(ticksize)), qtydecimals(fxdecimals(stepsize)), tick(fxfromdouble(ticksize,pricedecimals)), step(fxfromdouble(stepsize,qtydecimals)) {}
+
+  inline bool IsValid() const {return (pricedecimals>=0 && pricedecimals<=FXDEC_MAX_DECIMALS && qtydecimals>=0 && qtydecimals<=FXDEC_MAX_DECIMALS && tick>0 && step>0);}
+
+  inline fxint ParsePrice(const char* str, const size_t& len) const {return fxparse(str,len,pricedecimals);}
+  inline fxint ParseQuantity(const char* str, const size_t& len) const {return fxparse(str,len,qtydecimals);}
+  inline double PriceToDouble(const fxint& price) const {return fxtodouble(price,pricedecimals);}
+  inline double QuantityToDouble(const fxint& quantity) const {return fxtodouble(quantity,qtydecimals);}
+  inline fxint PriceFromDouble(const double& price) const {return fxfromdouble(price,pricedecimals);}
+  inline fxint QuantityFromDouble(const double& quantity) const {return fxfromdouble(quantity,qtydecimals);}
+
+  int pricedecimals;
+  int qtydecimals;
+  fxint tick;
+  fxint step;
+};
+
+#endif
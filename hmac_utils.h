@@ -0,0 +1,90 @@
+#ifndef _HMAC_UTILS_
+#define _HMAC_UTILS_
+
+#include <cstring>
+#include <cstdint>
+
+#include <openssl/sha.h>
+
+#include "conv_utils.h"
+
+//Length of a signature, in bytes and in hex characters
+#define HMAC_SHA256_LENGTH SHA256_DIGEST_LENGTH
+#define HMAC_SHA256_HEXLENGTH (2*SHA256_DIGEST_LENGTH)
+
+//HMAC-SHA256 signer keyed once. The one-shot HMAC function hashes the key
+//pads into fresh inner and outer SHA-256 states for every message and
+//allocates its contexts. The signer keeps these two states, already
+//absorbing the padded key, and copies them on the stack for each message,
+//so a signature costs the hashing of the message plus two compression
+//rounds for the outer hash, without any allocation.
+//The signing functions are const and can be called from several threads.
+//The SHA256_* functions are deprecated by OpenSSL 3 in favour of EVP
+//contexts, whose copies allocate, but are still provided.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+class hmacsigner
+{
+  public:
+  hmacsigner(): fInner(), fOuter() {SetKey(NULL, 0);}
+  hmacsigner(const void* key, const size_t& keylen): fInner(), fOuter() {SetKey(key, keylen);}
+
+  void SetKey(const void* key, const size_t& keylen)
+  {
+    unsigned char block[SHA256_CBLOCK];
+    unsigned char pad[SHA256_CBLOCK];
+    memset(block, 0, SHA256_CBLOCK);
+
+    //Keys longer than a block are replaced by their hash
+    if(keylen>SHA256_CBLOCK) SHA256((const unsigned char*)key, keylen, block);
+
+    else if(keylen) memcpy(block, key, keylen);
+
+    for(int i=0; i<SHA256_CBLOCK; ++i) pad[i]=block[i]^0x36;
+    SHA256_Init(&fInner);
+    SHA256_Update(&fInner, pad, SHA256_CBLOCK);
+
+    for(int i=0; i<SHA256_CBLOCK; ++i) pad[i]=block[i]^0x5c;
+    SHA256_Init(&fOuter);
+    SHA256_Update(&fOuter, pad, SHA256_CBLOCK);
+    memset(block, 0, SHA256_CBLOCK);
+    memset(pad, 0, SHA256_CBLOCK);
+  }
+
+  //Writes the HMAC_SHA256_LENGTH bytes signature of data to mac
+  inline void Sign(const void* data, const size_t& len, unsigned char* mac) const
+  {
+    SHA256_CTX ctx=fInner;
+    SHA256_Update(&ctx, data, len);
+    SHA256_Final(mac, &ctx);
+    ctx=fOuter;
+    SHA256_Update(&ctx, mac, SHA256_DIGEST_LENGTH);
+    SHA256_Final(mac, &ctx);
+  }
+
+  //Writes the HMAC_SHA256_HEXLENGTH characters of the signature in
+  //lowercase hex to hex, without a terminating null character. data and hex
+  //can be parts of the same buffer as long as they do not overlap.
+  inline void SignHex(const void* data, const size_t& len, char* hex) const
+  {
+    unsigned char mac[SHA256_DIGEST_LENGTH];
+    Sign(data, len, mac);
+    bytestoasciihex(mac, SHA256_DIGEST_LENGTH, hex);
+  }
+
+  //Signs n messages back to back, writing the hex signature of data[i] at
+  //hex+i*HMAC_SHA256_HEXLENGTH. The keyed states stay in cache from one
+  //message to the next.
+  inline void SignHexBatch(const int& n, const void* const* data, const size_t* lens, char* hex) const
+  {
+    for(int i=0; i<n; ++i) SignHex(data[i], lens[i], hex+i*HMAC_SHA256_HEXLENGTH);
+  }
+
+  protected:
+  SHA256_CTX fInner; //Hash state after the key XOR ipad block
+  SHA256_CTX fOuter; //Hash state after the key XOR opad block
+  private:
+};
+#pragma GCC diagnostic pop
+
+#endif
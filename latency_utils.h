@@ -0,0 +1,129 @@
+#ifndef _LATENCY_UTILS_
+#define _LATENCY_UTILS_
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <time.h>
+
+//Per-stage latency instrumentation of the depth feed (receive, parse,
+//apply, notify and exchange-to-local). It is compiled out entirely unless
+//BIN_LATENCY_STATS is defined, here or on the command line for all the
+//translation units.
+//#define BIN_LATENCY_STATS
+
+//Stages measured for each applied depth update, in nanoseconds
+enum {
+  lat_parse, //Reception by WebSocketManager to the end of the diff scan (dispatch, lock wait and scan)
+  lat_apply, //Scan to the levels being applied
+  lat_notify, //Levels applied to the subscribers notified and the views published
+  lat_total, //Reception to the end of the processing
+  lat_exchange, //Exchange event time (E) to reception, clamped to 0 if the clocks disagree
+  lat_nstages
+};
+
+static const char* const lat_stagenames[lat_nstages]={"parse", "apply", "notify", "total", "exchange"};
+
+//Monotonic time in nanoseconds (served from the vDSO, without a syscall)
+inline static uint64_t lat_now(){struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;}
+inline static uint64_t lat_realtime(){struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts); return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;}
+
+//Reception times of the frame being dispatched on the current thread, set
+//by WebSocketManager right before the message handler is called, and
+//consumed (reset) by the handler
+inline uint64_t& lat_rxtime(){static thread_local uint64_t t=0; return t;}
+inline uint64_t& lat_rxrealtime(){static thread_local uint64_t t=0; return t;}
+inline void lat_stamp_receive(){lat_rxtime()=lat_now(); lat_rxrealtime()=lat_realtime();}
+
+//Log-linear histogram in the spirit of HdrHistogram: values below
+//2^LATHIST_SUBBITS are exact, and each power of 2 above is split into
+//2^LATHIST_SUBBITS buckets, i.e. a relative error below 2^-LATHIST_SUBBITS
+//over the whole uint64_t range.
+#ifndef LATHIST_SUBBITS
+#define LATHIST_SUBBITS 5
+#endif
+#define LATHIST_SUB (1<<LATHIST_SUBBITS)
+#define LATHIST_BUCKETS ((64-LATHIST_SUBBITS+1)*LATHIST_SUB)
+
+struct latsummary
+{
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  double mean;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+};
+
+struct lathist
+{
+  inline void Clear(){memset(this, 0, sizeof(lathist));}
+
+  static inline uint32_t Index(const uint64_t& value)
+  {
+    if(value<LATHIST_SUB) return value;
+    const int shift=63-__builtin_clzll(value)-LATHIST_SUBBITS;
+    return (shift+1)*LATHIST_SUB+((value>>shift)&(LATHIST_SUB-1));
+  }
+
+  //Highest value of a bucket
+  static inline uint64_t Upper(const uint32_t& index)
+  {
+    if(index<LATHIST_SUB) return index;
+    const int shift=index/LATHIST_SUB-1;
+    return ((uint64_t)(LATHIST_SUB+index%LATHIST_SUB+1)<<shift)-1;
+  }
+
+  inline void Record(const uint64_t& value)
+  {
+    ++counts[Index(value)];
+
+    if(!count || value<min) min=value;
+
+    if(value>max) max=value;
+    ++count;
+    sum+=value;
+  }
+
+  //Value below which a fraction q of the recorded values lie, within the
+  //precision of the buckets
+  inline uint64_t Quantile(const double& q) const
+  {
+    if(!count) return 0;
+    const uint64_t rank=(uint64_t)(q*count+0.5);
+    uint64_t n=0;
+
+    for(uint32_t i=0; i<LATHIST_BUCKETS; ++i) {
+      n+=counts[i];
+
+      if(n>=rank && n) {
+	const uint64_t upper=Upper(i);
+	return (upper<max?upper:max);
+      }
+    }
+    return max;
+  }
+
+  inline void Summary(latsummary* summary) const
+  {
+    summary->count=count;
+    summary->min=min;
+    summary->max=max;
+    summary->mean=(count?(double)sum/count:0);
+    summary->p50=Quantile(0.5);
+    summary->p90=Quantile(0.9);
+    summary->p99=Quantile(0.99);
+    summary->p999=Quantile(0.999);
+  }
+
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t counts[LATHIST_BUCKETS];
+};
+
+#endif
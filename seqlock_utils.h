@@ -0,0 +1,69 @@
+#ifndef _SEQLOCK_UTILS_
+#define _SEQLOCK_UTILS_
+
+#include <cstring>
+#include <cstdint>
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define seqlock_pause() __builtin_ia32_pause()
+#else
+#define seqlock_pause()
+#endif
+
+//Sequence lock around a trivially copyable payload. There must be a single
+//writer at a time (serialised externally if needed), while any number of
+//readers copy the payload without locks or syscalls and retry if a write
+//happened during the copy. The layout is standard so the structure can be
+//placed in shared memory.
+template<typename T> struct seqlock
+{
+  seqlock(): seq(0), pad(), data() {}
+
+  //Returns the payload to be modified in place until EndWrite is called
+  inline T& BeginWrite()
+  {
+    seq.store(seq.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return data;
+  }
+
+  inline void EndWrite(){seq.store(seq.load(std::memory_order_relaxed)+1, std::memory_order_release);}
+
+  inline void Write(const T& value){memcpy(&BeginWrite(), &value, sizeof(T)); EndWrite();}
+
+  //Returns false if a write was in progress or happened during the copy
+  inline bool TryRead(T* value, uint64_t* version=NULL) const
+  {
+    const uint64_t s0=seq.load(std::memory_order_acquire);
+
+    if(s0&1) return false;
+    memcpy(value, &data, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if(seq.load(std::memory_order_relaxed)!=s0) return false;
+
+    if(version) *version=s0>>1;
+    return true;
+  }
+
+  //Spins until a consistent copy is obtained. Returns the payload version.
+  inline uint64_t Read(T* value) const
+  {
+    uint64_t version;
+
+    while(!TryRead(value, &version)) seqlock_pause();
+    return version;
+  }
+
+  inline uint64_t Version() const {return seq.load(std::memory_order_acquire)>>1;}
+
+  //Padding keeps the sequence counter and the payload on separate cache
+  //lines without over-aligning the structures embedding a seqlock
+  std::atomic<uint64_t> seq;
+  char pad[64-sizeof(std::atomic<uint64_t>)];
+  T data;
+};
+
+#endif
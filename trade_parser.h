@@ -0,0 +1,198 @@
+#ifndef _TRADE_PARSER_
+#define _TRADE_PARSER_
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "depth_parser.h"
+
+//Single-pass scanner for trade and aggTrade payloads, e.g.
+//{"e":"trade","E":1,"s":"BTCUSDT","t":1,"p":"1.0","q":"2.0","b":1,"a":2,"T":1,"m":true,"M":true}
+//{"e":"aggTrade","E":1,"s":"BTCUSDT","a":1,"p":"1.0","q":"2.0","f":1,"l":2,"T":1,"m":true}
+//Nothing is allocated and the record is a POD.
+
+struct traderecord
+{
+  uint64_t id; //Trade id, or aggregate trade id
+  uint64_t firstid; //First trade id of an aggregate trade, id otherwise
+  uint64_t eventtime;
+  uint64_t tradetime;
+  double price;
+  double quantity;
+  uint32_t ntrades; //Number of trades in an aggregate trade, 1 otherwise
+  uint8_t buyermaker; //Non-zero if the taker sold
+  uint8_t aggregate;
+  uint16_t reserved;
+};
+
+static const double _scan_pow10[]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+
+//Parses an unsigned decimal number. Numbers with at most 15 significant
+//digits are converted exactly (an exact integer divided by an exact power
+//of 10 is correctly rounded), longer ones fall back to strtod. Returns the
+//position past the number or NULL.
+inline static const char* scan_decimal(const char* p, const char* end, double* value)
+{
+  const char* start=p;
+  uint64_t m=0;
+  int digits=0, decimals=0;
+
+  for(; p<end && (uint8_t)(*p-'0')<10; ++p) {
+    m=m*10+(*p-'0');
+    digits+=(m>0);
+  }
+
+  if(p<end && *p=='.') {
+
+    for(++p; p<end && (uint8_t)(*p-'0')<10; ++p) {
+      m=m*10+(*p-'0');
+      digits+=(m>0);
+      ++decimals;
+    }
+  }
+
+  if(p==start) return NULL;
+
+  if(digits>15 || decimals>22 || (p<end && (*p=='e' || *p=='E'))) {
+    char* pend;
+    *value=strtod(start,&pend);
+    return pend;
+  }
+  *value=(double)m/_scan_pow10[decimals];
+  return p;
+}
+
+inline static const char* scan_bool(const char* p, const char* end, uint8_t* value)
+{
+  if(end-p>=4 && !memcmp(p,"true",4)) {
+    *value=1;
+    return p+4;
+  }
+
+  if(end-p>=5 && !memcmp(p,"false",5)) {
+    *value=0;
+    return p+5;
+  }
+  return NULL;
+}
+
+//Scans a trade or aggTrade payload, from the raw or the combined stream
+//(in which case the "data" object is scanned). Returns 0 on success and -1
+//if the payload is malformed or is not a trade.
+inline static int trade_scan(const char* msg, const size_t& len, traderecord* tr)
+{
+  const char* p=scan_skipws(msg,msg+len);
+  const char* const end=msg+len;
+  const char* key;
+  size_t keylen;
+  uint64_t a=0, f=0, l=0, t=0;
+  int found=0; //Bits: event type, price, quantity, trade time
+  memset(tr,0,sizeof(traderecord));
+
+  if(p==end || *p!='{') return -1;
+  ++p;
+
+  //Fields are short, so the separators are searched with scalar loops
+  for(;;) {
+    while(p<end && *p!='"' && *p!='}') ++p;
+
+    if(p==end) return -1;
+
+    if(*p=='}') break;
+    key=++p;
+
+    while(p<end && *p!='"') ++p;
+
+    if(p==end) return -1;
+    keylen=p-key;
+
+    for(++p; p<end && *p!=':'; ++p);
+
+    if(p==end) return -1;
+    p=scan_skipws(p+1,end);
+
+    if(p==end) return -1;
+
+    if(keylen==1) {
+
+      switch(*key) {
+	case 'e':
+
+	  if(end-p>=10 && !memcmp(p,"\"aggTrade\"",10)) tr->aggregate=1;
+
+	  else if(end-p<7 || memcmp(p,"\"trade\"",7)) return -1;
+	  found|=1;
+	  p+=(tr->aggregate?10:7);
+	  break;
+
+	case 'E':
+	  p=scan_uint(p,end,&tr->eventtime);
+	  break;
+
+	case 'T':
+	  p=scan_uint(p,end,&tr->tradetime);
+	  found|=8;
+	  break;
+
+	case 'p':
+
+	  if(*p!='"' || !(p=scan_decimal(p+1,end,&tr->price)) || p==end || *p!='"') return -1;
+	  ++p;
+	  found|=2;
+	  break;
+
+	case 'q':
+
+	  if(*p!='"' || !(p=scan_decimal(p+1,end,&tr->quantity)) || p==end || *p!='"') return -1;
+	  ++p;
+	  found|=4;
+	  break;
+
+	case 't':
+	  p=scan_uint(p,end,&t);
+	  break;
+
+	case 'a':
+	  p=scan_uint(p,end,&a);
+	  break;
+
+	case 'f':
+	  p=scan_uint(p,end,&f);
+	  break;
+
+	case 'l':
+	  p=scan_uint(p,end,&l);
+	  break;
+
+	case 'm':
+	  p=scan_bool(p,end,&tr->buyermaker);
+	  break;
+
+	default:
+	  p=scan_skipvalue(p,end);
+      }
+
+    } else if(keylen==4 && !memcmp(key,"data",4) && *p=='{') return trade_scan(p, end-p, tr);
+
+    else p=scan_skipvalue(p,end);
+
+    if(!p) return -1;
+  }
+
+  if(found!=15) return -1;
+
+  //In trade payloads, "a" is the seller order id
+  if(tr->aggregate) {
+    tr->id=a;
+    tr->firstid=f;
+    tr->ntrades=(l>=f?l-f+1:1);
+
+  } else {
+    tr->id=tr->firstid=t;
+    tr->ntrades=1;
+  }
+  return 0;
+}
+
+#endif
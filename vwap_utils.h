@@ -0,0 +1,155 @@
+#ifndef _VWAP_UTILS_
+#define _VWAP_UTILS_
+
+#include <cstdint>
+#include <cmath>
+
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Batch fill queries over one side of a book. The levels are stored as
+//structure of arrays with cumulative quantities and amounts, so that all
+//the requested sizes are answered in a single merged pass and the level
+//search compares several cumulative values at once.
+
+struct vwapside
+{
+  vwapside(): price(), quantity(), sum(), amount(), bid(false), truncated(false) {}
+
+  inline void Clear(const bool& isbid){price.clear(); quantity.clear(); sum.clear(); amount.clear(); bid=isbid; truncated=false;}
+
+  //Appends the next worse level
+  inline void Push(const double& p, const double& q)
+  {
+    const double s=(sum.empty()?0:sum.back())+q;
+    const double a=(amount.empty()?0:amount.back())+p*q;
+    price.push_back(p);
+    quantity.push_back(q);
+    sum.push_back(s);
+    amount.push_back(a);
+  }
+
+  //Levels ordered from the best price, e.g. a bookvec. The x (price) and
+  //y (quantity) members are used.
+  template<typename V> inline void Assign(const V& levels, const bool& isbid)
+  {
+    const size_t n=levels.size();
+    double s=0, a=0;
+    size_t i=0;
+    price.resize(n);
+    quantity.resize(n);
+    sum.resize(n);
+    amount.resize(n);
+    bid=isbid;
+    truncated=false;
+
+    for(typename V::const_iterator it=levels.begin(); it!=levels.end(); ++it, ++i) {
+      price[i]=it->x;
+      quantity[i]=it->y;
+      s+=it->y;
+      a+=it->x*it->y;
+      sum[i]=s;
+      amount[i]=a;
+    }
+  }
+
+  inline size_t Size() const {return price.size();}
+
+  std::vector<double> price;
+  std::vector<double> quantity;
+  std::vector<double> sum; //Cumulative quantity
+  std::vector<double> amount; //Cumulative quote amount
+  bool bid;
+  //The book may hold levels beyond the copied ones, so sizes the side
+  //cannot fill are not necessarily unfillable
+  bool truncated;
+};
+
+struct vwapfill
+{
+  double quantity; //Base quantity filled
+  double amount; //Quote amount spent or received
+  double vwap;
+  double worst; //Price of the last level reached
+  double slippage; //Adverse distance of the VWAP from the best price, in bps
+};
+
+//Returns the index of the first value not less than x in v[j..n), or n
+inline static size_t vwap_search(const double* v, size_t j, const size_t& n, const double& x)
+{
+#ifdef __SSE2__
+  const __m128d vx=_mm_set1_pd(x);
+
+  for(; j+4<=n; j+=4) {
+    const int mask=_mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(v+j),vx)) | (_mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(v+j+2),vx))<<2);
+
+    if(mask) return j+__builtin_ctz(mask);
+  }
+#endif
+
+  for(; j<n && v[j]<x; ++j);
+  return j;
+}
+
+inline static void vwap_result(const vwapside& side, const size_t& j, const double& quantity, const double& amount, vwapfill* fill)
+{
+  fill->quantity=quantity;
+  fill->amount=amount;
+  fill->vwap=amount/quantity;
+  fill->worst=side.price[j];
+  fill->slippage=(side.bid?side.price[0]-fill->vwap:fill->vwap-side.price[0])/side.price[0]*1e4;
+}
+
+//Fills for base quantities. The search resumes from the previous size when
+//the sizes are sorted in increasing order, and restarts otherwise. Sizes
+//that cannot be filled by the side get NAN results. Returns the number of
+//sizes that could be filled.
+inline static size_t vwap_fill_quantities(const vwapside& side, const double* quantities, const size_t& n, vwapfill* fills)
+{
+  const size_t nlevels=side.Size();
+  const double* sum=side.sum.data();
+  size_t j=0, ret=0;
+
+  for(size_t i=0; i<n; ++i) {
+    const double q=quantities[i];
+
+    if(i && q<quantities[i-1]) j=0;
+    j=vwap_search(sum, j, nlevels, q);
+
+    if(j==nlevels || q<=0) {
+      fills[i].quantity=fills[i].amount=fills[i].vwap=fills[i].worst=fills[i].slippage=NAN;
+      continue;
+    }
+    vwap_result(side, j, q, (j?side.amount[j-1]:0)+side.price[j]*(q-(j?sum[j-1]:0)), fills+i);
+    ++ret;
+  }
+  return ret;
+}
+
+//Same as vwap_fill_quantities for quote amounts
+inline static size_t vwap_fill_amounts(const vwapside& side, const double* amounts, const size_t& n, vwapfill* fills)
+{
+  const size_t nlevels=side.Size();
+  const double* amount=side.amount.data();
+  size_t j=0, ret=0;
+
+  for(size_t i=0; i<n; ++i) {
+    const double a=amounts[i];
+
+    if(i && a<amounts[i-1]) j=0;
+    j=vwap_search(amount, j, nlevels, a);
+
+    if(j==nlevels || a<=0) {
+      fills[i].quantity=fills[i].amount=fills[i].vwap=fills[i].worst=fills[i].slippage=NAN;
+      continue;
+    }
+    vwap_result(side, j, (j?side.sum[j-1]:0)+(a-(j?amount[j-1]:0))/side.price[j], a, fills+i);
+    ++ret;
+  }
+  return ret;
+}
+
+#endif